@@ -42,56 +42,8 @@ struct CharacterParams : public ActorParams
 };
 
 
-// Base class for all the game components
-class Actor: public IActor
-{
-protected:
-	shared_ptr<ActorParams>		m_params;
-	int							m_elapsedTime;
-	int							m_timeToStart;
-	BuffList					m_buffs;
-public:
-	Actor();
-	Actor(shared_ptr<ActorParams> p);
-
-	virtual Mat4x4 const &VGetMat() {return m_params->m_Mat;}
-	virtual void VSetMat(const Mat4x4 &m) {m_params->m_Mat = m;}
-	virtual void VOnUpdate(int deltaMS);
-	virtual shared_ptr<ActorParams> VGet() {return m_params;}
-	virtual void VSetId(ActorId id) {m_params->m_Id = id;}
-	virtual void VSetParams(shared_ptr<ActorParams> p) {m_params = p;}
-	virtual bool VTakeDamage(int damage);
-	virtual void VSetDirection(Vec3 b);
-	virtual void VApplyBuff(shared_ptr<IBuff> buff);
-};
-
-
-// Used to do visual effects
-class EffectActor : public Actor
-{
-protected:
-	float			m_size;
-public:
-	EffectActor(): Actor() {}
-	EffectActor(shared_ptr<ActorParams> p, float size) : Actor(p), m_size(size) {}
-	virtual float VGetRadius() {return m_size;}
-};
-
-// A missle that will track it's target until it gets close enough.
-class MissileActor : public Actor
-{
-	ActorId m_target;
-	ActorId m_tower;
-	Mat4x4 m_location;
-
-public:
-	MissileActor(shared_ptr<MissileParams> p, ActorId id, ActorId tar): Actor(p), m_tower(id),m_target(tar),m_location(Mat4x4::g_Identity) {}
-	virtual void VOnUpdate(int deltaMS);
-	virtual void SetTarget(ActorId id);
-	virtual void OnFire(ActorId id);
-};
-
-// Modifies some part of the actor
+// Modifies some part of the actor until its time runs out. The game
+// times it, so it isn't updated while it lasts.
 class Buff: public IBuff
 {
 protected:
@@ -103,11 +55,13 @@ public:
 	Buff(ActorId id, BuffType type, int time): m_id(id),m_type(type),m_time(time) {}
 	virtual void VApply() {}
 	virtual void VRemove() {}
-	virtual bool VOnUpdate(int deltaMS) { return false;}
+	virtual int VGetDuration() {return m_time;}
 	virtual BuffType VGetType() {return m_type;}
 	virtual ActorId VGetActorId() {return m_id;}
 };
 
+const float SLOW_SPEED = 0.5f;			// of its velocity a slowed actor moves at
+
 // A buff that slows the target
 class Slow: public Buff
 {
@@ -115,5 +69,4 @@ public:
 	Slow(ActorId id):Buff(id, BT_ICE, 1100) {}
 	virtual void VApply();
 	virtual void VRemove();
-	virtual bool VOnUpdate(int deltaMS);
 };
\ No newline at end of file
@@ -0,0 +1,198 @@
+//========================================================================
+// ActorStore.cpp : The game's actors, kept as arrays of their parts.
+//========================================================================
+
+#include "StdHeader.h"
+#include "ActorStore.h"
+#include "Actors.h"
+#include "JobSystem.h"
+#include "Event.h"
+
+
+ActorStore::ActorStore()
+{
+	m_freeSlot = -1;
+	m_stepMS = 0;
+}
+
+// Slots are used again newest first. The generation starts at 1, so no id
+// is 0 or INVALID_ACTOR_ID.
+ActorId ActorStore::Create(ActorParams const &params)
+{
+	int slot = m_freeSlot;
+	if (slot >= 0)
+	{
+		m_freeSlot = m_slots[slot].m_nextFree;
+	}
+	else
+	{
+		assert(m_slots.size() < ACTOR_INDEX_MASK && "Out of actor slots");
+		ActorSlot s;
+		s.m_generation = 1;
+		slot = (int)m_slots.size();
+		m_slots.push_back(s);
+	}
+
+	ActorSlot &s = m_slots[slot];
+	s.m_dense = (int)m_ids.size();
+	s.m_nextFree = -1;
+
+	ActorId id = MakeActorId(slot, s.m_generation);
+	m_ids.push_back(id);
+	m_types.push_back(params.m_Type);
+	m_transforms.push_back(params.m_Mat);
+	m_velocities.push_back(Vec3(0, 0, 0));
+	m_health.push_back(params.m_Health);
+	m_buffs.push_back(0);
+	m_moved.push_back(0);
+
+	return id;
+}
+
+// The last actor in the arrays is moved into the gap.
+bool ActorStore::Destroy(ActorId id)
+{
+	int i = Find(id);
+	if (i < 0)
+		return false;
+
+	int last = (int)m_ids.size() - 1;
+	if (i != last)
+	{
+		m_ids[i] = m_ids[last];
+		m_types[i] = m_types[last];
+		m_transforms[i] = m_transforms[last];
+		m_velocities[i] = m_velocities[last];
+		m_health[i] = m_health[last];
+		m_buffs[i] = m_buffs[last];
+		m_moved[i] = m_moved[last];
+		m_slots[ActorIndex(m_ids[i])].m_dense = i;
+	}
+
+	m_ids.pop_back();
+	m_types.pop_back();
+	m_transforms.pop_back();
+	m_velocities.pop_back();
+	m_health.pop_back();
+	m_buffs.pop_back();
+	m_moved.pop_back();
+
+	int slot = ActorIndex(id);
+	ActorSlot &s = m_slots[slot];
+	s.m_dense = -1;
+	s.m_generation = (s.m_generation + 1) & ACTOR_GENERATION_MASK;
+	if (!s.m_generation)
+		s.m_generation = 1;
+	s.m_nextFree = m_freeSlot;
+	m_freeSlot = slot;
+
+	return true;
+}
+
+// Ids start again from the beginning, the same as a new store.
+void ActorStore::Clear()
+{
+	m_slots.clear();
+	m_freeSlot = -1;
+
+	m_ids.clear();
+	m_types.clear();
+	m_transforms.clear();
+	m_velocities.clear();
+	m_health.clear();
+	m_buffs.clear();
+	m_moved.clear();
+}
+
+int ActorStore::Find(ActorId id) const
+{
+	unsigned int slot = ActorIndex(id);
+	if (slot >= m_slots.size())
+		return -1;
+
+	ActorSlot const &s = m_slots[slot];
+	if (s.m_dense < 0 || m_ids[s.m_dense] != id)
+		return -1;
+
+	return s.m_dense;
+}
+
+bool ActorStore::AddBuff(int i, BuffType type)
+{
+	if (HasBuff(i, type))
+		return false;
+
+	m_buffs[i] |= 1u << type;
+	return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////Systems////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Each range only writes its own elements of the arrays.
+void ActorStore::MoveRange(void *pStore, int begin, int end)
+{
+	ActorStore *store = (ActorStore *)pStore;
+	float seconds = store->m_stepMS / 1000.0f;
+
+	Vec3 const *velocity = &store->m_velocities[0];
+	unsigned int const *buffs = &store->m_buffs[0];
+	Mat4x4 *transform = &store->m_transforms[0];
+	char *moved = &store->m_moved[0];
+
+	for (int i = begin; i < end; i++)
+	{
+		Vec3 const &v = velocity[i];
+		if (v.x == 0 && v.y == 0 && v.z == 0)
+			continue;
+
+		float step = (buffs[i] & (1u << BT_ICE)) ? seconds * SLOW_SPEED : seconds;
+		transform[i]._41 += v.x * step;
+		transform[i]._42 += v.y * step;
+		transform[i]._43 += v.z * step;
+		moved[i] = 1;
+	}
+}
+
+// The events are queued after the jobs are done, in array order, so a
+// replay sees them the same way.
+void ActorStore::UpdateMovement(int deltaMS)
+{
+	int count = GetCount();
+	if (!count)
+		return;
+
+	m_stepMS = deltaMS;
+	JobSystem *jobs = JobSystem::Get();
+	if (jobs)
+		jobs->ParallelFor(count, 0, MoveRange, this);
+	else
+		MoveRange(this, 0, count);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (!m_moved[i])
+			continue;
+
+		m_moved[i] = 0;
+		safeQueueEvent(EventPtr (SAFE_NEW Evt_Move_Actor(m_ids[i], m_transforms[i])));
+	}
+}
+
+// Goes from the back, so the actor moved into a gap has been looked at.
+void ActorStore::UpdateHealth()
+{
+	for (int i = GetCount() - 1; i >= 0; i--)
+	{
+		if (m_health[i] > 0)
+			continue;
+
+		ActorId id = m_ids[i];
+		Destroy(id);
+		safeQueueEvent(EventPtr (SAFE_NEW Evt_Remove_Actor(id)));
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+//========================================================================
+// ActorStore.h : The game's actors, kept as arrays of their parts.
+//
+// Each part an actor has (where it is, how fast it's going, its health,
+// its buffs) is in an array of its own, and an actor is the same element
+// of each one. The arrays have no gaps, a removed actor's place is taken
+// by the last one, so the systems that update actors go straight down the
+// arrays they need and touch nothing else.
+//
+// An id is the actor's slot in the store and the slot's generation, see
+// ActorIndex. The slot says where the actor is in the arrays, and an id
+// left over from an actor that's gone doesn't match the generation of
+// whatever took its slot.
+//========================================================================
+
+#include "StdHeader.h"
+#include <vector>
+
+class ActorStore
+{
+	struct ActorSlot
+	{
+		int m_dense;					// element in the arrays, -1 when the slot's free
+		unsigned int m_generation;
+		int m_nextFree;
+	};
+
+	std::vector<ActorSlot> m_slots;
+	int m_freeSlot;
+
+	// Element i of each of these is the same actor.
+	std::vector<ActorId> m_ids;
+	std::vector<ActorType> m_types;
+	std::vector<Mat4x4> m_transforms;
+	std::vector<Vec3> m_velocities;		// units a second, before buffs
+	std::vector<int> m_health;
+	std::vector<unsigned int> m_buffs;	// a bit for each BuffType it has
+	std::vector<char> m_moved;			// set by the movement system, not bool so threads can share it
+
+	int m_stepMS;						// for the movement jobs
+
+	static void MoveRange(void *pStore, int begin, int end);
+
+public:
+	ActorStore();
+
+	// The new actor starts where the params say, not moving.
+	ActorId Create(ActorParams const &params);
+	bool Destroy(ActorId id);
+	void Clear();
+
+	// The actor's element in the arrays, or -1 if it's gone. Elements move
+	// when actors are destroyed, so don't keep them past that.
+	int Find(ActorId id) const;
+	bool IsAlive(ActorId id) const { return Find(id) >= 0; }
+	int GetCount() const { return (int)m_ids.size(); }
+
+	ActorId GetId(int i) const { return m_ids[i]; }
+	ActorType GetType(int i) const { return m_types[i]; }
+	Mat4x4 &Transform(int i) { return m_transforms[i]; }
+	// Actors start still. Nothing in the game gives them a velocity yet,
+	// the player's character is moved by Evt_Try_Move_Actor instead.
+	Vec3 &Velocity(int i) { return m_velocities[i]; }
+	int &Health(int i) { return m_health[i]; }
+
+	// False if it has a buff of that type already.
+	bool AddBuff(int i, BuffType type);
+	void RemoveBuff(int i, BuffType type) { m_buffs[i] &= ~(1u << type); }
+	bool HasBuff(int i, BuffType type) const { return (m_buffs[i] & (1u << type)) != 0; }
+
+	// Systems, run once a step on the game's thread.
+
+	// Moves every actor by its velocity, slowed by its buffs, spread over
+	// the job threads, then queues a move event for those that went anywhere.
+	void UpdateMovement(int deltaMS);
+
+	// Destroys actors whose health has run out and queues their removal
+	// for everything else.
+	void UpdateHealth();
+};
@@ -0,0 +1,122 @@
+//========================================================================
+// CoProcess.cpp : Processes written as a sequence instead of a state machine.
+//========================================================================
+
+#include "StdHeader.h"
+#include "CoProcess.h"
+#include "Game.h"
+#include "..\ResourceCache\ResCache2.h"
+#include <set>
+
+typedef std::multimap<unsigned int, CoProcess *> CoProcessWaitMap;
+
+// One listener for every process waiting on events, as listeners can't be
+// taken off the event manager again. It's added for a type the first time a
+// process waits on it.
+class CoProcessListener: public IEventListener
+{
+	CoProcessWaitMap m_waiting;
+	std::set<unsigned int> m_types;
+
+public:
+	void Wait(EventType const &type, CoProcess *process);
+	void Cancel(CoProcess *process);
+	virtual bool HandleEvent(Event const & e);
+};
+
+static EventListenerPtr s_listener;
+
+static CoProcessListener *GetListener()
+{
+	if (!s_listener)
+		s_listener.reset(SAFE_NEW CoProcessListener());
+	return (CoProcessListener *)s_listener.get();
+}
+
+void CoProcessListener::Wait(EventType const &type, CoProcess *process)
+{
+	if (m_types.insert(type.getId()).second)
+		safeAddListener(s_listener, type);
+
+	m_waiting.insert(CoProcessWaitMap::value_type(type.getId(), process));
+}
+
+void CoProcessListener::Cancel(CoProcess *process)
+{
+	CoProcessWaitMap::iterator it = m_waiting.lower_bound(process->m_waitingFor);
+	while (it != m_waiting.end() && (*it).first == process->m_waitingFor)
+	{
+		if ((*it).second == process)
+		{
+			m_waiting.erase(it);
+			return;
+		}
+		it++;
+	}
+}
+
+// Lets everything waiting on the type carry on at its next update.
+bool CoProcessListener::HandleEvent(Event const & e)
+{
+	CoProcessWaitMap::iterator begin = m_waiting.lower_bound(e.getId());
+	CoProcessWaitMap::iterator end = m_waiting.upper_bound(e.getId());
+	for (CoProcessWaitMap::iterator it = begin; it != end; it++)
+		(*it).second->m_waitingFor = 0;
+
+	m_waiting.erase(begin, end);
+	return false;
+}
+
+
+CoProcess::CoProcess(int type, ActorId id):Process(type, id)
+{
+	m_coState = 0;
+	m_waitingFor = 0;
+	m_loading = false;
+	m_loaded = 0;
+}
+
+// A load not done yet would set m_loaded after the process is gone.
+CoProcess::~CoProcess()
+{
+	if (m_waitingFor)
+		GetListener()->Cancel(this);
+
+	if (m_loading && !m_loaded)
+		g_App->m_ResCache->CancelLoad(&m_loaded);
+}
+
+void CoProcess::OnUpdate(int deltaMS)
+{
+	Process::OnUpdate(deltaMS);
+
+	if (m_waitingFor)
+		return;
+
+	if (m_loading)
+	{
+		if (!m_loaded)
+			return;
+		m_loading = false;
+	}
+
+	VRun(deltaMS);
+}
+
+void CoProcess::WaitForEvent(EventType const &type)
+{
+	if (m_waitingFor)
+		GetListener()->Cancel(this);
+
+	m_waitingFor = type.getId();
+	GetListener()->Wait(type, this);
+}
+
+// The load blocks on the disk, so it's kept off the job threads, where it
+// would hold up whatever the game waits on them for. Only the cache is read
+// in, whoever wants the resource still calls Get, which is then a hit.
+void CoProcess::StartLoad(std::string const &name)
+{
+	m_loading = true;
+	g_App->m_ResCache->LoadAsync(name, &m_loaded);
+}
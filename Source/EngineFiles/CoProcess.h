@@ -0,0 +1,83 @@
+#pragma once
+//========================================================================
+// CoProcess.h : Processes written as a sequence instead of a state machine.
+//
+// VRun is written top to bottom between CO_BEGIN and CO_END, and the CO_
+// macros leave it part way and carry on from the same place next time,
+// the way Duff's device jumps into a loop. Nothing is kept on the stack
+// across a wait, so anything that has to last goes in a member:
+//
+//	void VRun(int deltaMS)
+//	{
+//		CO_BEGIN;
+//		for (m_spawned = 0; m_spawned < 10; m_spawned++)
+//		{
+//			SpawnCreep();
+//			CO_WAIT(500);
+//		}
+//		CO_AWAIT_EVENT(Evt_Remove_Actor::gkType);
+//		CO_END;
+//	}
+//
+// A switch can't be used in VRun across a wait, as the macros are cases of
+// their own switch. Waiting on a delay takes the process off the update
+// through Process::Sleep. While waiting on an event or a load VRun isn't called.
+// Processes are allocated from the EventPool's blocks, as they're made and
+// dropped as often as events.
+//========================================================================
+
+#include "StdHeader.h"
+#include "Process.h"
+#include "EventPool.h"
+
+// Each wait needs its own case, __COUNTER__ gives one (__LINE__ isn't a
+// constant with edit and continue).
+#define CO_BEGIN				switch (m_coState) { case 0:
+#define CO_END					} Kill(); return
+#define CO_SUSPEND(n)			do { m_coState = (n); return; case (n):; } while (0)
+
+// Carries on at the next update.
+#define CO_YIELD				CO_SUSPEND(__COUNTER__ + 1)
+
+// Carries on once ms have passed, without being updated in between.
+#define CO_WAIT(ms)				do { Sleep(ms); CO_YIELD; } while (0)
+
+// Carries on once cond is true, checked every update.
+#define CO_WAIT_UNTIL(cond)		while (!(cond)) CO_YIELD
+
+// Carries on after the next event of the type is sent.
+#define CO_AWAIT_EVENT(type)	do { WaitForEvent(type); CO_YIELD; } while (0)
+
+// Carries on once the resource is in the cache, loaded on the cache's thread.
+#define CO_AWAIT_LOAD(name)		do { StartLoad(name); CO_YIELD; } while (0)
+
+class CoProcess: public Process
+{
+	friend class CoProcessListener;
+
+	int m_coState;					// where VRun carries on from, 0 is the start
+	unsigned int m_waitingFor;		// event type id, 0 when not waiting
+	bool m_loading;
+	volatile LONG m_loaded;			// set by the cache's load thread
+
+protected:
+	// The sequence, see above.
+	virtual void VRun(int deltaMS)=0;
+
+	void WaitForEvent(EventType const &type);
+	void StartLoad(std::string const &name);
+
+public:
+	CoProcess(int type, ActorId id = -1);
+	virtual ~CoProcess();
+
+	virtual void OnUpdate(int deltaMS);
+
+	static void * operator new(size_t size) { return EventPool::Alloc(size); }
+	static void operator delete(void * p, size_t size) { EventPool::Free(p, size); }
+#if defined(_DEBUG)
+	// Matches SAFE_NEW, see Event.
+	static void * operator new(size_t size, int, const char *, int) { return EventPool::Alloc(size); }
+	static void operator delete(void *, int, const char *, int) {}
+#endif
+};
@@ -0,0 +1,44 @@
+//========================================================================
+// FixedStep.cpp : Runs the simulation in steps of the same length however
+// long the frames take.
+//========================================================================
+
+#include "StdHeader.h"
+#include "FixedStep.h"
+
+FixedStepDriver::FixedStepDriver(unsigned int stepMS, unsigned int maxSteps)
+{
+	m_stepMS = stepMS > 0 ? stepMS : 1;
+	m_maxSteps = maxSteps > 0 ? maxSteps : 1;
+	Reset();
+}
+
+void FixedStepDriver::Reset()
+{
+	m_accumulator = 0;
+	m_steps = 0;
+	m_frames = 0;
+	m_framesBehind = 0;
+	m_droppedMS = 0;
+}
+
+unsigned int FixedStepDriver::Advance(unsigned int elapsedMS)
+{
+	m_frames++;
+	m_accumulator += elapsedMS;
+
+	unsigned int steps = m_accumulator / m_stepMS;
+	if (steps > m_maxSteps)
+	{
+		// What's left over from the last step is kept so the alpha stays right.
+		unsigned int dropped = (steps - m_maxSteps) * m_stepMS;
+		m_accumulator -= dropped;
+		m_droppedMS += dropped;
+		m_framesBehind++;
+		steps = m_maxSteps;
+	}
+
+	m_accumulator -= steps * m_stepMS;
+	m_steps += steps;
+	return steps;
+}
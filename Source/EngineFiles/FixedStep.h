@@ -0,0 +1,42 @@
+#pragma once
+//========================================================================
+// FixedStep.h : Runs the simulation in steps of the same length however
+// long the frames take.
+//
+// The frame time goes into an accumulator and whole steps are taken out of
+// it. What's left is how far the next step has got, which the views use to
+// draw things part way between the last two steps. If the steps fall behind
+// (a slow frame, a breakpoint) only a few are run and the rest of the time
+// is thrown away, so catching up can't take longer than the frame it's for.
+//========================================================================
+
+#include "StdHeader.h"
+
+class FixedStepDriver
+{
+	unsigned int m_stepMS;
+	unsigned int m_maxSteps;			// most steps run for one frame
+	unsigned int m_accumulator;			// time not yet stepped, in ms
+
+	unsigned int m_steps;
+	unsigned int m_frames;
+	unsigned int m_framesBehind;		// frames that threw time away
+	unsigned int m_droppedMS;
+
+public:
+	FixedStepDriver(unsigned int stepMS, unsigned int maxSteps);
+
+	// Adds the frame's time and returns how many steps to run for it.
+	unsigned int Advance(unsigned int elapsedMS);
+
+	// How far it is from the last step to the next one, from 0 up to 1.
+	float GetAlpha() const { return (float)m_accumulator / (float)m_stepMS; }
+
+	unsigned int GetStepMS() const { return m_stepMS; }
+	unsigned int GetStepCount() const { return m_steps; }
+	unsigned int GetFrameCount() const { return m_frames; }
+	unsigned int GetFramesBehind() const { return m_framesBehind; }
+	unsigned int GetDroppedMS() const { return m_droppedMS; }
+
+	void Reset();
+};
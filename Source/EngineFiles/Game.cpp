@@ -31,11 +31,15 @@ GameApp *g_App;
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 // Basic Constructor
-GameApp::GameApp():m_eventManager()
+GameApp::GameApp():m_eventManager(), m_stepDriver(SIMULATION_STEP_MS, MAX_SIMULATION_STEPS)
 {
 	g_App = this;
 	m_pGame = NULL;
 	m_ResCache = NULL;
+	m_dumpResStats = false;
+	m_dumpEventStats = false;
+	m_replaying = false;
+	m_headlessSteps = 0;
 }
 
 // Called before the object is destroyed to clean up variables.
@@ -43,8 +47,23 @@ int GameApp::OnClose()
 {
 	SAFE_DELETE(m_pGame);
 
+	m_eventManager.setJournal(NULL);
+	m_journal.Close();
+
+	m_jobSystem.Shutdown();
+
+	m_eventManager.setProfiler(NULL);
+	if (m_dumpEventStats)
+		m_eventProfiler.DumpReport(EVENT_STATS);
+
 	DestroyWindow(GetHwnd());
 
+	if (m_ResCache && m_ResCache->IsRecording())
+		m_ResCache->StopRecording(RESOURCE_MANIFEST);
+
+	if (m_ResCache && m_dumpResStats)
+		m_ResCache->DumpStats(RESOURCE_STATS);
+
 	SAFE_DELETE(m_ResCache);
 	return 0;
 }
@@ -126,13 +145,60 @@ bool GameApp::InitInstance(HINSTANCE hInstance, LPTSTR lpCommandLine)
 
 	}
 	
-	// Opens the resource needed for the game.
-	m_ResCache = SAFE_NEW ResCache(5, SAFE_NEW ResourceZipFile(_T("Q3Game.zip")));
+	// Opens the resource needed for the game. A native pack built with ZipPack -pak
+	// is used over the zip when there is one.
+	IResourceFile *resFile;
+	if (GetFileAttributes(RESOURCE_PACK) != INVALID_FILE_ATTRIBUTES)
+		resFile = SAFE_NEW ResourcePackFile(RESOURCE_PACK);
+	else
+		resFile = SAFE_NEW ResourceZipFile(RESOURCE_ZIP);
+
+	m_ResCache = SAFE_NEW ResCache(5, resFile, 2);
 	if (!m_ResCache->Init())
 	{
 		return false;
 	}
 
+	// Either records the order resources get used in, or replays the last
+	// recording as background loads so they're ready before they're asked for.
+	if (_tcsstr(lpCommandLine, _T("-recordmanifest")))
+		m_ResCache->StartRecording();
+	else
+		m_ResCache->Prefetch(RESOURCE_MANIFEST);
+
+	m_dumpResStats = _tcsstr(lpCommandLine, _T("-resstats")) != NULL;
+
+	// One thread per processor for process and actor updates.
+	m_jobSystem.Init(0);
+
+	// Times every event and listener, the report is written on close.
+	m_dumpEventStats = _tcsstr(lpCommandLine, _T("-eventstats")) != NULL;
+	if (m_dumpEventStats)
+		m_eventManager.setProfiler(&m_eventProfiler);
+
+	// Plays a recorded journal into a game with no window or view, see RunReplay.
+	if (_tcsstr(lpCommandLine, _T("-replay")))
+	{
+		m_replaying = true;
+		m_pGame = CreateHeadlessGame();
+		return m_pGame != NULL;
+	}
+
+	// Runs the game with no window as fast as the steps will go, see RunHeadless.
+	// A number after it sets how many steps.
+	const _TCHAR *headless = _tcsstr(lpCommandLine, _T("-headless"));
+	if (headless)
+	{
+		int steps = _tcstol(headless + _tcslen(_T("-headless")), NULL, 10);
+		m_headlessSteps = steps > 0 ? steps : HEADLESS_STEPS;
+		m_pGame = CreateHeadlessGame();
+		return m_pGame != NULL;
+	}
+
+	// Records the session's events so it can be replayed.
+	if (_tcsstr(lpCommandLine, _T("-journal")) && m_journal.Open(EVENT_JOURNAL))
+		m_eventManager.setJournal(&m_journal);
+
 	// Basic DXUT initialization.
 	DXUTInit(true, true, true);
 
@@ -322,11 +388,18 @@ void CALLBACK GameApp::OnUpdateGame( IDirect3DDevice9* pd3dDevice, double fTime,
 		return;
 	}
 
-	// Update the game.
+	// Update the game in fixed steps, however long the frame took. The time
+	// left over draws moving actors part way between the last two steps.
 	if (g_App->m_pGame)
 	{
-		safeTick( 20 );
-		g_App->m_pGame->OnUpdate(elapsedTime);
+		unsigned int steps = g_App->m_stepDriver.Advance(elapsedTime);
+		for (unsigned int i = 0; i < steps; i++)
+		{
+			g_App->m_journal.BeginFrame(SIMULATION_STEP_MS);
+			safeTick( 20 );
+			g_App->m_pGame->OnUpdate(SIMULATION_STEP_MS);
+		}
+		g_App->m_pGame->Interpolate(g_App->m_stepDriver.GetAlpha());
 	}
 }
 
@@ -387,6 +460,117 @@ Q3Game* GameApp::CreateGameAndView()
 	return game;
 }
 
+// Creates a game with the map and the player's character but no view, for replays.
+Q3Game* GameApp::CreateHeadlessGame()
+{
+	Q3Game* game = SAFE_NEW Q3Game();
+	if (game)
+	{
+		game->AddMap(VLoadMap());
+
+		// Same as the human view gets, so actor ids match the recording.
+		shared_ptr<CharacterParams> cp(SAFE_NEW CharacterParams());
+		cp->m_Mat = Mat4x4::g_Identity;
+		game->CreateCharacter(cp);
+	}
+	return game;
+}
+
+// Plays the journal back as fast as it will go, then writes how long it took.
+// Each frame ticks the events, updates the game with the recorded time and
+// then sends the events recorded in that frame.
+int GameApp::RunReplay()
+{
+	EventJournalPlayer player;
+	if (!player.Open(EVENT_JOURNAL))
+		return 1;
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	unsigned int frames = 0;
+	unsigned int deltaMS;
+	while (player.NextFrame(deltaMS))
+	{
+		safeTick(INFINITE);
+		m_pGame->OnUpdate(deltaMS);
+		player.SendFrameEvents();
+		frames++;
+	}
+
+	QueryPerformanceCounter(&end);
+	double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+
+	FILE *file = _wfopen(REPLAY_REPORT, _T("wt"));
+	if (file)
+	{
+		fprintf(file, "frames %u\nevents %u\ntime %.1f ms\nper frame %.3f ms\n", frames, player.GetSentCount(), ms, frames ? ms / frames : 0.0);
+		WriteTimerStats(file);
+		fclose(file);
+	}
+
+	CloseHeadless();
+	return 0;
+}
+
+// Runs the steps through the same driver as the windowed game, with a step's
+// worth of time each, so nothing waits on the clock. Writes how long it took.
+int GameApp::RunHeadless()
+{
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	m_stepDriver.Reset();
+	while (m_stepDriver.GetStepCount() < m_headlessSteps)
+	{
+		unsigned int steps = m_stepDriver.Advance(SIMULATION_STEP_MS);
+		for (unsigned int i = 0; i < steps; i++)
+		{
+			safeTick(INFINITE);
+			m_pGame->OnUpdate(SIMULATION_STEP_MS);
+		}
+	}
+
+	QueryPerformanceCounter(&end);
+	double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+	unsigned int steps = m_stepDriver.GetStepCount();
+
+	FILE *file = _wfopen(HEADLESS_REPORT, _T("wt"));
+	if (file)
+	{
+		fprintf(file, "steps %u\ngame time %u ms\ntime %.1f ms\nper step %.3f ms\n",
+			steps, steps * SIMULATION_STEP_MS, ms, steps ? ms / steps : 0.0);
+		WriteTimerStats(file);
+		fclose(file);
+	}
+
+	CloseHeadless();
+	return 0;
+}
+
+// How the game's timers were used, for the run reports.
+void GameApp::WriteTimerStats(FILE *file)
+{
+	TimerStats const &stats = m_pGame->m_processManager.GetTimers().GetStats();
+	fprintf(file, "timers pending %u (most %u)\ntimers started %u cancelled %u fired %u\nmost fired in a step %u\nsleeping processes %u\n",
+		stats.m_pending, stats.m_maxPending, stats.m_started, stats.m_cancelled, stats.m_fired,
+		stats.m_maxFiredInTick, m_pGame->m_processManager.GetSleepingCount());
+}
+
+// Cleans up after a run with no window, OnClose does it for the windowed game.
+void GameApp::CloseHeadless()
+{
+	SAFE_DELETE(m_pGame);
+	SAFE_DELETE(m_ResCache);
+	m_jobSystem.Shutdown();
+
+	m_eventManager.setProfiler(NULL);
+	if (m_dumpEventStats)
+		m_eventProfiler.DumpReport(EVENT_STATS);
+}
+
 shared_ptr<Q3Map> GameApp::VLoadMap()
 {
 	MapFileParser m;
@@ -405,33 +589,32 @@ shared_ptr<Q3Map> GameApp::VLoadMap()
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 // Listener for Game events.
-void ListenForGameEvents(EventListenerPtr listener)
+void ListenForGameEvents(EventBatchListenerPtr listener)
 {
-	safeAddListener( listener, EventType(Evt_New_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Remove_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Move_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Change_GameState::gkName) );
-	safeAddListener( listener, EventType(Evt_Damage_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Apply_Buff::gkName) );
-	safeAddListener( listener, EventType(Evt_Create_Missile::gkName) );
-	safeAddListener( listener, EventType(Evt_Left_Click::gkName) );
-	safeAddListener( listener, EventType(Evt_Try_Move_Actor::gkName) );
+	safeAddListener( listener, Evt_New_Actor::gkType );
+	safeAddListener( listener, Evt_Remove_Actor::gkType );
+	safeAddBatchListener( listener, Evt_Move_Actor::gkType );
+	safeAddListener( listener, Evt_Change_GameState::gkType );
+	safeAddListener( listener, Evt_Damage_Actor::gkType );
+	safeAddListener( listener, Evt_Apply_Buff::gkType );
+	safeAddListener( listener, Evt_Create_Missile::gkType );
+	safeAddListener( listener, Evt_Left_Click::gkType );
+	safeAddListener( listener, Evt_Try_Move_Actor::gkType );
 }
 
 // Base constructor, adds listener.
-Q3Game::Q3Game()
+Q3Game::Q3Game():m_spatial(SPATIAL_CELL_SIZE, SPATIAL_BUCKETS)
 {
 	m_data.m_timeLeftUntilWave = 0;
 	m_data.m_waveTimeLimit = 10000;
 	m_data.m_curWave = 1;
 	m_data.m_curMoney = 6;
 	m_data.m_curLife = 10;
-	m_LastActorId = 0;
 	m_status = Game_Initializing;
 	m_curTowerType = -1;
 	m_selectedTower = 0;
 
-	EventListenerPtr gameLogicListener (SAFE_NEW GameLogicListener( this) );
+	EventBatchListenerPtr gameLogicListener (SAFE_NEW GameLogicListener( this) );
 	ListenForGameEvents(gameLogicListener);
 	m_eventListener = gameLogicListener;
 }
@@ -439,13 +622,8 @@ Q3Game::Q3Game()
 // Clears out all actors and flushes process list.
 Q3Game::~Q3Game()
 {
-	while(!m_pActorMap.empty())
-	{
-		ActorMap::iterator it = m_pActorMap.begin();
-		ActorId id = (*it).first;
-		m_pActorMap.erase(it);
-	}
-
+	m_actors.Clear();
+	m_spatial.Clear();
 	m_processManager.DeleteProcessList();
 }
 
@@ -458,16 +636,19 @@ void Q3Game::OnUpdate(int deltaMS)
 		(*i)->VOnUpdate( deltaMS );
 	}
 
+	// Whatever the simulation sends comes from the game's state and the
+	// input already recorded, so a replay shouldn't send it again.
+	safeBeginDerived();
+
 	switch (m_status)
 	{
 		// Main game running status, updates processes/actors, checks for win/lose condition, spawns waves
 		case Game_Running:
 			m_processManager.UpdateProcesses(deltaMS);
-			for(ActorMap::iterator it=m_pActorMap.begin(); it != m_pActorMap.end(); it++)
-			{
-				shared_ptr<IActor> actor = it->second;
-				actor->VOnUpdate( deltaMS );
-			}
+
+			// Whole arrays at a time, see ActorStore.
+			m_actors.UpdateMovement(deltaMS);
+			m_actors.UpdateHealth();
 			break;
 		
 		// Starting a new game.
@@ -479,6 +660,17 @@ void Q3Game::OnUpdate(int deltaMS)
 		case Game_Pause:
 			break;
 	}	
+
+	safeEndDerived();
+}
+
+// Lets the views draw moving actors part way between the last two steps.
+void Q3Game::Interpolate(float alpha)
+{
+	for(GameViewList::iterator i=m_viewList.begin(); i!=m_viewList.end(); ++i)
+	{
+		(*i)->VInterpolate( alpha );
+	}
 }
 
 // Creates the basic scene for the game and sets up the tower types.
@@ -487,13 +679,15 @@ void Q3Game::BuildInitialScene()
 	safeTriggerEvent(Evt_RebuildUI());
 }
 
-// Adds an actor to the actor list, sends event to add actors elsewhere.
-void Q3Game::VAddActor(shared_ptr<IActor> actor)
+// Adds an actor to the store, sends event to add actors elsewhere. The
+// params are only used to make it, the store keeps what the game needs.
+ActorId Q3Game::VAddActor(shared_ptr<ActorParams> p)
 {
-	m_pActorMap[m_LastActorId] = actor;
-	actor->VSetId(m_LastActorId);
-	m_LastActorId++;
-	safeQueueEvent(EventPtr (SAFE_NEW Evt_New_Actor(actor->VGet())));
+	p->m_Id = m_actors.Create(*p);
+	if (p->m_Type != AT_GROUND)
+		m_spatial.Insert(p->m_Id, p->m_Mat.GetPosition());
+	safeQueueEvent(EventPtr (SAFE_NEW Evt_New_Actor(p)));
+	return p->m_Id;
 }
 
 // Changes the game state.
@@ -502,26 +696,23 @@ void Q3Game::VGameStatusChange(GameStatus status)
 	m_status = status;
 }
 
-// Removes an actor from the actor list.
+// Removes an actor from the store. It may be gone already, if its health
+// ran out.
 void Q3Game::VRemoveActor(ActorId id)
 {
-	ActorMap::iterator it = m_pActorMap.find(id);
-	if (it == m_pActorMap.end())
-		return;
-
-	shared_ptr<IActor> actor = (*it).second;
-	m_pActorMap.erase(id);
+	m_actors.Destroy(id);
+	m_spatial.Remove(id);
 }
 
 // Moves an actor to the new location.
 void Q3Game::VMoveActor(ActorId id, const Mat4x4 &m)
 {
-	if (id < m_LastActorId)
-	{
-		shared_ptr<IActor> actor = m_pActorMap[id];
-		if (actor)
-			actor->VSetMat(m);
-	}
+	int i = m_actors.Find(id);
+	if (i < 0)
+		return;
+
+	m_actors.Transform(i) = m;
+	m_spatial.Move(id, m.GetPosition());
 }
 
 // Adds a view to the view list.
@@ -545,8 +736,7 @@ void Q3Game::CreateGrid()
 	p->m_Mat = Mat4x4::g_Identity;
 	p->m_hasTextureAlpha = false;
 	p->m_Type = AT_GROUND;
-	shared_ptr<IActor> actor (SAFE_NEW Actor(p));
-	VAddActor(actor);
+	VAddActor(p);
 }
 
 // Creates a missle to fire at the tower's target.
@@ -556,37 +746,64 @@ void Q3Game::CreateMissile(ActorId id)
 	//create missile here
 }
 
-// Gets the pointer to the actor with this id.
-shared_ptr<IActor> Q3Game::GetActor(ActorId id)
+// Deals damage to the actor of this id. It's removed at the end of the
+// step if that's the last of its health.
+void Q3Game::DamageActor(ActorId id, int damage)
 {
-	ActorMap::iterator it = m_pActorMap.find(id);
-	shared_ptr<IActor> actor;
-
-	//actor = m_pActorMap[id];
-
-	if (it != m_pActorMap.end())
-		actor = it->second;
-
-	return actor;
+	int i = m_actors.Find(id);
+	if (i >= 0)
+		m_actors.Health(i) -= damage;
 }
 
-// Deals damage to the actor of this id.
-void Q3Game::DamageActor(ActorId id, int damage)
+// Applys a buff to the actor. Can only have 1 buff of each type going at a time.
+// Buffs are put on a timer to be taken off again, so nothing looks at them
+// while they last.
+void Q3Game::ApplyBuffToActor(ActorId id, shared_ptr<IBuff> buff)
 {
-	/*if (id > 2)
-		m_pActorMap[id]->VTakeDamage(damage);*/
+	int i = m_actors.Find(id);
+	if (i < 0 || !m_actors.AddBuff(i, buff->VGetType()))
+		return;
+
+	buff->VApply();
+	m_buffTimers[m_processManager.GetTimers().Start(buff->VGetDuration(), ExpireBuff, this)] = buff;
 }
 
-// Applys a buff to the actor.
-void Q3Game::ApplyBuffToActor(ActorId id, shared_ptr<IBuff> buff)
+// Takes a buff off when its time is up, if the actor's still there.
+void Q3Game::ExpireBuff(void *pGame, TimerId id)
 {
-	m_pActorMap[id]->VApplyBuff(buff);
+	Q3Game *game = (Q3Game *)pGame;
+	std::map<TimerId, shared_ptr<IBuff> >::iterator it = game->m_buffTimers.find(id);
+	if (it == game->m_buffTimers.end())
+		return;
+
+	shared_ptr<IBuff> buff = (*it).second;
+	game->m_buffTimers.erase(it);
+
+	int i = game->m_actors.Find(buff->VGetActorId());
+	if (i < 0)
+		return;
+
+	game->m_actors.RemoveBuff(i, buff->VGetType());
+	buff->VRemove();
 }
 
-// Used when the mouse if right clicked.
+// Used when the mouse if right clicked. Selects the nearest placed actor
+// close enough to the click. The player, effects and missiles are in the
+// hash too, so they're passed over.
 void Q3Game::RightClick(Vec3 l)
 {
+	std::vector<ActorId> nearest;
+	m_spatial.QueryNearest(l, SELECT_CANDIDATES, SELECT_RADIUS, nearest);
 
+	for (unsigned int n = 0; n < nearest.size(); n++)
+	{
+		int i = m_actors.Find(nearest[n]);
+		if (i >= 0 && m_actors.GetType(i) == AT_Q3)
+		{
+			SelectTower(nearest[n]);
+			return;
+		}
+	}
 }
 
 float Dist2d(Vec3 a, Vec3 b)
@@ -632,13 +849,13 @@ Vec3 Q3Game::Move(Vec3 start, Vec3 end, float size)
 void Q3Game::AttemptActorMove(ActorId id, Mat4x4 m, float deltaMS)
 {
 	float size = 40.0f;
-	shared_ptr<IActor> actor = GetActor(id);
-	if (actor)
+	int i = m_actors.Find(id);
+	if (i >= 0)
 	{
 		Mat4x4 mat = m;
-		if (actor->VGet()->m_Mat.GetPosition() != m.GetPosition())
+		if (m_actors.Transform(i).GetPosition() != m.GetPosition())
 		{
-			Vec3 start = actor->VGet()->m_Mat.GetPosition();
+			Vec3 start = m_actors.Transform(i).GetPosition();
 			Vec3 end = m.GetPosition()+g_Up*10;
 
 			Vec3 stepMove = Move(start, end, size);
@@ -653,11 +870,7 @@ void Q3Game::AttemptActorMove(ActorId id, Mat4x4 m, float deltaMS)
 
 ActorId Q3Game::CreateCharacter(shared_ptr<CharacterParams> p)
 {
-	shared_ptr<IActor> character (new Actor(p));
-	VAddActor(character);
-	ActorId id = character->VGet()->m_Id;
-	assert(id >= 0 && "Wrong Character ID");
-	return id;
+	return VAddActor(p);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -667,23 +880,23 @@ ActorId Q3Game::CreateCharacter(shared_ptr<CharacterParams> p)
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 // Listener for human view events.
-void ListenForViewEvents(EventListenerPtr listener)
+void ListenForViewEvents(EventBatchListenerPtr listener)
 {
-	safeAddListener( listener, EventType(Evt_New_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Move_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Move_Camera::gkName) );
-	safeAddListener( listener, EventType(Evt_Remove_Actor::gkName) );
-	safeAddListener( listener, EventType(Evt_Change_GameState::gkName) );
-	safeAddListener( listener, EventType(Evt_Shot::gkName ) );
-	safeAddListener( listener, EventType(Evt_Remove_Effect::gkName ) );
-	safeAddListener( listener, EventType(Evt_Device_Created::gkName) );
-	safeAddListener( listener, EventType(Evt_RebuildUI::gkName) );
-	safeAddListener( listener, EventType(Evt_Remove_Effect_By_Id::gkName) );
-	safeAddListener( listener, EventType(Evt_Mouse_Move::gkName) );
+	safeAddListener( listener, Evt_New_Actor::gkType );
+	safeAddBatchListener( listener, Evt_Move_Actor::gkType );
+	safeAddListener( listener, Evt_Move_Camera::gkType );
+	safeAddListener( listener, Evt_Remove_Actor::gkType );
+	safeAddListener( listener, Evt_Change_GameState::gkType );
+	safeAddListener( listener, Evt_Shot::gkType );
+	safeAddListener( listener, Evt_Remove_Effect::gkType );
+	safeAddListener( listener, Evt_Device_Created::gkType );
+	safeAddListener( listener, Evt_RebuildUI::gkType );
+	safeAddListener( listener, Evt_Remove_Effect_By_Id::gkType );
+	safeAddListener( listener, Evt_Mouse_Move::gkType );
 }
 
 // Constructor
-HumanView::HumanView():m_lastShot(0)
+HumanView::HumanView():m_lastShot(0), m_step(0)
 {
 	m_id=0;
 
@@ -704,7 +917,7 @@ HumanView::HumanView():m_lastShot(0)
 	m_pScene->SetCamera(m_pCamera);
 	m_status = Game_Initializing;
 
-	EventListenerPtr viewListener (SAFE_NEW GameViewListener( this) );
+	EventBatchListenerPtr viewListener (SAFE_NEW GameViewListener( this) );
 	ListenForViewEvents(viewListener);
 	m_eventListener = viewListener;
 	m_pFont = NULL;
@@ -753,6 +966,9 @@ bool HumanView::InitAudio()
 // Updates processes and the screen elements.
 void HumanView::VOnUpdate(int deltaMS)
 {
+	// Only the controller's events are the player's input, see Q3Game::OnUpdate.
+	safeBeginDerived();
+
 	m_processManager->UpdateProcesses(deltaMS);
 
 	switch (m_status)
@@ -768,7 +984,11 @@ void HumanView::VOnUpdate(int deltaMS)
 			(*it)->VOnUpdate(deltaMS);
 	}
 
+	safeEndDerived();
+
 	m_controller->OnUpdate(deltaMS);
+
+	m_step++;
 }
 
 // Sets view id.
@@ -949,6 +1169,7 @@ void HumanView::VOnLostDevice()
 // Removes an actor from the scene node.
 void HumanView::VRemoveActor(ActorId id)
 {
+	m_moves.erase(id);
 	m_pScene->RemoveChild(id);
 }
 
@@ -987,10 +1208,53 @@ void HumanView::VMoveActor(ActorId id, Mat4x4 const &mat)
     shared_ptr<ISceneNode> node = m_pScene->FindActor(id);
 	if (node)
 	{
+		// Where it was before its first move this step is where it's drawn from.
+		InterpolatedMove &move = m_moves[id];
+		if (!move.m_node || move.m_step != m_step)
+		{
+			move.m_node = node;
+			move.m_from = node->VGet()->ToWorld();
+			move.m_step = m_step;
+		}
 		node->VSetTransform(&mat);
 	}
 }
 
+// Draws the actors that moved in the last step part way along the move, alpha
+// being how far it is to the next step. Those that didn't are drawn where they are.
+void HumanView::VInterpolate(float alpha)
+{
+	InterpolatedMoveMap::iterator it = m_moves.begin();
+	while (it != m_moves.end())
+	{
+		InterpolatedMove &move = (*it).second;
+		if (move.m_step + 1 != m_step)
+		{
+			move.m_node->VSetRenderTransform(NULL);
+			it = m_moves.erase(it);
+			continue;
+		}
+
+		Mat4x4 const &to = move.m_node->VGet()->ToWorld();
+
+		Quaternion fromRot, toRot, rot;
+		fromRot.Build(move.m_from);
+		toRot.Build(to);
+		rot.Slerp(fromRot, toRot, alpha);
+
+		Vec3 fromPos = move.m_from.GetPosition();
+		Vec3 toPos = to.GetPosition();
+		Vec3 pos;
+		D3DXVec3Lerp(&pos, &fromPos, &toPos, alpha);
+
+		Mat4x4 mat;
+		mat.BuildRotationQuat(rot);
+		mat.SetPosition(pos);
+		move.m_node->VSetRenderTransform(&mat);
+		it++;
+	}
+}
+
 // Moves the camera to the changed location.
 void HumanView::MoveCamera(Mat4x4 const &change)
 {
@@ -1010,12 +1274,25 @@ void HumanView::AddShot(ActorId id, int time, Vec3 start, Vec3 end, std::string
 	Mat4x4 s,e;
 	s.BuildTranslation(start);
 	e.BuildTranslation(end);
-	shared_ptr<ISceneNode> object (SAFE_NEW ShotNode(id, time, m_lastShot, texture, s, e));
+	shared_ptr<ISceneNode> object (SAFE_NEW ShotNode(id, m_lastShot, texture, s, e));
+	m_shotTimers[m_processManager->GetTimers().Start(time, ExpireShot, this)] = m_lastShot;
 	++m_lastShot;
 	m_pScene->AddChild(-1, object);
 	object->VOnRestore(&*m_pScene);
 }
 
+// Asks for a shot to be taken away once it's been shown long enough.
+void HumanView::ExpireShot(void *pView, TimerId id)
+{
+	HumanView *view = (HumanView *)pView;
+	std::map<TimerId, unsigned int>::iterator it = view->m_shotTimers.find(id);
+	if (it == view->m_shotTimers.end())
+		return;
+
+	safeQueueEvent(EventPtr (SAFE_NEW Evt_Remove_Effect((*it).second)));
+	view->m_shotTimers.erase(it);
+}
+
 
 // Used for the mouse over the towers.
 void HumanView::MouseMove(Vec3 pos)
@@ -1176,7 +1453,8 @@ void HumanInterfaceController::OnUpdate(int deltaMS)
 		m_currentSpeed = 0.0f;
 	}
 
-	safeTriggerEvent(Evt_Try_Move_Actor(m_object->VGet()->ActorId(), m_matToWorld, deltaMS));
+	// Queued rather than triggered so moves made before the next tick are merged.
+	safeQueueEvent(EventPtr(SAFE_NEW Evt_Try_Move_Actor(m_object->VGet()->ActorId(), m_matToWorld, deltaMS)));
 }
 
 Mat4x4 HumanInterfaceController::CalcViewMatrix(float yaw, float pitch)
@@ -1258,50 +1536,44 @@ void HumanInterfaceController::OnMouseMove(const CPoint &mousePos)
 // Event listener for the game logic, mostly just calls the game's functions.
 bool GameLogicListener::HandleEvent(Event const & e)
 {
-	if (strcmp(e.getType().getName(), Evt_Remove_Actor::gkName)==0)
+	if (e.getId() == Evt_Remove_Actor::gkType.getId())
 	{
 		EvtData_Remove_Actor *data = e.getData<EvtData_Remove_Actor>();
 		m_game->VRemoveActor(data->m_id);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Move_Actor::gkName)==0)
-	{
-		EvtData_Move_Actor *data = e.getData<EvtData_Move_Actor>();
-		m_game->VMoveActor(data->m_id, data->m_Mat);
-	}
-	else
-	if (strcmp(e.getType().getName(), Evt_Try_Move_Actor::gkName)==0)
+	if (e.getId() == Evt_Try_Move_Actor::gkType.getId())
 	{
 		EvtData_Try_Move_Actor *data = e.getData<EvtData_Try_Move_Actor>();
 		m_game->AttemptActorMove(data->m_id, data->m_Mat, data->m_deltaMS);
 		return true;
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Change_GameState::gkName)==0)
+	if (e.getId() == Evt_Change_GameState::gkType.getId())
 	{
 		EvtData_Change_GameState *data = e.getData<EvtData_Change_GameState>();
 		m_game->VGameStatusChange(data->m_state);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Damage_Actor::gkName) == 0 )
+	if (e.getId() == Evt_Damage_Actor::gkType.getId())
 	{
 		EvtData_Damage_Actor *data = e.getData<EvtData_Damage_Actor>();
 		m_game->DamageActor(data->m_id, data->m_damage);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Apply_Buff::gkName) == 0 )
+	if (e.getId() == Evt_Apply_Buff::gkType.getId())
 	{
 		EvtData_Apply_Buff *data = e.getData<EvtData_Apply_Buff>();
 		m_game->ApplyBuffToActor(data->m_buff->VGetActorId(), data->m_buff);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Create_Missile::gkName) == 0 )
+	if (e.getId() == Evt_Create_Missile::gkType.getId())
 	{
 		EvtData_Create_Missile *data = e.getData<EvtData_Create_Missile>();
 		m_game->CreateMissile(data->m_id);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Left_Click::gkName) == 0 )
+	if (e.getId() == Evt_Left_Click::gkType.getId())
 	{
 		EvtData_Right_Click *data = e.getData<EvtData_Right_Click>();
 		m_game->RightClick(data->m_loc);
@@ -1312,10 +1584,25 @@ bool GameLogicListener::HandleEvent(Event const & e)
 	return false;
 }
 
+// Batched events, all of one type.
+bool GameLogicListener::HandleEvents(Event const * const * events, unsigned int count)
+{
+	if (events[0]->getId() == Evt_Move_Actor::gkType.getId())
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			EvtData_Move_Actor *data = events[i]->getData<EvtData_Move_Actor>();
+			m_game->VMoveActor(data->m_id, data->m_Mat);
+		}
+	}
+
+	return false;
+}
+
 // Event listener for the game view, mostly just calls the view's functions.
 bool GameViewListener::HandleEvent(Event const & e)
 {
-	if (strcmp(e.getType().getName(), Evt_New_Actor::gkName)==0)
+	if (e.getId() == Evt_New_Actor::gkType.getId())
 	{
 		EvtData_New_Actor *data = e.getData<EvtData_New_Actor>();
 		// add new actor stuff here.
@@ -1337,31 +1624,25 @@ bool GameViewListener::HandleEvent(Event const & e)
 		}
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Remove_Actor::gkName)==0)
+	if (e.getId() == Evt_Remove_Actor::gkType.getId())
 	{
 		EvtData_Remove_Actor *data = e.getData<EvtData_Remove_Actor>();
 		m_view->VRemoveActor(data->m_id);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Move_Actor::gkName)==0)
-	{
-		EvtData_Move_Actor *data = e.getData<EvtData_Move_Actor>();
-		m_view->VMoveActor(data->m_id, data->m_Mat);
-	}
-	else
-	if (strcmp(e.getType().getName(), Evt_Move_Camera::gkName)==0)
+	if (e.getId() == Evt_Move_Camera::gkType.getId())
 	{
 		EvtData_Move_Camera *data = e.getData<EvtData_Move_Camera>();
 		m_view->MoveCamera(data->m_mat);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Change_GameState::gkName)==0)
+	if (e.getId() == Evt_Change_GameState::gkType.getId())
 	{
 		EvtData_Change_GameState *data = e.getData<EvtData_Change_GameState>();
 		m_view->VGameStatusChange(data->m_state);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Shot::gkName)==0)
+	if (e.getId() == Evt_Shot::gkType.getId())
 	{
 		EvtData_Shot *data = e.getData<EvtData_Shot>();
 		m_view->AddShot(data->m_id, data->m_time, data->m_start, data->m_end, data->m_texture);
@@ -1369,30 +1650,30 @@ bool GameViewListener::HandleEvent(Event const & e)
 		m_view->Attach(sfx);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Remove_Effect::gkName)==0)
+	if (e.getId() == Evt_Remove_Effect::gkType.getId())
 	{
 		EvtData_Remove_Effect *data = e.getData<EvtData_Remove_Effect>();
 
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Remove_Effect_By_Id::gkName)==0)
+	if (e.getId() == Evt_Remove_Effect_By_Id::gkType.getId())
 	{
 		EvtData_Remove_Effect_By_Id *data = e.getData<EvtData_Remove_Effect_By_Id>();
 
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_Device_Created::gkName)==0)
+	if (e.getId() == Evt_Device_Created::gkType.getId())
 	{
 		EvtData_Device_Created *data = e.getData<EvtData_Device_Created>();
 		m_view->DeviceCreated(data->m_device);
 	}
 	else
-	if (strcmp(e.getType().getName(), Evt_RebuildUI::gkName) == 0 )
+	if (e.getId() == Evt_RebuildUI::gkType.getId())
 	{
 		m_view->RebuildUI();
 	}	
 	else
-	if (strcmp(e.getType().getName(), Evt_Mouse_Move::gkName) == 0 )
+	if (e.getId() == Evt_Mouse_Move::gkType.getId())
 	{
 		EvtData_Mouse_Move *data = e.getData<EvtData_Mouse_Move>();
 		m_view->MouseMove(data->m_pos);
@@ -1402,6 +1683,21 @@ bool GameViewListener::HandleEvent(Event const & e)
 	return false;
 }
 
+// Batched events, all of one type.
+bool GameViewListener::HandleEvents(Event const * const * events, unsigned int count)
+{
+	if (events[0]->getId() == Evt_Move_Actor::gkType.getId())
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			EvtData_Move_Actor *data = events[i]->getData<EvtData_Move_Actor>();
+			m_view->VMoveActor(data->m_id, data->m_Mat);
+		}
+	}
+
+	return false;
+}
+
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -3,14 +3,35 @@
 #include "StdHeader.h"
 #include "SceneNode.h"
 #include "Event.h"
+#include "EventJournal.h"
+#include "EventProfiler.h"
 #include "Process.h"
+#include "JobSystem.h"
+#include "FixedStep.h"
+#include "ActorStore.h"
+#include "SpatialHash.h"
 #include "Q3FileParser.h"
 #include "Actors.h"
 
 
 const double SCREEN_REFRESH_RATE(1000.0f/60.0f);
+const int	SIMULATION_STEP_MS = 16;
+const int	MAX_SIMULATION_STEPS = 5;		// steps run for one frame before time is dropped
+const int	HEADLESS_STEPS = 3750;			// a minute of game time
 const int	MAP_SIZE = 20;
 const int	HALF_MAP_SIZE = 10;
+const float	SPATIAL_CELL_SIZE = 256.0f;		// about a tower's range
+const int	SPATIAL_BUCKETS = 4096;
+const float	SELECT_RADIUS = 64.0f;			// how near a click has to be to pick an actor
+const int	SELECT_CANDIDATES = 8;			// nearest actors looked through for one that can be picked
+
+#define RESOURCE_ZIP _T("Q3Game.zip")
+#define RESOURCE_PACK _T("Q3Game.pak")
+#define RESOURCE_MANIFEST _T("Q3Game.manifest")
+#define RESOURCE_STATS _T("ResCacheStats.json")
+#define REPLAY_REPORT _T("ReplayReport.txt")
+#define HEADLESS_REPORT _T("HeadlessReport.txt")
+#define EVENT_STATS _T("EventStats.json")
 
 class HumanView;
 
@@ -81,6 +102,16 @@ public:
 
 class CSoundProcess;
 
+// A scene node that moved during a step, and where it was before it.
+struct InterpolatedMove
+{
+	shared_ptr<ISceneNode>	m_node;
+	Mat4x4					m_from;
+	unsigned int			m_step;
+};
+
+typedef std::map<ActorId, InterpolatedMove> InterpolatedMoveMap;
+
 // Human view, includes 3D renderer
 class HumanView: public IGameView
 {
@@ -104,6 +135,11 @@ class HumanView: public IGameView
 	ID3DXSprite*					m_pTextSprite;
 	unsigned int					m_lastShot;
 	ProcessManager					*m_processManager;
+	std::map<TimerId, unsigned int>	m_shotTimers;
+	static void ExpireShot(void *pView, TimerId id);
+
+	InterpolatedMoveMap				m_moves;
+	unsigned int					m_step;			// steps the view has finished
 
 
 public:
@@ -126,6 +162,7 @@ public:
 	shared_ptr<SceneNode> CreateCharacter(shared_ptr<CharacterParams> p);
 
 	void VMoveActor(ActorId id, Mat4x4 const &mat);
+	virtual void VInterpolate(float alpha);
 	void MoveCamera(Mat4x4 const &change);
 	HRESULT DeviceCreated(IDirect3DDevice9* device);
 	void Attach(shared_ptr<Process> process) {m_processManager->Attach(process);}
@@ -155,8 +192,8 @@ class Q3Game: public IGame
 {
 	friend class GameApp;
 	GameViewList		m_viewList;
-	ActorMap			m_pActorMap;
-	ActorId				m_LastActorId;
+	ActorStore			m_actors;
+	SpatialHash			m_spatial;			// where the actors are but the ground, dead ones until their remove is handled
 	GameStatus			m_status;
 	
 	EventListenerPtr	m_eventListener;
@@ -166,7 +203,10 @@ class Q3Game: public IGame
 	ActorId				m_selectedTower;
 
 	shared_ptr<Q3Map>	m_map;
+
+	std::map<TimerId, shared_ptr<IBuff> >	m_buffTimers;
 	
+	static void ExpireBuff(void *pGame, TimerId id);
 	void CreateGrid();
 	void FindNewPaths();
 	Vec3 Move(Vec3 start, Vec3 end, float size);
@@ -176,14 +216,16 @@ public:
 	~Q3Game();
 	void CreateMissile(ActorId id);
 	virtual void OnUpdate(int deltaMS);
-	virtual void VAddActor(shared_ptr<IActor> actor);
+	void Interpolate(float alpha);
+	virtual ActorId VAddActor(shared_ptr<ActorParams> p);
 	virtual void VRemoveActor(ActorId id);
 	virtual void VMoveActor(ActorId id, const Mat4x4 &m);
 	virtual void VAddView(shared_ptr<IGameView> view);
 	void BuildInitialScene();
 	virtual void VGameStatusChange(GameStatus status);
 	GameData GetData() {return m_data;}
-	shared_ptr<IActor> GetActor(ActorId id);
+	ActorStore &GetActors() {return m_actors;}
+	SpatialHash const &GetSpatial() const {return m_spatial;}
 	void DamageActor(ActorId id, int damage);
 	void ApplyBuffToActor(ActorId id, shared_ptr<IBuff> buff);
 	void RightClick(Vec3 l);
@@ -203,7 +245,17 @@ class GameApp
 	bool CheckMemory(const DWORD physicalRAM, const DWORD virtualRAM);
 	bool CheckHardDisk(const int diskSpace);
 	EventManager m_eventManager;
+	JobSystem m_jobSystem;
+	EventJournal m_journal;
+	EventProfiler m_eventProfiler;
+	FixedStepDriver m_stepDriver;
 	bool	m_Quitting;
+	bool	m_dumpResStats;
+	bool	m_dumpEventStats;
+	bool	m_replaying;
+	unsigned int m_headlessSteps;
+	void CloseHeadless();
+	void WriteTimerStats(FILE *file);
 public:
 	GameApp();
 	HWND GetHwnd() {return DXUTGetHWND();}
@@ -229,6 +281,11 @@ public:
 	LRESULT OnSysCommand(WPARAM wParam, LPARAM lParam);
 
 	Q3Game* CreateGameAndView();
+	Q3Game* CreateHeadlessGame();
+	bool IsReplaying() { return m_replaying; }
+	int RunReplay();
+	bool IsHeadless() { return m_headlessSteps > 0; }
+	int RunHeadless();
 	Q3Game* m_pGame;
 	class ResCache *m_ResCache;
 
@@ -238,22 +295,24 @@ public:
 	shared_ptr<Q3Map> VLoadMap();
 };
 
-// Event listener for the game logic
-class GameLogicListener: public IEventListener
+// Event listener for the game logic. Moves come in batches.
+class GameLogicListener: public IEventBatchListener
 {
 	Q3Game * m_game;
 public:
 	GameLogicListener(Q3Game * game):m_game(game){};
 	virtual bool HandleEvent(Event const & e);
+	virtual bool HandleEvents(Event const * const * events, unsigned int count);
 };
 
-// Event listener for the game view
-class GameViewListener: public IEventListener
+// Event listener for the game view. Moves come in batches.
+class GameViewListener: public IEventBatchListener
 {
 	HumanView * m_view;
 public:
 	GameViewListener(HumanView * view):m_view(view){};
 	virtual bool HandleEvent(Event const & e);
+	virtual bool HandleEvents(Event const * const * events, unsigned int count);
 };
 
 extern GameApp *g_App;
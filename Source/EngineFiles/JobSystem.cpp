@@ -0,0 +1,357 @@
+//========================================================================
+// JobSystem.cpp : Worker threads that share out jobs by work stealing.
+//========================================================================
+
+#include "StdHeader.h"
+#include <process.h>
+
+#include "JobSystem.h"
+
+// The thread's worker, or -1 for threads that aren't the job system's.
+static __declspec(thread) int s_workerIndex = -1;
+
+JobSystem *JobSystem::s_pJobSystem = NULL;
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////JobDeque///////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// The job is written before bottom moves past it, and a volatile write is a
+// release, so a thief that sees the new bottom sees the job.
+bool JobDeque::Push(Job const &job)
+{
+	LONG bottom = m_bottom;
+	LONG top = m_top;
+	if (bottom - top >= CAPACITY)
+		return false;
+
+	m_jobs[bottom & (CAPACITY - 1)] = job;
+	m_bottom = bottom + 1;
+	return true;
+}
+
+// Takes bottom back first so thieves stop short of the job, then checks top.
+// Only the last job can be wanted by a thief too, and the swap on top decides
+// who gets it.
+bool JobDeque::Pop(Job &job)
+{
+	LONG bottom = m_bottom - 1;
+	InterlockedExchange(&m_bottom, bottom);		// full barrier before reading top
+	LONG top = m_top;
+
+	LONG size = bottom - top;
+	if (size < 0)
+	{
+		m_bottom = top;
+		return false;
+	}
+
+	job = m_jobs[bottom & (CAPACITY - 1)];
+	if (size > 0)
+		return true;
+
+	bool won = InterlockedCompareExchange(&m_top, top + 1, top) == top;
+	m_bottom = top + 1;
+	return won;
+}
+
+// The job is copied out before the swap. The owner can't write over it
+// meanwhile since it never fills the slot at top, and if the swap fails the
+// copy is thrown away.
+bool JobDeque::Steal(Job &job)
+{
+	LONG top = m_top;
+	LONG bottom = m_bottom;
+	if (bottom - top <= 0)
+		return false;
+
+	job = m_jobs[top & (CAPACITY - 1)];
+	return InterlockedCompareExchange(&m_top, top + 1, top) == top;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////JobSystem//////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+JobSystem::JobSystem()
+{
+	m_workers = NULL;
+	m_numThreads = 1;
+	m_wake = NULL;
+	m_sleeping = 0;
+	m_stop = 0;
+	s_pJobSystem = this;
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+	if (s_pJobSystem == this)
+		s_pJobSystem = NULL;
+}
+
+bool JobSystem::Init(int numThreads)
+{
+	Shutdown();
+
+	if (numThreads <= 0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		numThreads = info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+	}
+	if (numThreads > MAXIMUM_WAIT_OBJECTS)
+		numThreads = MAXIMUM_WAIT_OBJECTS;
+	if (numThreads == 1)
+		return true;
+
+	m_wake = CreateSemaphore(NULL, 0, numThreads, NULL);
+	if (!m_wake)
+		return false;
+
+	m_workers = SAFE_NEW Worker[numThreads];
+	for (int i = 0; i < numThreads; i++)
+	{
+		m_workers[i].m_random = 2463534242u + i;
+		m_workers[i].m_thread = NULL;
+		m_workers[i].m_system = this;
+	}
+
+	m_sleeping = 0;
+	m_stop = 0;
+	m_numThreads = 1;
+	s_workerIndex = 0;
+
+	// If a thread can't be started the job system just has fewer.
+	for (int i = 1; i < numThreads; i++)
+	{
+		HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, WorkerThreadProc, &m_workers[m_numThreads], 0, NULL);
+		if (thread)
+			m_workers[m_numThreads++].m_thread = thread;
+	}
+
+	return true;
+}
+
+// Jobs still waiting are dropped, so it should only be called between frames.
+void JobSystem::Shutdown()
+{
+	if (!m_workers)
+		return;
+
+	m_stop = 1;
+	if (m_numThreads > 1)
+		ReleaseSemaphore(m_wake, m_numThreads - 1, NULL);
+
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	for (int i = 1; i < m_numThreads; i++)
+		threads[i - 1] = m_workers[i].m_thread;
+
+	if (m_numThreads > 1)
+	{
+		WaitForMultipleObjects(m_numThreads - 1, threads, TRUE, INFINITE);
+		for (int i = 0; i < m_numThreads - 1; i++)
+			CloseHandle(threads[i]);
+	}
+
+	CloseHandle(m_wake);
+	m_wake = NULL;
+
+	SAFE_DELETE_ARRAY(m_workers);
+	m_numThreads = 1;
+	s_workerIndex = -1;
+}
+
+unsigned int __stdcall JobSystem::WorkerThreadProc(void *pStart)
+{
+	Worker *worker = (Worker *)pStart;
+	JobSystem *system = worker->m_system;
+	system->WorkerLoop((int)(worker - system->m_workers));
+	return 0;
+}
+
+// A job from the thread's own deque, or one stolen from another's.
+bool JobSystem::FindJob(int index, Job &job)
+{
+	Worker &worker = m_workers[index];
+
+	if (worker.m_deque.Pop(job))
+		return true;
+
+	// xorshift, so threads don't all go after the same one.
+	worker.m_random ^= worker.m_random << 13;
+	worker.m_random ^= worker.m_random >> 17;
+	worker.m_random ^= worker.m_random << 5;
+
+	int start = (int)(worker.m_random % (unsigned int)m_numThreads);
+	for (int i = 0; i < m_numThreads; i++)
+	{
+		int victim = (start + i) % m_numThreads;
+		if (victim == index)
+			continue;
+
+		if (m_workers[victim].m_deque.Steal(job))
+			return true;
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(Job const &job)
+{
+	job.m_func(job.m_pContext);
+	InterlockedDecrement(&job.m_counter->m_count);
+}
+
+// Spins a little when there's nothing to do, then sleeps until a job is started.
+void JobSystem::WorkerLoop(int index)
+{
+	s_workerIndex = index;
+
+	const int SPINS = 64;
+	int idle = 0;
+
+	Job job;
+	while (!m_stop)
+	{
+		if (FindJob(index, job))
+		{
+			Execute(job);
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < SPINS)
+		{
+			YieldProcessor();
+			continue;
+		}
+
+		// Counted as sleeping before looking once more, so a job started
+		// after the look is sure to release the semaphore.
+		InterlockedIncrement(&m_sleeping);
+		if (FindJob(index, job))
+		{
+			InterlockedDecrement(&m_sleeping);
+			Execute(job);
+			idle = 0;
+			continue;
+		}
+
+		WaitForSingleObject(m_wake, INFINITE);
+		InterlockedDecrement(&m_sleeping);
+		idle = 0;
+	}
+}
+
+void JobSystem::Run(JobFunc func, void *pContext, JobCounter *counter)
+{
+	InterlockedIncrement(&counter->m_count);
+
+	int index = s_workerIndex;
+	if (!m_workers || index < 0)
+	{
+		func(pContext);
+		InterlockedDecrement(&counter->m_count);
+		return;
+	}
+
+	Job job;
+	job.m_func = func;
+	job.m_pContext = pContext;
+	job.m_counter = counter;
+
+	if (!m_workers[index].m_deque.Push(job))
+	{
+		Execute(job);
+		return;
+	}
+
+	// The push has to be seen before m_sleeping is read, see WorkerLoop.
+	MemoryBarrier();
+	if (m_sleeping > 0)
+		ReleaseSemaphore(m_wake, 1, NULL);
+}
+
+// Runs other jobs until the counter's are all done.
+void JobSystem::Wait(JobCounter *counter)
+{
+	int index = s_workerIndex;
+
+	Job job;
+	while (counter->m_count > 0)
+	{
+		if (m_workers && index >= 0 && FindJob(index, job))
+			Execute(job);
+		else
+			YieldProcessor();
+	}
+}
+
+
+struct JobRange
+{
+	JobRangeFunc m_func;
+	void *m_pContext;
+	int m_begin;
+	int m_end;
+};
+
+static void RunRange(void *pRange)
+{
+	JobRange *range = (JobRange *)pRange;
+	range->m_func(range->m_pContext, range->m_begin, range->m_end);
+}
+
+void JobSystem::ParallelFor(int count, int grain, JobRangeFunc func, void *pContext)
+{
+	if (count <= 0)
+		return;
+
+	// Four ranges a thread evens out items that take different times.
+	if (grain <= 0)
+		grain = count / (m_numThreads * 4);
+	if (grain < 1)
+		grain = 1;
+
+	const int MAX_RANGES = 256;
+	int numRanges = (count + grain - 1) / grain;
+	if (numRanges > MAX_RANGES)
+	{
+		numRanges = MAX_RANGES;
+		grain = (count + MAX_RANGES - 1) / MAX_RANGES;
+	}
+
+	if (numRanges == 1 || m_numThreads == 1)
+	{
+		func(pContext, 0, count);
+		return;
+	}
+
+	JobRange ranges[MAX_RANGES];
+	JobCounter counter;
+
+	// The first range is kept for this thread.
+	for (int i = numRanges - 1; i >= 0; i--)
+	{
+		ranges[i].m_func = func;
+		ranges[i].m_pContext = pContext;
+		ranges[i].m_begin = i * grain;
+		ranges[i].m_end = (i + 1) * grain < count ? (i + 1) * grain : count;
+		if (ranges[i].m_begin >= ranges[i].m_end)
+			continue;
+
+		if (i > 0)
+			Run(RunRange, &ranges[i], &counter);
+		else
+			RunRange(&ranges[0]);
+	}
+
+	Wait(&counter);
+}
@@ -0,0 +1,99 @@
+#pragma once
+//========================================================================
+// JobSystem.h : Worker threads that share out jobs by work stealing.
+//
+// Every thread has its own deque of jobs, kept by value so there's nothing
+// to allocate. A thread pushes and pops jobs at the bottom of its own
+// deque, and a thread with nothing to do steals from the top of another's
+// (Chase and Lev's deque, with a fixed size). A thread waiting on a counter
+// runs jobs while it waits, so jobs can start more jobs and wait on them.
+//========================================================================
+
+#include "StdHeader.h"
+
+typedef void (*JobFunc)(void *pContext);
+
+// Does items [begin, end) of a ParallelFor. Called from several threads at
+// once, so it may only touch those items and things that are safe to share.
+typedef void (*JobRangeFunc)(void *pContext, int begin, int end);
+
+// Counts the jobs started with it that haven't finished. Wait on it to join them.
+struct JobCounter
+{
+	volatile LONG m_count;
+
+	JobCounter():m_count(0) {}
+};
+
+struct Job
+{
+	JobFunc m_func;
+	void *m_pContext;
+	JobCounter *m_counter;
+};
+
+class JobDeque
+{
+public:
+	enum { CAPACITY = 1024 };			// power of two
+
+	JobDeque():m_top(0), m_bottom(0) {}
+
+	// Owner's thread only. Push fails when the deque is full.
+	bool Push(Job const &job);
+	bool Pop(Job &job);
+
+	// Any thread. False if it's empty or another thread got there first.
+	bool Steal(Job &job);
+
+private:
+	// The ends only ever count up and wrap, their difference is the size.
+	volatile LONG m_top;
+	char m_pad[60];						// keeps the two ends off the same cache line
+	volatile LONG m_bottom;
+	Job m_jobs[CAPACITY];
+};
+
+class JobSystem
+{
+	struct Worker
+	{
+		JobDeque m_deque;
+		unsigned int m_random;			// picks who to steal from first
+		HANDLE m_thread;
+		JobSystem *m_system;
+	};
+
+	Worker *m_workers;					// 0 is the thread that called Init
+	int m_numThreads;
+	HANDLE m_wake;						// semaphore sleeping workers wait on
+	volatile LONG m_sleeping;
+	volatile LONG m_stop;
+
+	static JobSystem *s_pJobSystem;
+
+	bool FindJob(int index, Job &job);
+	void Execute(Job const &job);
+	void WorkerLoop(int index);
+	static unsigned int __stdcall WorkerThreadProc(void *pStart);
+
+public:
+	JobSystem();
+	~JobSystem();
+
+	// numThreads counts the calling thread, <= 0 uses one per processor.
+	// Until it's called, or with one thread, jobs run as they're started.
+	bool Init(int numThreads);
+	void Shutdown();
+	int GetNumThreads() const { return m_numThreads; }
+
+	// Jobs started from threads that aren't the job system's run straight away.
+	void Run(JobFunc func, void *pContext, JobCounter *counter);
+	void Wait(JobCounter *counter);
+
+	// Calls func over [0, count) in ranges of about grain items and waits for
+	// them all. grain <= 0 picks one that gives each thread a few ranges.
+	void ParallelFor(int count, int grain, JobRangeFunc func, void *pContext);
+
+	static JobSystem *Get() { return s_pJobSystem; }
+};
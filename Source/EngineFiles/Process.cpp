@@ -1,4 +1,5 @@
 #include "Process.h"
+#include "JobSystem.h"
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -32,10 +33,22 @@ Process::Process(int type, ActorId id):m_bKill(false),
 	m_bInitialUpdate(true),	
 	m_type(type),
 	m_flags(0),
-	m_id(id)
+	m_id(id),
+	m_sleepMS(0),
+	m_manager(NULL),
+	m_slot(-1)
 {
 }
 
+// The manager it's attached to keeps its processes by actor, so it's told.
+void Process::SetActorId(ActorId id)
+{
+	if (m_manager)
+		m_manager->ChangeActorId(this, id);
+	else
+		m_id = id;
+}
+
 Process::~Process()
 {
 }
@@ -49,6 +62,24 @@ void Process::OnUpdate(int deltaMS)
 	}
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////WaitProcess////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+WaitProcess::WaitProcess(unsigned int ms, ActorId id):Process(PROCESS_TYPE_WAIT, id)
+{
+	Sleep(ms);
+}
+
+// Only updated once it's slept the whole time.
+void WaitProcess::OnUpdate(int deltaMS)
+{
+	Process::OnUpdate(deltaMS);
+	Kill();
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////ProcessManager/////////////////////////////////////////////
@@ -57,99 +88,339 @@ void Process::OnUpdate(int deltaMS)
 
 void ListenForProcessEvents(EventListenerPtr listener)
 {
-	safeAddListener( listener, EventType(Evt_Remove_Actor::gkName) );
+	safeAddListener( listener, Evt_Remove_Actor::gkType );
 }
 
 
 ProcessManager::ProcessManager()
 {
+	m_deltaMS = 0;
+	m_freeSlot = -1;
+	m_live = 0;
+	m_sleeping = 0;
+
 	EventListenerPtr listener (SAFE_NEW ProcessManagerListener( this) );
 	ListenForProcessEvents(listener);
 	m_eventListener = listener;
 }
 
+ProcessManager::~ProcessManager()
+{
+	DeleteProcessList();
+}
+
 // Itereates through the processes updating all of them and removing dead ones.
+// Independent processes are updated together on the job threads once the
+// others are done, and all of them have finished before this returns.
+// The timers go first, so processes they wake are updated this time.
+// Processes attached during the update are updated too, and the ones that
+// end are only taken off once it's over.
 void ProcessManager::UpdateProcesses(int deltaMS)
 {
-	ProcessList::iterator i = m_processList.begin();
+	m_timers.Advance(deltaMS);
 
-	shared_ptr<Process> nextProcess;
+	JobSystem *jobs = JobSystem::Get();
+	bool parallel = jobs && jobs->GetNumThreads() > 1;
+	m_independent.clear();
 
-	while (i != m_processList.end())
+	for (unsigned int n = 0; n < m_update.size(); n++)
 	{
-		shared_ptr<Process> p = (*i);
-		i++;
-		if (p->IsDead())
+		int slot = m_update[n];
+		if (m_slots[slot].m_removing)
+			continue;
+
+		// The slot keeps it alive until the removals are done.
+		Process *p = m_slots[slot].m_process.get();
+		if (p->m_sleepMS > 0 && !p->IsDead())
+		{
+			m_slots[slot].m_timer = m_timers.Start(p->m_sleepMS, WakeProcess, p);
+			p->m_sleepMS = 0;
+			RemoveFromUpdate(slot);
+			m_sleeping++;
+
+			// The last one was moved into its place.
+			n--;
+		}
+		else if (p->IsDead())
 		{
-			nextProcess = p->GetNext();
+			shared_ptr<Process> nextProcess = p->GetNext();
 			if (nextProcess)
-			{
-				nextProcess->SetAttached(true);
 				Attach(nextProcess);
-			}
-			Detach(p);
+			Detach(slot);
 		}
 		else if (p->IsActive() && !p->IsPause())
 		{
-			p->OnUpdate(deltaMS);
+			if (parallel && p->IsIndependent())
+				m_independent.push_back(p);
+			else
+				p->OnUpdate(deltaMS);
 		}
 	}
+
+	if (!m_independent.empty())
+	{
+		m_deltaMS = deltaMS;
+		jobs->ParallelFor((int)m_independent.size(), 0, UpdateIndependent, this);
+	}
+
+	FlushRemovals();
+}
+
+void ProcessManager::UpdateIndependent(void *pManager, int begin, int end)
+{
+	ProcessManager *manager = (ProcessManager *)pManager;
+	for (int i = begin; i < end; i++)
+		manager->m_independent[i]->OnUpdate(manager->m_deltaMS);
+}
+
+// Puts a process back in the update once it's slept.
+void ProcessManager::WakeProcess(void *pProcess, TimerId id)
+{
+	Process *process = (Process *)pProcess;
+	ProcessManager *manager = process->m_manager;
+	ProcessSlot &slot = manager->m_slots[process->m_slot];
+
+	slot.m_timer = 0;
+	manager->m_sleeping--;
+	if (!slot.m_removing)
+		manager->AddToUpdate(process->m_slot);
 }
 
 // Clears the process list
 void ProcessManager::DeleteProcessList()
 {
-	for (ProcessList::iterator i = m_processList.begin(); i != m_processList.end();)
+	for (unsigned int i = 0; i < m_slots.size(); i++)
 	{
-		Detach(* (i++));
+		if (m_slots[i].m_process)
+			Detach(i);
 	}
+	FlushRemovals();
 }
 
 // Checks if any processes of the given type are attached.
 bool ProcessManager::IsProcessActive(int type)
 {
-	for (ProcessList::iterator i = m_processList.begin(); i != m_processList.end(); i++)
+	std::map<int, int>::iterator head = m_typeHeads.find(type);
+	if (head == m_typeHeads.end())
+		return false;
+
+	for (int i = (*head).second; i >= 0; i = m_slots[i].m_nextByType)
 	{
-		if ( (*i)->GetType() == type && ( (*i)->IsDead() == false || (*i)->GetNext()))
+		Process *p = m_slots[i].m_process.get();
+		if (!m_slots[i].m_removing && (p->IsDead() == false || p->GetNext()))
 			return true;
 	}
 	return false;
 }
 
 // Attaches a process to the process list
-void ProcessManager::Attach(shared_ptr<Process> process)
+ProcessHandle ProcessManager::Attach(shared_ptr<Process> const &process)
 {
-	m_processList.push_back(process);
+	int slot = m_freeSlot;
+	if (slot >= 0)
+	{
+		m_freeSlot = m_slots[slot].m_nextFree;
+	}
+	else
+	{
+		m_slots.push_back(ProcessSlot());
+		slot = (int)m_slots.size() - 1;
+		m_slots[slot].m_generation = 0;
+	}
+
+	ProcessSlot &s = m_slots[slot];
+	s.m_process = process;
+	s.m_timer = 0;
+	s.m_removing = false;
+
+	process->m_manager = this;
+	process->m_slot = slot;
 	process->SetAttached(true);
+
+	LinkActor(slot);
+	LinkType(slot);
+	AddToUpdate(slot);
+	m_live++;
+
+	return (s.m_generation << 20) | (slot + 1);
 }
 
-// Removes a process from the process list
-void ProcessManager::Detach(shared_ptr<Process> process)
+shared_ptr<Process> ProcessManager::Find(ProcessHandle handle) const
 {
-	m_processList.remove(process);
+	int slot = (int)(handle & 0xfffff) - 1;
+	if (slot < 0 || slot >= (int)m_slots.size())
+		return shared_ptr<Process>();
+
+	ProcessSlot const &s = m_slots[slot];
+	if (!s.m_process || s.m_removing || ((s.m_generation << 20) | (slot + 1)) != handle)
+		return shared_ptr<Process>();
+
+	return s.m_process;
+}
+
+// Stops it being updated, it's taken off by FlushRemovals.
+void ProcessManager::Detach(int slot)
+{
+	ProcessSlot &s = m_slots[slot];
+	if (s.m_removing)
+		return;
+
+	s.m_removing = true;
+	m_removals.push_back(slot);
+	m_live--;
+}
+
+void ProcessManager::FlushRemovals()
+{
+	for (unsigned int i = 0; i < m_removals.size(); i++)
+		Remove(m_removals[i]);
+	m_removals.clear();
+}
+
+void ProcessManager::Remove(int slot)
+{
+	ProcessSlot &s = m_slots[slot];
+
+	if (s.m_timer)
+	{
+		m_timers.Cancel(s.m_timer);
+		s.m_timer = 0;
+		m_sleeping--;
+	}
+
+	UnlinkActor(slot);
+	UnlinkType(slot);
+	if (s.m_update >= 0)
+		RemoveFromUpdate(slot);
+
+	Process *process = s.m_process.get();
+	process->m_manager = NULL;
+	process->m_slot = -1;
 	process->SetAttached(false);
+
+	// Released last, the process may hold the last reference to others.
+	shared_ptr<Process> gonner;
+	gonner.swap(s.m_process);
+	s.m_removing = false;
+	s.m_generation = (s.m_generation + 1) & 0xfff;
+	s.m_nextFree = m_freeSlot;
+	m_freeSlot = slot;
+}
+
+void ProcessManager::LinkActor(int slot)
+{
+	ProcessSlot &s = m_slots[slot];
+	s.m_prevByActor = s.m_nextByActor = -1;
+
+	// Processes without an actor aren't looked up by one.
+	ActorId id = s.m_process->m_id;
+	if (id == INVALID_ACTOR_ID)
+		return;
+
+	unsigned int index = ActorIndex(id);
+	if (index >= m_actorHeads.size())
+		m_actorHeads.resize(index + 1, -1);
+
+	s.m_nextByActor = m_actorHeads[index];
+	if (s.m_nextByActor >= 0)
+		m_slots[s.m_nextByActor].m_prevByActor = slot;
+	m_actorHeads[index] = slot;
+}
+
+void ProcessManager::UnlinkActor(int slot)
+{
+	ProcessSlot &s = m_slots[slot];
+	ActorId id = s.m_process->m_id;
+	if (id == INVALID_ACTOR_ID)
+		return;
+
+	if (s.m_prevByActor >= 0)
+		m_slots[s.m_prevByActor].m_nextByActor = s.m_nextByActor;
+	else
+		m_actorHeads[ActorIndex(id)] = s.m_nextByActor;
+
+	if (s.m_nextByActor >= 0)
+		m_slots[s.m_nextByActor].m_prevByActor = s.m_prevByActor;
+}
+
+void ProcessManager::LinkType(int slot)
+{
+	ProcessSlot &s = m_slots[slot];
+	s.m_prevByType = -1;
+
+	std::map<int, int>::iterator head = m_typeHeads.find(s.m_process->m_type);
+	if (head == m_typeHeads.end())
+		head = m_typeHeads.insert(std::make_pair(s.m_process->m_type, -1)).first;
+
+	s.m_nextByType = (*head).second;
+	if (s.m_nextByType >= 0)
+		m_slots[s.m_nextByType].m_prevByType = slot;
+	(*head).second = slot;
+}
+
+void ProcessManager::UnlinkType(int slot)
+{
+	ProcessSlot &s = m_slots[slot];
+	if (s.m_prevByType >= 0)
+		m_slots[s.m_prevByType].m_nextByType = s.m_nextByType;
+	else
+		m_typeHeads[s.m_process->m_type] = s.m_nextByType;
+
+	if (s.m_nextByType >= 0)
+		m_slots[s.m_nextByType].m_prevByType = s.m_prevByType;
+}
+
+void ProcessManager::AddToUpdate(int slot)
+{
+	m_slots[slot].m_update = (int)m_update.size();
+	m_update.push_back(slot);
+}
+
+// The last one in the update array is moved into the gap.
+void ProcessManager::RemoveFromUpdate(int slot)
+{
+	int index = m_slots[slot].m_update;
+	int last = m_update.back();
+
+	m_update[index] = last;
+	m_slots[last].m_update = index;
+	m_update.pop_back();
+	m_slots[slot].m_update = -1;
+}
+
+// Moves the process to the other actor's list.
+void ProcessManager::ChangeActorId(Process *process, ActorId id)
+{
+	UnlinkActor(process->m_slot);
+	process->m_id = id;
+	LinkActor(process->m_slot);
 }
 
 // Checks if there are processes waiting to be updated
 bool ProcessManager::HasProcesses()
 {
-	return !m_processList.empty();
+	return m_live > 0;
 }
 
-// Removes all processes associated with the actor
+// Removes all processes associated with the actor. A list can also have
+// processes of an earlier actor in the same store slot, they're left alone.
 void ProcessManager::RemoveActor(ActorId id)
 {
-	for (ProcessList::iterator i = m_processList.begin(); i != m_processList.end(); i++)
+	unsigned int index = ActorIndex(id);
+	if (index >= m_actorHeads.size())
+		return;
+
+	for (int i = m_actorHeads[index]; i >= 0; i = m_slots[i].m_nextByActor)
 	{
-		if ( (*i)->GetId() == id)
-			Detach(* (i++));
+		if (m_slots[i].m_process->m_id == id)
+			Detach(i);
 	}
 }
 
 // Handles events for the process manager
 bool ProcessManagerListener::HandleEvent(Event const & e)
 {
-	if (strcmp(e.getType().getName(), Evt_Remove_Actor::gkName)==0)
+	if (e.getId() == Evt_Remove_Actor::gkType.getId())
 	{
 		EvtData_Remove_Actor *data = e.getData<EvtData_Remove_Actor>();
 		m_manager->RemoveActor(data->m_id);
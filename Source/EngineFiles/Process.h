@@ -8,15 +8,24 @@
 #include <boost\config.hpp>
 #include <boost\shared_ptr.hpp>
 #include <list>
+#include <map>
+#include <vector>
 #include "Event.h"
+#include "TimerWheel.h"
 
 static const int PROCESS_FLAG_ATTACHED		= 0x00000001;
 
+static const int PROCESS_TYPE_WAIT			= 1000;		// clear of the sound types
+
+class ProcessManager;
+
 class Process
 {
 	friend class ProcessManager;
 private:
 	int m_flags;
+	ProcessManager *m_manager;		// the one it's attached to
+	int m_slot;						// in the manager's slot map
 
 protected:
 	bool m_bKill;
@@ -25,6 +34,7 @@ protected:
 	bool m_bInitialUpdate;
 	int m_type;
 	ActorId m_id;
+	unsigned int m_sleepMS;
 	
 	shared_ptr<Process> m_nextProcess;
 public:	
@@ -41,7 +51,12 @@ public:
 	virtual bool IsAttached() {return (m_flags & PROCESS_FLAG_ATTACHED) ? true : false;}
 	virtual int GetType() {return m_type;}
 	virtual ActorId GetId() {return m_id;}
-	virtual void SetActorId(ActorId id) {m_id = id;}
+	virtual void SetActorId(ActorId id);
+
+	// Takes the process out of the update until the time has passed. It's
+	// put on the process manager's timers before its next update, and isn't
+	// looked at again until they wake it.
+	void Sleep(unsigned int ms) {m_sleepMS = ms;}
 
 	Process(int type, ActorId id = -1);
 	Process(const Process& in);
@@ -49,26 +64,92 @@ public:
 
 	virtual void OnUpdate(int deltaMS);
 	virtual void OnInitialize() {}
+
+	// True if OnUpdate only touches the process itself, so it can run on a
+	// job thread alongside other processes. It mustn't attach or kill other
+	// processes, and events have to go through safeThreadSafeQueueEvent.
+	virtual bool IsIndependent() { return false; }
+};
+
+// Does nothing for a while and then ends, so the process after it starts.
+class WaitProcess: public Process
+{
+public:
+	WaitProcess(unsigned int ms, ActorId id = -1);
+	virtual void OnUpdate(int deltaMS);
 };
 
 
-typedef std::list<shared_ptr<Process> > ProcessList;
+// Picks out an attached process. Once it's gone the handle finds nothing,
+// even when its slot has been used again. 0 is never a handle.
+typedef unsigned int ProcessHandle;
+
+// Where an attached process is kept. The slots are linked into a list for
+// each actor and each type, so those can be found without going through
+// every process.
+struct ProcessSlot
+{
+	shared_ptr<Process> m_process;	// empty when the slot is free
+	int m_update;					// in the update array, -1 while asleep
+	int m_nextByActor, m_prevByActor;
+	int m_nextByType, m_prevByType;
+	int m_nextFree;
+	TimerId m_timer;				// wakes it when it's asleep
+	unsigned int m_generation;
+	bool m_removing;				// taken off at the end of the update
+};
 
 class ProcessManager
 {
 private:
 	EventListenerPtr m_eventListener;
-	void Detach(shared_ptr<Process> process);
-protected:
-	ProcessList m_processList;
+	std::vector<Process *> m_independent;		// updated on the job threads this tick
+	int m_deltaMS;
+	TimerWheel m_timers;
+
+	std::vector<ProcessSlot> m_slots;
+	std::vector<int> m_update;					// slots of the processes that are awake
+	std::vector<int> m_actorHeads;				// first slot of the processes of each actor, by ActorIndex
+	std::map<int, int> m_typeHeads;				// first slot of each type, there are only a few
+	std::vector<int> m_removals;
+	int m_freeSlot;
+	unsigned int m_live;						// attached and not being removed
+	unsigned int m_sleeping;
+
+	void Detach(int slot);
+	void Remove(int slot);
+	void FlushRemovals();
+	void LinkActor(int slot);
+	void UnlinkActor(int slot);
+	void LinkType(int slot);
+	void UnlinkType(int slot);
+	void AddToUpdate(int slot);
+	void RemoveFromUpdate(int slot);
+	void ChangeActorId(Process *process, ActorId id);
+	static void UpdateIndependent(void *pManager, int begin, int end);
+	static void WakeProcess(void *pProcess, TimerId id);
+
+	friend class Process;
+
 public:
 	ProcessManager();
+	~ProcessManager();
 	void UpdateProcesses(int deltaMS);
 	void DeleteProcessList();
 	bool IsProcessActive(int type);
-	void Attach(shared_ptr<Process> process);
+	ProcessHandle Attach(shared_ptr<Process> const &process);
+	shared_ptr<Process> Find(ProcessHandle handle) const;
 	bool HasProcesses();
+
+	// The actor's processes stop being updated straight away and are taken
+	// off at the end of the update.
 	void RemoveActor(ActorId id);
+
+	// Moved on by UpdateProcesses, before the processes are, so anything that
+	// wants a callback after a while can use them instead of counting down.
+	TimerWheel & GetTimers() {return m_timers;}
+	unsigned int GetProcessCount() const {return m_live;}
+	unsigned int GetSleepingCount() const {return m_sleeping;}
 };
 
 class ProcessManagerListener: public IEventListener
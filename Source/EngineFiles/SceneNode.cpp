@@ -35,6 +35,7 @@ SceneNode::SceneNode()
 	m_props.m_toWorld = m_props.m_fromWorld = Mat4x4::g_Identity;
 	m_props.m_Radius = 0;
 	m_props.m_renderPass = RenderPass_Static;
+	m_props.m_interpolated = false;
 }
 
 SceneNode::SceneNode(ActorId id, std::string name, SceneNode *parent, RenderPass render, const Mat4x4 *to, const Mat4x4 *from)
@@ -45,6 +46,7 @@ SceneNode::SceneNode(ActorId id, std::string name, SceneNode *parent, RenderPass
 	VSetTransform(to, from);
 	m_props.m_Radius = 0;
 	m_props.m_renderPass = render;
+	m_props.m_interpolated = false;
 }
 
 SceneNode::~SceneNode()
@@ -64,6 +66,14 @@ void SceneNode::VSetTransform(const Mat4x4 *toWorld, const Mat4x4 *fromWorld)
 	}
 }
 
+// Sets where the node is drawn without moving it, NULL draws it where it is.
+void SceneNode::VSetRenderTransform(const Mat4x4 *renderToWorld)
+{
+	m_props.m_interpolated = renderToWorld != NULL;
+	if (renderToWorld)
+		m_props.m_renderToWorld = *renderToWorld;
+}
+
 // Called to update the scene nodes
 HRESULT SceneNode::VOnUpdate(Scene *pScene, DWORD const elapsed)
 {
@@ -95,7 +105,7 @@ HRESULT SceneNode::VOnRestore(Scene *pScene)
 // Called before the scene node is rendered
 HRESULT SceneNode::VPreRender(Scene *pScene)
 {
-	pScene->PushAndSetMatrix(m_props.m_toWorld);
+	pScene->PushAndSetMatrix(m_props.RenderToWorld());
 	return S_OK;
 }
 
@@ -346,7 +356,7 @@ HRESULT CameraNode::SetView(Scene *pScene)
 {
 	if (m_pTarget != NULL)
 	{
-		Mat4x4 mat = m_pTarget->VGet()->ToWorld();
+		Mat4x4 mat = m_pTarget->VGet()->RenderToWorld();
 		VSetTransform(&mat);
 	}
 	Mat4x4 fromWorld = VGet()->FromWorld();
@@ -654,8 +664,8 @@ ShotNode::ShotNode():SceneNode(), m_elapsedTime(0)
 {
 }
 
-ShotNode::ShotNode(ActorId id, int time, unsigned int num, std::string texture, Mat4x4 start, Mat4x4 end):SceneNode(num, "ShotNode", NULL, RenderPass_Effect, &start),
-					m_shotNum(num),m_timeLeft(time),m_id(id),m_textureFile(texture),m_elapsedTime(0)
+ShotNode::ShotNode(ActorId id, unsigned int num, std::string texture, Mat4x4 start, Mat4x4 end):SceneNode(num, "ShotNode", NULL, RenderPass_Effect, &start),
+					m_shotNum(num),m_id(id),m_textureFile(texture),m_elapsedTime(0)
 {
 	Vec3 s = start.GetPosition();
 	Vec3 e = end.GetPosition();
@@ -810,17 +820,9 @@ HRESULT ShotNode::VRender(Scene *pScene)
 	return S_OK;
 }
 
-// Shot node update function
+// Shot node update function. The view times how long it stays, see HumanView::AddShot.
 HRESULT ShotNode::VOnUpdate(Scene *pScene, const DWORD elapsedMS)
 {
-	// Checks how much longer it should stay there
-	m_timeLeft -= elapsedMS;
-	if (m_timeLeft <= 0)	
-	{
-		safeQueueEvent(EventPtr (SAFE_NEW Evt_Remove_Effect(m_shotNum)));
-	}
-
-
 	m_elapsedTime += elapsedMS;
 	DWORD const numFramesToAdvance = (m_elapsedTime / 100);
 
@@ -10,6 +10,8 @@ class SceneNodeProperties
 	ActorId			m_ActorId;
 	std::string		m_Name;
 	Mat4x4			m_toWorld, m_fromWorld;
+	Mat4x4			m_renderToWorld;		// where it's drawn, part way between two steps
+	bool			m_interpolated;
 	float			m_Radius;
 	bool			m_hasAlpha;
 	RenderPass		m_renderPass;
@@ -19,6 +21,7 @@ public:
 
 	Mat4x4 const &ToWorld() const {return m_toWorld;}
 	Mat4x4 const &FromWorld() const {return m_fromWorld;}
+	Mat4x4 const &RenderToWorld() const {return m_interpolated ? m_renderToWorld : m_toWorld;}
 	void Transform(Mat4x4 *toWorld, Mat4x4 *fromWorld) const;
 
 	const char * Name() const {return m_Name.c_str(); }
@@ -44,6 +47,7 @@ public:
 	virtual ~SceneNode();
 	virtual const SceneNodeProperties * const VGet() const {return &m_props;}
 	virtual void VSetTransform(const Mat4x4 *toWorld, const Mat4x4 *fromWorld=NULL);
+	virtual void VSetRenderTransform(const Mat4x4 *renderToWorld);
 	virtual HRESULT VOnUpdate(Scene *, DWORD const elapsed);
 	virtual HRESULT VOnRestore(Scene *pScene);
 
@@ -189,10 +193,9 @@ class ShotNode : public SceneNode
 public:
 	bool							m_bTextureHasAlpha;
 	unsigned int					m_shotNum;
-	int								m_timeLeft;
 
 	ShotNode();
-	ShotNode(ActorId id, int time, unsigned int num,std::string texture, Mat4x4 start, Mat4x4 end);
+	ShotNode(ActorId id, unsigned int num,std::string texture, Mat4x4 start, Mat4x4 end);
 	~ShotNode();
 
 	virtual HRESULT VOnRestore(Scene *pScene);
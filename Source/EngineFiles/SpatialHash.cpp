@@ -0,0 +1,324 @@
+//========================================================================
+// SpatialHash.cpp : Finds the actors near a point without looking at the
+// rest.
+//========================================================================
+
+#include "StdHeader.h"
+#include "SpatialHash.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <math.h>
+
+
+SpatialHash::SpatialHash(float cellSize, int buckets)
+{
+	int size = 1;
+	while (size < buckets)
+		size <<= 1;
+
+	m_buckets.resize(size, -1);
+	m_cellSize = cellSize;
+	m_count = 0;
+}
+
+int SpatialHash::CellOf(float v) const
+{
+	return (int)floorf(v / m_cellSize);
+}
+
+int SpatialHash::BucketOf(int cellX, int cellY) const
+{
+	unsigned int h = (unsigned int)cellX * 73856093u ^ (unsigned int)cellY * 19349663u;
+	return (int)(h & (m_buckets.size() - 1));
+}
+
+void SpatialHash::Link(int index)
+{
+	Entry &e = m_entries[index];
+	e.m_bucket = BucketOf(e.m_cellX, e.m_cellY);
+	e.m_prev = -1;
+	e.m_next = m_buckets[e.m_bucket];
+	if (e.m_next >= 0)
+		m_entries[e.m_next].m_prev = index;
+	m_buckets[e.m_bucket] = index;
+}
+
+void SpatialHash::Unlink(int index)
+{
+	Entry &e = m_entries[index];
+	if (e.m_prev >= 0)
+		m_entries[e.m_prev].m_next = e.m_next;
+	else
+		m_buckets[e.m_bucket] = e.m_next;
+
+	if (e.m_next >= 0)
+		m_entries[e.m_next].m_prev = e.m_prev;
+}
+
+// An actor that's in already is just moved.
+void SpatialHash::Insert(ActorId id, Vec3 const &pos)
+{
+	unsigned int index = ActorIndex(id);
+	if (index >= m_entries.size())
+	{
+		Entry free;
+		free.m_id = INVALID_ACTOR_ID;
+		m_entries.resize(index + 1, free);
+	}
+
+	Entry &e = m_entries[index];
+	if (e.m_id != INVALID_ACTOR_ID)
+	{
+		// An actor that's gone may still be in its slot.
+		Unlink(index);
+		m_count--;
+	}
+
+	e.m_id = id;
+	e.m_x = pos.x;
+	e.m_y = pos.y;
+	e.m_cellX = CellOf(pos.x);
+	e.m_cellY = CellOf(pos.y);
+	Link(index);
+	m_count++;
+}
+
+void SpatialHash::Move(ActorId id, Vec3 const &pos)
+{
+	if (!Contains(id))
+		return;
+
+	Entry &e = m_entries[ActorIndex(id)];
+	e.m_x = pos.x;
+	e.m_y = pos.y;
+
+	int cellX = CellOf(pos.x);
+	int cellY = CellOf(pos.y);
+	if (cellX == e.m_cellX && cellY == e.m_cellY)
+		return;
+
+	Unlink(ActorIndex(id));
+	e.m_cellX = cellX;
+	e.m_cellY = cellY;
+	Link(ActorIndex(id));
+}
+
+void SpatialHash::Remove(ActorId id)
+{
+	if (!Contains(id))
+		return;
+
+	Unlink(ActorIndex(id));
+	m_entries[ActorIndex(id)].m_id = INVALID_ACTOR_ID;
+	m_count--;
+}
+
+void SpatialHash::Clear()
+{
+	m_entries.clear();
+	std::fill(m_buckets.begin(), m_buckets.end(), -1);
+	m_count = 0;
+}
+
+bool SpatialHash::Contains(ActorId id) const
+{
+	unsigned int index = ActorIndex(id);
+	return id != INVALID_ACTOR_ID && index < m_entries.size() && m_entries[index].m_id == id;
+}
+
+// Other cells can share the bucket, so the cell is checked too.
+void SpatialHash::GatherCell(int cellX, int cellY, float x, float y, float radiusSq, std::vector<ActorId> &out) const
+{
+	for (int i = m_buckets[BucketOf(cellX, cellY)]; i >= 0; i = m_entries[i].m_next)
+	{
+		Entry const &e = m_entries[i];
+		if (e.m_cellX != cellX || e.m_cellY != cellY)
+			continue;
+
+		float dx = e.m_x - x;
+		float dy = e.m_y - y;
+		if (dx * dx + dy * dy <= radiusSq)
+			out.push_back(e.m_id);
+	}
+}
+
+// A query that covers more cells than there are buckets looks at every
+// entry instead, it's less work.
+int SpatialHash::QueryRadius(Vec3 const &centre, float radius, std::vector<ActorId> &out) const
+{
+	size_t before = out.size();
+	float radiusSq = radius * radius;
+
+	int x0 = CellOf(centre.x - radius), x1 = CellOf(centre.x + radius);
+	int y0 = CellOf(centre.y - radius), y1 = CellOf(centre.y + radius);
+
+	if ((double)(x1 - x0 + 1) * (y1 - y0 + 1) > m_buckets.size())
+	{
+		for (unsigned int i = 0; i < m_entries.size(); i++)
+		{
+			Entry const &e = m_entries[i];
+			if (e.m_id == INVALID_ACTOR_ID)
+				continue;
+
+			float dx = e.m_x - centre.x;
+			float dy = e.m_y - centre.y;
+			if (dx * dx + dy * dy <= radiusSq)
+				out.push_back(e.m_id);
+		}
+		return (int)(out.size() - before);
+	}
+
+	for (int cy = y0; cy <= y1; cy++)
+		for (int cx = x0; cx <= x1; cx++)
+			GatherCell(cx, cy, centre.x, centre.y, radiusSq, out);
+
+	return (int)(out.size() - before);
+}
+
+int SpatialHash::QueryBox(Vec3 const &min, Vec3 const &max, std::vector<ActorId> &out) const
+{
+	size_t before = out.size();
+
+	int x0 = CellOf(min.x), x1 = CellOf(max.x);
+	int y0 = CellOf(min.y), y1 = CellOf(max.y);
+
+	if ((double)(x1 - x0 + 1) * (y1 - y0 + 1) > m_buckets.size())
+	{
+		for (unsigned int i = 0; i < m_entries.size(); i++)
+		{
+			Entry const &e = m_entries[i];
+			if (e.m_id != INVALID_ACTOR_ID && e.m_x >= min.x && e.m_x <= max.x && e.m_y >= min.y && e.m_y <= max.y)
+				out.push_back(e.m_id);
+		}
+		return (int)(out.size() - before);
+	}
+
+	for (int cy = y0; cy <= y1; cy++)
+	{
+		for (int cx = x0; cx <= x1; cx++)
+		{
+			for (int i = m_buckets[BucketOf(cx, cy)]; i >= 0; i = m_entries[i].m_next)
+			{
+				Entry const &e = m_entries[i];
+				if (e.m_cellX != cx || e.m_cellY != cy)
+					continue;
+
+				if (e.m_x >= min.x && e.m_x <= max.x && e.m_y >= min.y && e.m_y <= max.y)
+					out.push_back(e.m_id);
+			}
+		}
+	}
+
+	return (int)(out.size() - before);
+}
+
+typedef std::pair<float, ActorId> SpatialCandidate;
+
+// Ring r is the cells r away from the centre's cell. Everything in ring
+// r + 1 is at least r cells from the centre, so once the kth nearest found
+// is closer than that, the search can stop.
+int SpatialHash::QueryNearest(Vec3 const &centre, int k, float radius, std::vector<ActorId> &out) const
+{
+	if (k <= 0)
+		return 0;
+
+	float radiusSq = radius * radius;
+	std::vector<SpatialCandidate> found;
+
+	int cx = CellOf(centre.x);
+	int cy = CellOf(centre.y);
+	int maxRing = (int)(radius / m_cellSize) + 1;
+
+	if ((double)(2 * maxRing + 1) * (2 * maxRing + 1) > m_buckets.size())
+	{
+		for (unsigned int i = 0; i < m_entries.size(); i++)
+		{
+			Entry const &e = m_entries[i];
+			if (e.m_id == INVALID_ACTOR_ID)
+				continue;
+
+			float dx = e.m_x - centre.x;
+			float dy = e.m_y - centre.y;
+			float distSq = dx * dx + dy * dy;
+			if (distSq <= radiusSq)
+				found.push_back(SpatialCandidate(distSq, e.m_id));
+		}
+	}
+	else
+	{
+		for (int r = 0; r <= maxRing; r++)
+		{
+			for (int y = cy - r; y <= cy + r; y++)
+			{
+				// Only the ring's edge, the inside was done already.
+				int step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+				for (int x = cx - r; x <= cx + r; x += step)
+				{
+					for (int i = m_buckets[BucketOf(x, y)]; i >= 0; i = m_entries[i].m_next)
+					{
+						Entry const &e = m_entries[i];
+						if (e.m_cellX != x || e.m_cellY != y)
+							continue;
+
+						float dx = e.m_x - centre.x;
+						float dy = e.m_y - centre.y;
+						float distSq = dx * dx + dy * dy;
+						if (distSq <= radiusSq)
+							found.push_back(SpatialCandidate(distSq, e.m_id));
+					}
+				}
+			}
+
+			if ((int)found.size() >= k)
+			{
+				std::nth_element(found.begin(), found.begin() + (k - 1), found.end());
+				float reach = r * m_cellSize;
+				if (found[k - 1].first <= reach * reach)
+					break;
+			}
+		}
+	}
+
+	int count = (int)found.size() < k ? (int)found.size() : k;
+	std::partial_sort(found.begin(), found.begin() + count, found.end());
+	for (int i = 0; i < count; i++)
+		out.push_back(found[i].second);
+
+	return count;
+}
+
+
+// What the batch jobs share.
+struct SpatialBatch
+{
+	SpatialHash const *m_hash;
+	SpatialQuery *m_queries;
+};
+
+// Queries only read the hash, and each range writes its own results.
+void SpatialHash::QueryRange(void *pBatch, int begin, int end)
+{
+	SpatialBatch *batch = (SpatialBatch *)pBatch;
+	for (int i = begin; i < end; i++)
+	{
+		SpatialQuery &q = batch->m_queries[i];
+		q.m_results.clear();
+		if (q.m_nearest > 0)
+			batch->m_hash->QueryNearest(q.m_centre, q.m_nearest, q.m_radius, q.m_results);
+		else
+			batch->m_hash->QueryRadius(q.m_centre, q.m_radius, q.m_results);
+	}
+}
+
+void SpatialHash::QueryBatch(SpatialQuery *queries, int count) const
+{
+	SpatialBatch batch;
+	batch.m_hash = this;
+	batch.m_queries = queries;
+
+	JobSystem *jobs = JobSystem::Get();
+	if (jobs)
+		jobs->ParallelFor(count, 0, QueryRange, &batch);
+	else
+		QueryRange(&batch, 0, count);
+}
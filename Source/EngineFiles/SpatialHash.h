@@ -0,0 +1,78 @@
+#pragma once
+//========================================================================
+// SpatialHash.h : Finds the actors near a point without looking at the
+// rest.
+//
+// The map is cut into square cells across x and y, the ground the game
+// is played on, and height is ignored. A cell's actors are kept in one of
+// a fixed number of buckets picked by hashing the cell, so the grid has no
+// edges and only costs memory for the buckets. Moving an actor only
+// relinks it when it changes cell, and a query looks at the cells its
+// area covers. Cells work best about the size of the usual query radius.
+//========================================================================
+
+#include "StdHeader.h"
+#include <vector>
+
+// One of a batch of queries. m_nearest > 0 keeps only that many of the
+// nearest, nearest first, otherwise the order is whatever the cells give.
+struct SpatialQuery
+{
+	Vec3 m_centre;
+	float m_radius;
+	int m_nearest;
+	std::vector<ActorId> m_results;
+
+	SpatialQuery():m_radius(0), m_nearest(0) {}
+};
+
+class SpatialHash
+{
+	struct Entry
+	{
+		ActorId m_id;					// INVALID_ACTOR_ID when the entry's free
+		float m_x, m_y;
+		int m_cellX, m_cellY;
+		int m_bucket;
+		int m_prev, m_next;				// in the bucket's list
+	};
+
+	// An actor's entry is at its ActorIndex, so finding it needs no lookup.
+	std::vector<Entry> m_entries;
+	std::vector<int> m_buckets;			// first entry in each bucket, -1 if none
+	float m_cellSize;
+	int m_count;
+
+	static void QueryRange(void *pQueries, int begin, int end);
+
+	int CellOf(float v) const;
+	int BucketOf(int cellX, int cellY) const;
+	void Link(int index);
+	void Unlink(int index);
+
+	// Adds the actors in the cell that pass the test to out.
+	void GatherCell(int cellX, int cellY, float x, float y, float radiusSq, std::vector<ActorId> &out) const;
+
+public:
+	// buckets is rounded up to a power of two.
+	SpatialHash(float cellSize, int buckets);
+
+	void Insert(ActorId id, Vec3 const &pos);
+	void Move(ActorId id, Vec3 const &pos);		// does nothing if it isn't in
+	void Remove(ActorId id);
+	void Clear();
+	bool Contains(ActorId id) const;
+	int GetCount() const { return m_count; }
+
+	// Each adds what it finds to out and returns how many that was.
+	int QueryRadius(Vec3 const &centre, float radius, std::vector<ActorId> &out) const;
+	int QueryBox(Vec3 const &min, Vec3 const &max, std::vector<ActorId> &out) const;
+
+	// Up to k actors within radius, nearest first. Searches out a ring of
+	// cells at a time and stops once no closer actor can be further out.
+	int QueryNearest(Vec3 const &centre, int k, float radius, std::vector<ActorId> &out) const;
+
+	// Answers all the queries, spread over the job threads. Each query's
+	// results are cleared first. Nothing may change the hash until it returns.
+	void QueryBatch(SpatialQuery *queries, int count) const;
+};
@@ -0,0 +1,210 @@
+//========================================================================
+// TimerWheel.cpp : Calls back when a deadline is reached, without looking
+// at the timers that are still waiting.
+//========================================================================
+
+#include "StdHeader.h"
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel()
+{
+	m_free = -1;
+	m_now = 0;
+	for (int i = 0; i <= FIRING; i++)
+		m_lists[i] = -1;
+}
+
+TimerId TimerWheel::Start(unsigned int delayMS, TimerFunc func, void *pContext)
+{
+	int index = m_free;
+	if (index >= 0)
+	{
+		m_free = m_timers[index].m_next;
+	}
+	else
+	{
+		if (m_timers.size() >= INDEX_MASK)
+			return 0;
+
+		Timer timer;
+		timer.m_generation = 0;
+		m_timers.push_back(timer);
+		index = (int)m_timers.size() - 1;
+	}
+
+	// Never due on the tick that's already been fired.
+	Timer &timer = m_timers[index];
+	timer.m_deadline = m_now + (delayMS > 0 ? delayMS : 1);
+	timer.m_func = func;
+	timer.m_pContext = pContext;
+	Place(index);
+
+	m_stats.m_started++;
+	if (++m_stats.m_pending > m_stats.m_maxPending)
+		m_stats.m_maxPending = m_stats.m_pending;
+
+	return MakeId(index);
+}
+
+bool TimerWheel::Cancel(TimerId id)
+{
+	if (!IsPending(id))
+		return false;
+
+	int index = (int)(id & INDEX_MASK) - 1;
+	Unlink(index);
+	Free(index);
+
+	m_stats.m_cancelled++;
+	m_stats.m_pending--;
+	return true;
+}
+
+bool TimerWheel::IsPending(TimerId id) const
+{
+	int index = (int)(id & INDEX_MASK) - 1;
+	if (index < 0 || index >= (int)m_timers.size())
+		return false;
+
+	return m_timers[index].m_list >= 0 && MakeId(index) == id;
+}
+
+void TimerWheel::Advance(unsigned int deltaMS)
+{
+	m_stats.m_firedLastTick = 0;
+
+	// With nothing waiting there's no slot worth visiting.
+	if (m_stats.m_pending == 0)
+	{
+		m_now += deltaMS;
+		return;
+	}
+
+	for (unsigned int i = 0; i < deltaMS; i++)
+		Tick();
+
+	if (m_stats.m_firedLastTick > m_stats.m_maxFiredInTick)
+		m_stats.m_maxFiredInTick = m_stats.m_firedLastTick;
+}
+
+void TimerWheel::Clear()
+{
+	for (int i = 0; i <= FIRING; i++)
+	{
+		while (m_lists[i] >= 0)
+		{
+			int index = m_lists[i];
+			Unlink(index);
+			Free(index);
+		}
+	}
+	m_stats.m_pending = 0;
+}
+
+// A timer goes on the fastest wheel that reaches its deadline. Deadlines
+// past the last wheel go as far as it reaches and are placed again when
+// that slot comes round.
+void TimerWheel::Place(int index)
+{
+	unsigned int deadline = m_timers[index].m_deadline;
+	unsigned int wait = deadline - m_now;
+
+	int wheel = 0;
+	while (wheel < WHEELS - 1 && wait >= (1u << (SLOT_BITS * (wheel + 1))))
+		wheel++;
+
+	if (wheel == WHEELS - 1 && wait >= (1u << (SLOT_BITS * WHEELS)))
+		deadline = m_now + (1u << (SLOT_BITS * WHEELS)) - 1;
+
+	int slot = (deadline >> (SLOT_BITS * wheel)) & (SLOTS - 1);
+	Link(index, wheel * SLOTS + slot);
+}
+
+void TimerWheel::Link(int index, int list)
+{
+	Timer &timer = m_timers[index];
+	timer.m_list = list;
+	timer.m_prev = -1;
+	timer.m_next = m_lists[list];
+	if (timer.m_next >= 0)
+		m_timers[timer.m_next].m_prev = index;
+	m_lists[list] = index;
+}
+
+void TimerWheel::Unlink(int index)
+{
+	Timer &timer = m_timers[index];
+	if (timer.m_prev >= 0)
+		m_timers[timer.m_prev].m_next = timer.m_next;
+	else
+		m_lists[timer.m_list] = timer.m_next;
+
+	if (timer.m_next >= 0)
+		m_timers[timer.m_next].m_prev = timer.m_prev;
+
+	timer.m_list = -1;
+}
+
+// The generation moves on so the old id no longer matches.
+void TimerWheel::Free(int index)
+{
+	Timer &timer = m_timers[index];
+	timer.m_list = -1;
+	timer.m_generation = (timer.m_generation + 1) & ((1u << (32 - INDEX_BITS)) - 1);
+	timer.m_next = m_free;
+	m_free = index;
+}
+
+// Spreads the wheel's current slot over the wheels below it.
+void TimerWheel::Cascade(int wheel)
+{
+	int list = wheel * SLOTS + ((m_now >> (SLOT_BITS * wheel)) & (SLOTS - 1));
+	while (m_lists[list] >= 0)
+	{
+		int index = m_lists[list];
+		Unlink(index);
+		Place(index);
+		m_stats.m_cascaded++;
+	}
+}
+
+void TimerWheel::Tick()
+{
+	m_now++;
+
+	// When a wheel comes round, the one above it moves on a slot.
+	for (int wheel = 1; wheel < WHEELS; wheel++)
+	{
+		if ((m_now & ((1u << (SLOT_BITS * wheel)) - 1)) != 0)
+			break;
+		Cascade(wheel);
+	}
+
+	// Moved onto their own list first, so callbacks starting or cancelling
+	// timers don't change the slot being walked.
+	int slot = m_now & (SLOTS - 1);
+	if (m_lists[slot] < 0)
+		return;
+
+	m_lists[FIRING] = m_lists[slot];
+	m_lists[slot] = -1;
+	for (int index = m_lists[FIRING]; index >= 0; index = m_timers[index].m_next)
+		m_timers[index].m_list = FIRING;
+
+	while (m_lists[FIRING] >= 0)
+	{
+		int index = m_lists[FIRING];
+		Timer &timer = m_timers[index];
+		TimerFunc func = timer.m_func;
+		void *pContext = timer.m_pContext;
+		TimerId id = MakeId(index);
+
+		Unlink(index);
+		Free(index);
+		m_stats.m_pending--;
+		m_stats.m_fired++;
+		m_stats.m_firedLastTick++;
+
+		func(pContext, id);
+	}
+}
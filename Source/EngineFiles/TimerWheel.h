@@ -0,0 +1,95 @@
+#pragma once
+//========================================================================
+// TimerWheel.h : Calls back when a deadline is reached, without looking at
+// the timers that are still waiting.
+//
+// A hierarchical timing wheel. The first wheel has a slot for each of the
+// next 64 ms, the next has a slot for each 64 ms after that, and so on up
+// to four wheels (about four and a half hours). A timer goes in the slot of
+// the wheel its deadline falls in. When a wheel comes round, the next
+// slot of the wheel above is spread out over it. Starting, cancelling
+// and firing a timer take the same time however many are waiting, and
+// moving the time on only looks at the slots it passes.
+//========================================================================
+
+#include "StdHeader.h"
+#include <vector>
+
+// 0 is never a timer, so it can stand for none.
+typedef unsigned int TimerId;
+
+// Called from Advance on the thread that owns the wheel. It can start and
+// cancel timers, this one's id is already free.
+typedef void (*TimerFunc)(void *pContext, TimerId id);
+
+struct TimerStats
+{
+	unsigned int m_pending;
+	unsigned int m_maxPending;
+	unsigned int m_started;
+	unsigned int m_cancelled;
+	unsigned int m_fired;
+	unsigned int m_firedLastTick;
+	unsigned int m_maxFiredInTick;
+	unsigned int m_cascaded;			// moved down from a slower wheel
+
+	TimerStats() : m_pending(0), m_maxPending(0), m_started(0), m_cancelled(0), m_fired(0), m_firedLastTick(0), m_maxFiredInTick(0), m_cascaded(0) { }
+};
+
+class TimerWheel
+{
+	enum
+	{
+		WHEELS = 4,
+		SLOT_BITS = 6,
+		SLOTS = 1 << SLOT_BITS,
+		FIRING = WHEELS * SLOTS,		// list the timers being fired are on
+		INDEX_BITS = 20,				// the rest of an id is the slot's generation
+		INDEX_MASK = (1 << INDEX_BITS) - 1
+	};
+
+	struct Timer
+	{
+		unsigned int m_deadline;
+		TimerFunc m_func;
+		void *m_pContext;
+		int m_prev, m_next;				// in the list the timer is on
+		int m_list;						// -1 when the timer is free
+		unsigned int m_generation;
+	};
+
+	std::vector<Timer> m_timers;
+	int m_free;							// free timers, linked through m_next
+	int m_lists[FIRING + 1];
+	unsigned int m_now;
+	TimerStats m_stats;
+
+	TimerId MakeId(int index) const { return (m_timers[index].m_generation << INDEX_BITS) | (index + 1); }
+	void Place(int index);
+	void Link(int index, int list);
+	void Unlink(int index);
+	void Free(int index);
+	void Cascade(int wheel);
+	void Tick();
+
+public:
+	TimerWheel();
+
+	// The callback is made once delayMS has passed, on the first Advance that
+	// gets there. A delay of 0 waits for the next Advance.
+	TimerId Start(unsigned int delayMS, TimerFunc func, void *pContext);
+
+	// False if the timer has already fired or been cancelled.
+	bool Cancel(TimerId id);
+	bool IsPending(TimerId id) const;
+
+	// Moves the time on, firing the timers it passes in deadline order.
+	void Advance(unsigned int deltaMS);
+
+	// Drops all the timers without calling them.
+	void Clear();
+
+	unsigned int GetTime() const { return m_now; }
+	unsigned int GetPendingCount() const { return m_stats.m_pending; }
+	const TimerStats & GetStats() const { return m_stats; }
+};
@@ -6,6 +6,8 @@ The event manager is a global object that manages itself. It is called through h
 
 
 #include "Event.h"
+#include "EventJournal.h"
+#include "EventProfiler.h"
 
 
 char * const Evt_New_Actor::gkName = "create_actor_event";
@@ -25,6 +27,26 @@ char * const Evt_Create_Missile::gkName = "create_missile";
 char * const Evt_Left_Click::gkName = "right_click_event";
 char * const Evt_Mouse_Move::gkName = "mouse_move";
 
+char * const EventManager::gkWildcard = "*";
+
+// Hashed once here rather than every time an event is made.
+const EventType Evt_New_Actor::gkType(Evt_New_Actor::gkName);
+const EventType Evt_Remove_Actor::gkType(Evt_Remove_Actor::gkName);
+const EventType Evt_Move_Actor::gkType(Evt_Move_Actor::gkName);
+const EventType Evt_Try_Move_Actor::gkType(Evt_Try_Move_Actor::gkName);
+const EventType Evt_Move_Camera::gkType(Evt_Move_Camera::gkName);
+const EventType Evt_Change_GameState::gkType(Evt_Change_GameState::gkName);
+const EventType Evt_Shot::gkType(Evt_Shot::gkName);
+const EventType Evt_Remove_Effect::gkType(Evt_Remove_Effect::gkName);
+const EventType Evt_Remove_Effect_By_Id::gkType(Evt_Remove_Effect_By_Id::gkName);
+const EventType Evt_Device_Created::gkType(Evt_Device_Created::gkName);
+const EventType Evt_RebuildUI::gkType(Evt_RebuildUI::gkName);
+const EventType Evt_Damage_Actor::gkType(Evt_Damage_Actor::gkName);
+const EventType Evt_Apply_Buff::gkType(Evt_Apply_Buff::gkName);
+const EventType Evt_Create_Missile::gkType(Evt_Create_Missile::gkName);
+const EventType Evt_Left_Click::gkType(Evt_Left_Click::gkName);
+const EventType Evt_Mouse_Move::gkType(Evt_Mouse_Move::gkName);
+
 
 
 // List of helper functions to access the eventmanager.
@@ -50,6 +72,12 @@ bool safeAddListener(EventListenerPtr const & listener, EventType const & type)
 	return IEventManager::Get()->addListener(listener, type);
 }
 
+bool safeAddBatchListener(EventBatchListenerPtr const & listener, EventType const & type)
+{
+	assert(IEventManager::Get() && "No Event Manager!");
+	return IEventManager::Get()->addBatchListener(listener, type);
+}
+
 bool safeTriggerEvent(Event const & event)
 {
 	assert(IEventManager::Get() && "No Event Manager!");
@@ -62,6 +90,12 @@ bool safeQueueEvent(EventPtr const & event)
 	return IEventManager::Get()->queueEvent(event);
 }
 
+bool safeThreadSafeQueueEvent(EventPtr const & event)
+{
+	assert(IEventManager::Get() && "No Event Manager!");
+	return IEventManager::Get()->threadSafeQueueEvent(event);
+}
+
 bool safeTick(unsigned int maxMS)
 {
 	assert(IEventManager::Get() && "No Event Manager!");
@@ -74,88 +108,466 @@ bool safeValidateType(EventType const & type)
 	return IEventManager::Get()->validateType(type);
 }
 
+void safeBeginDerived()
+{
+	assert(IEventManager::Get() && "No Event Manager!");
+	IEventManager::Get()->beginDerived();
+}
+
+void safeEndDerived()
+{
+	assert(IEventManager::Get() && "No Event Manager!");
+	IEventManager::Get()->endDerived();
+}
+
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////GameApp////////////////////////////////////////////////////
+//////////////////////////////////EventQueue/////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-// Adds an event listener to the list for that event type. Returns false if listener is not added, true if added
-bool EventManager::addListener(EventListenerPtr const & listener, EventType const & type)
+EventQueue::EventQueue():m_events(64), m_head(0), m_count(0), m_headSeq(0), m_coalesceUsed(0)
 {
-	if (!validateType(type))
-		return false;
+	CoalesceSlot empty = { 0, 0, 0 };
+	m_coalesce.assign(64, empty);
+}
+
+// Doubles the buffer, unwrapping the events so the oldest is at the start.
+void EventQueue::grow()
+{
+	unsigned int oldSize = (unsigned int)m_events.size();
+	std::vector<EventPtr> events(oldSize * 2);
+
+	for (unsigned int i = 0; i < m_count; i++)
+		events[i].swap(m_events[(m_head + i) & (oldSize - 1)]);
+
+	m_events.swap(events);
+	m_head = 0;
+}
 
-	EventTypeSet::iterator it = m_eventTypes.find(type);
+// Rebuilds the coalescing index, twice the size, dropping stale entries.
+void EventQueue::growCoalesce()
+{
+	std::vector<CoalesceSlot> old;
+	old.swap(m_coalesce);
+
+	CoalesceSlot empty = { 0, 0, 0 };
+	m_coalesce.assign(old.size() * 2, empty);
+	m_coalesceUsed = 0;
 
-	// Looks to see if the event is a type seen before and adds the event type if not.
-	if (it == m_eventTypes.end())
+	unsigned int mask = (unsigned int)m_coalesce.size() - 1;
+	for (unsigned int j = 0; j < old.size(); j++)
 	{
-		EventTypeSetRet itEvent = m_eventTypes.insert(type);
+		if (old[j].m_id == 0 || !isWaiting(old[j].m_seq))
+			continue;
 
-		if (itEvent.second == false)
-			return false;
+		unsigned int i = (old[j].m_id ^ (old[j].m_key * 2654435761u)) & mask;
+		while (m_coalesce[i].m_id != 0)
+			i = (i + 1) & mask;
 
-		if (itEvent.first == m_eventTypes.end())
-			return false;
+		m_coalesce[i] = old[j];
+		m_coalesceUsed++;
+	}
+}
+
+void EventQueue::append(EventPtr const & event)
+{
+	if (m_count == m_events.size())
+		grow();
+	m_events[(m_head + m_count) & (m_events.size() - 1)] = event;
+	m_count++;
+}
 
-		it = itEvent.first;
+bool EventQueue::push_back(EventPtr const & event)
+{
+	unsigned int key;
+	if (!event->getCoalesceKey(key))
+	{
+		append(event);
+		return false;
 	}
 
-	EventListenerMap::iterator itMap = m_listenerMap.find(type.getId());
+	// Kept under half full so probes stay short.
+	if ((m_coalesceUsed + 1) * 2 > m_coalesce.size())
+		growCoalesce();
+
+	unsigned int id = event->getId();
+	unsigned int mask = (unsigned int)m_coalesce.size() - 1;
+	unsigned int i = (id ^ (key * 2654435761u)) & mask;
 
-	// Finds the list of listeners for the event type and creates one if it doesn't exist.
-	if (itMap == m_listenerMap.end())
+	while (m_coalesce[i].m_id != 0)
 	{
-		EventListenerMapRet itListMap = m_listenerMap.insert(EventListenerMapEntry(type.getId(), EventListenerList()));
-		
-		if (itListMap.second == false)
+		CoalesceSlot & slot = m_coalesce[i];
+		if (slot.m_id == id && slot.m_key == key)
+		{
+			if (isWaiting(slot.m_seq))
+			{
+				atSeq(slot.m_seq) = event;
+				return true;
+			}
+
+			// The last one has already gone, this one takes its entry.
+			slot.m_seq = m_headSeq + m_count;
+			append(event);
 			return false;
+		}
+		i = (i + 1) & mask;
+	}
 
-		if (itListMap.first == m_listenerMap.end())
-			return false;
+	m_coalesce[i].m_id = id;
+	m_coalesce[i].m_key = key;
+	m_coalesce[i].m_seq = m_headSeq + m_count;
+	m_coalesceUsed++;
+
+	append(event);
+	return false;
+}
+
+void EventQueue::pop_front()
+{
+	m_events[m_head].reset();
+	m_head = (m_head + 1) & (m_events.size() - 1);
+	m_headSeq++;
+	m_count--;
+
+	// Everything in the index is stale once the queue is empty.
+	if (m_count == 0 && m_coalesceUsed > 0)
+	{
+		CoalesceSlot empty = { 0, 0, 0 };
+		m_coalesce.assign(m_coalesce.size(), empty);
+		m_coalesceUsed = 0;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////EventRing//////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Capacity is rounded up to a power of two.
+EventRing::EventRing(unsigned int capacity)
+{
+	unsigned int size = 2;
+	while (size < capacity)
+		size <<= 1;
+
+	m_cells = SAFE_NEW Cell[size];
+	m_mask = size - 1;
+
+	// A slot is free to push at position p when its sequence is p.
+	for (unsigned int i = 0; i < size; i++)
+		m_cells[i].m_sequence = i;
+
+	m_enqueuePos = 0;
+	m_dequeuePos = 0;
+	m_pushed = 0;
+	m_rejected = 0;
+	m_highWater = 0;
+}
 
-		itMap = itListMap.first;
+EventRing::~EventRing()
+{
+	SAFE_DELETE_ARRAY(m_cells);
+}
+
+// Any thread. Returns false if the ring is full.
+bool EventRing::push(EventPtr const & event)
+{
+	Cell *cell;
+	LONG pos = m_enqueuePos;
+
+	for (;;)
+	{
+		cell = &m_cells[pos & m_mask];
+		LONG diff = cell->m_sequence - pos;
+
+		if (diff == 0)
+		{
+			// The slot is free, claim the position unless another pusher beat us to it.
+			LONG old = InterlockedCompareExchange(&m_enqueuePos, pos + 1, pos);
+			if (old == pos)
+				break;
+			pos = old;
+		}
+		else if (diff < 0)
+		{
+			// The popper hasn't freed this slot from the last time around.
+			InterlockedIncrement(&m_rejected);
+			return false;
+		}
+		else
+			pos = m_enqueuePos;
 	}
 
-	EventListenerList & theList= (*itMap).second;
+	cell->m_event = event;
+
+	// Publishes the event to the popper.
+	InterlockedExchange(&cell->m_sequence, pos + 1);
+	InterlockedIncrement(&m_pushed);
+	return true;
+}
+
+// Only the thread that calls tick. Returns false if the ring is empty.
+bool EventRing::pop(EventPtr & event)
+{
+	Cell *cell = &m_cells[m_dequeuePos & m_mask];
+	if (cell->m_sequence - (m_dequeuePos + 1) < 0)
+		return false;
+
+	event = cell->m_event;
+	cell->m_event.reset();
+
+	// Frees the slot for the push one lap ahead.
+	InterlockedExchange(&cell->m_sequence, m_dequeuePos + m_mask + 1);
+	m_dequeuePos++;
+	return true;
+}
+
+void EventRing::getStats(EventRingStats & stats) const
+{
+	stats.m_capacity = m_mask + 1;
+	stats.m_pushed = m_pushed;
+	stats.m_rejected = m_rejected;
+	stats.m_highWater = m_highWater;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////EventListenerTable/////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
 
-	// Checks to see if the listener is already in the map.
-	for (EventListenerList::iterator i = theList.begin(); i != theList.end(); i++)
+// Returns false if the listener is already in the entry.
+bool EventListenerEntry::add(EventListenerPtr const & listener)
+{
+	for (unsigned int i = 0; i < m_listeners.size(); i++)
 	{
-		if ((*i) == listener)
+		if (m_listeners[i] == listener.get())
 			return false;
 	}
 
-	theList.push_back(listener);
+	m_listeners.push_back(listener.get());
+	m_owners.push_back(listener);
+	return true;
+}
+
+bool EventListenerEntry::addBatch(EventBatchListenerPtr const & listener)
+{
+	for (unsigned int i = 0; i < m_batchListeners.size(); i++)
+	{
+		if (m_batchListeners[i] == listener.get())
+			return false;
+	}
 
+	m_batchListeners.push_back(listener.get());
+	m_owners.push_back(listener);
 	return true;
 }
 
-// Instantly triggers an event. Returns true if event is processed
-bool EventManager::triggerEvent(Event const & event)
+EventListenerTable::EventListenerTable()
 {
-	EventType type = event.getType();
+	Slot empty = { 0, -1 };
+	m_slots.assign(32, empty);
+	m_mask = 31;
+}
+
+// Index of the entry for the id, or -1 if there isn't one.
+int EventListenerTable::find(unsigned int id) const
+{
+	for (unsigned int i = id & m_mask; ; i = (i + 1) & m_mask)
+	{
+		Slot const & slot = m_slots[i];
+		if (slot.m_id == id)
+			return slot.m_entry;
+		if (slot.m_id == 0)
+			return -1;
+	}
+}
 
+// Adds an entry for the type if there isn't one and returns its index, or -1
+// if the id is taken by another name.
+int EventListenerTable::insert(EventType const & type)
+{
+	int index = find(type.getId());
+	if (index >= 0)
+	{
+		char * const name = m_entries[index].m_name;
+		if (name != type.getName() && strcmp(name, type.getName()) != 0)
+			return -1;
+		return index;
+	}
+
+	// Kept under half full so probes stay short.
+	if ((m_entries.size() + 1) * 2 > m_slots.size())
+		grow();
+
+	index = (int)m_entries.size();
+	m_entries.push_back(EventListenerEntry(type));
+
+	unsigned int i = type.getId() & m_mask;
+	while (m_slots[i].m_id != 0)
+		i = (i + 1) & m_mask;
+
+	m_slots[i].m_id = type.getId();
+	m_slots[i].m_entry = index;
+	return index;
+}
+
+void EventListenerTable::grow()
+{
+	unsigned int size = (unsigned int)m_slots.size() * 2;
+	Slot empty = { 0, -1 };
+	m_slots.assign(size, empty);
+	m_mask = size - 1;
+
+	for (unsigned int e = 0; e < m_entries.size(); e++)
+	{
+		unsigned int i = m_entries[e].m_id & m_mask;
+		while (m_slots[i].m_id != 0)
+			i = (i + 1) & m_mask;
+
+		m_slots[i].m_id = m_entries[e].m_id;
+		m_slots[i].m_entry = e;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////EventManager///////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+EventManager::EventManager():m_wildcard(EventType(gkWildcard)), m_delayedSeq(0), m_threadSafeQueue(THREAD_SAFE_QUEUE_SIZE), m_coalesced(0), m_journal(NULL), m_profiler(NULL), m_dispatchDepth(0), m_derivedDepth(0)
+{
+	QueryPerformanceFrequency(&m_frequency);
+	registerEventTypes();
+}
+
+// Registers the engine's events up front so a name that hashes the same as
+// one of them is caught when it's first used, not when both meet in a listener.
+// Goes by name since the game's EventManager is a global and the gkTypes may
+// not be constructed yet.
+void EventManager::registerEventTypes()
+{
+	registerType(EventType(Evt_New_Actor::gkName));
+	registerType(EventType(Evt_Remove_Actor::gkName));
+	registerType(EventType(Evt_Move_Actor::gkName));
+	registerType(EventType(Evt_Try_Move_Actor::gkName));
+	registerType(EventType(Evt_Move_Camera::gkName));
+	registerType(EventType(Evt_Change_GameState::gkName));
+	registerType(EventType(Evt_Shot::gkName));
+	registerType(EventType(Evt_Remove_Effect::gkName));
+	registerType(EventType(Evt_Remove_Effect_By_Id::gkName));
+	registerType(EventType(Evt_Device_Created::gkName));
+	registerType(EventType(Evt_RebuildUI::gkName));
+	registerType(EventType(Evt_Damage_Actor::gkName));
+	registerType(EventType(Evt_Apply_Buff::gkName));
+	registerType(EventType(Evt_Create_Missile::gkName));
+	registerType(EventType(Evt_Left_Click::gkName));
+	registerType(EventType(Evt_Mouse_Move::gkName));
+}
+
+// Adds the type to the table. Returns false if its id is taken by another name.
+bool EventManager::registerType(EventType const & type)
+{
+	if (type.getName() == NULL || type.getId() == 0)
+		return false;
+
+	int index = m_listeners.insert(type);
+	assert(index >= 0 && "Event types hashed wrong!");
+	return index >= 0;
+}
+
+// Adds an event listener to the list for that event type. Returns false if listener is not added, true if added
+bool EventManager::addListener(EventListenerPtr const & listener, EventType const & type)
+{
+	if (!validateType(type))
+		return false;
+
+	if (strcmp(type.getName(), gkWildcard) == 0)
+		return m_wildcard.add(listener);
+
+	int index = m_listeners.insert(type);
+	if (index < 0)
+		return false;
+
+	return m_listeners.getEntry(index).add(listener);
+}
+
+// Batch listeners get the type's queued events after the lane they're in has
+// been handled, whether or not a listener handled them. They can't listen to
+// the wildcard.
+bool EventManager::addBatchListener(EventBatchListenerPtr const & listener, EventType const & type)
+{
 	if (!validateType(type))
 		return false;
 
-	EventListenerMap::iterator itMap = m_listenerMap.find(type.getId());
+	if (strcmp(type.getName(), gkWildcard) == 0)
+		return false;
 
-	if (itMap == m_listenerMap.end())
+	int index = m_listeners.insert(type);
+	if (index < 0)
 		return false;
 
-	EventListenerList theList = (*itMap).second;
+	return m_listeners.getEntry(index).addBatch(listener);
+}
+
+// True if something would hear an event of the type.
+bool EventManager::hasListeners(EventType const & type) const
+{
+	if (m_wildcard.size() > 0)
+		return true;
+
+	int index = m_listeners.find(type.getId());
+	return index >= 0 && !m_listeners.getEntry(index).empty();
+}
+
+// Instantly triggers an event. Returns true if event is processed.
+// Wildcard listeners see it first. The lists are walked by index with the
+// count taken up front, so listeners added by a handler wait for the next event.
+bool EventManager::triggerEvent(Event const & event)
+{
+	EventType type = event.getType();
+
+	if (!validateType(type))
+		return false;
+
+	if (m_journal)
+		m_journal->Record(event, false, isDerived());
+
+	if (m_profiler)
+		m_profiler->OnTriggered(event);
 
 	bool processed = false;
+	m_dispatchDepth++;
+
+	for (unsigned int i = 0, count = m_wildcard.size(); i < count; i++)
+		callListener(m_wildcard.m_listeners[i], event);
 
-	for (EventListenerList::iterator i = theList.begin(); i != theList.end(); i++)
+	int index = m_listeners.find(type.getId());
+	if (index >= 0)
 	{
-		if ((*i)->HandleEvent(event))
-			processed = true;
+		for (unsigned int i = 0, count = m_listeners.getEntry(index).size(); i < count; i++)
+		{
+			// Looked up each time, a handler adding a new event type can move the entry.
+			if (callListener(m_listeners.getEntry(index).m_listeners[i], event))
+				processed = true;
+		}
+
+		Event const * events = &event;
+		for (unsigned int i = 0, count = m_listeners.getEntry(index).batchSize(); i < count; i++)
+		{
+			if (callBatchListener(m_listeners.getEntry(index).m_batchListeners[i], &events, 1))
+				processed = true;
+		}
 	}
 
+	m_dispatchDepth--;
 	return processed;
 }
 
@@ -167,50 +579,244 @@ bool EventManager::queueEvent(EventPtr const & event)
 	if (!validateType(type))
 		return false;
 
-	EventListenerMap::iterator itMap = m_listenerMap.find(type.getId());
-	if (itMap == m_listenerMap.end())
+	if (!hasListeners(type))
 		return false;
 
-	m_eventQueue.push_back(event);
+	if (m_journal)
+		m_journal->Record(*event, true, isDerived());
+
+	enqueue(event);
 	return true;
 }
 
-// Goes through the event queue and processes events for the given time.
+// Events with a time wait in the heap, the rest go straight to their lane.
+void EventManager::enqueue(EventPtr const & event)
+{
+	if (event->getTimeIn() <= 0)
+	{
+		pushToLane(event);
+		return;
+	}
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+
+	DelayedEvent delayed;
+	delayed.m_due = now.QuadPart + (LONGLONG)event->getTimeIn() * m_frequency.QuadPart / 1000;
+	delayed.m_seq = m_delayedSeq++;
+	delayed.m_event = event;
+
+	m_delayed.push_back(delayed);
+	std::push_heap(m_delayed.begin(), m_delayed.end());
+}
+
+void EventManager::pushToLane(EventPtr const & event)
+{
+	EventPriority priority = event->getPriority();
+	assert(priority >= 0 && priority < EventPriority_Last);
+
+	bool coalesced = m_eventQueues[priority].push_back(event);
+	if (coalesced)
+		m_coalesced++;
+
+	if (m_profiler)
+		m_profiler->OnQueued(*event, coalesced);
+}
+
+// Wildcard listeners only watch, they can't stop the event. The first typed
+// listener that handles it stops it. Events with batch listeners are kept
+// for dispatchBatches.
+void EventManager::dispatchQueued(EventPtr const & event)
+{
+	if (m_profiler)
+		m_profiler->OnDispatched(*event);
+
+	m_dispatchDepth++;
+
+	for (unsigned int i = 0, count = m_wildcard.size(); i < count; i++)
+		callListener(m_wildcard.m_listeners[i], *event);
+
+	int index = m_listeners.find(event->getId());
+	if (index >= 0)
+	{
+		for (unsigned int i = 0, count = m_listeners.getEntry(index).size(); i < count; i++)
+		{
+			if (callListener(m_listeners.getEntry(index).m_listeners[i], *event))
+				break;
+		}
+
+		if (m_listeners.getEntry(index).batchSize() > 0)
+			m_batched.push_back(event);
+	}
+
+	m_dispatchDepth--;
+}
+
+static bool EventIdLess(EventPtr const & a, EventPtr const & b)
+{
+	return a->getId() < b->getId();
+}
+
+// Hands the held events to the batch listeners, one span per type in the
+// order they were queued.
+void EventManager::dispatchBatches()
+{
+	if (m_batched.empty())
+		return;
+
+	std::stable_sort(m_batched.begin(), m_batched.end(), EventIdLess);
+
+	m_dispatchDepth++;
+
+	for (unsigned int start = 0, end; start < m_batched.size(); start = end)
+	{
+		unsigned int id = m_batched[start]->getId();
+
+		m_batchSpan.clear();
+		for (end = start; end < m_batched.size() && m_batched[end]->getId() == id; end++)
+			m_batchSpan.push_back(m_batched[end].get());
+
+		int index = m_listeners.find(id);
+		for (unsigned int i = 0, count = m_listeners.getEntry(index).batchSize(); i < count; i++)
+			callBatchListener(m_listeners.getEntry(index).m_batchListeners[i], &m_batchSpan[0], (unsigned int)m_batchSpan.size());
+	}
+
+	m_dispatchDepth--;
+
+	m_batchSpan.clear();
+	m_batched.clear();
+}
+
+// Calls one listener, timing it when profiling.
+bool EventManager::callListener(IEventListener * listener, Event const & event)
+{
+	if (!m_profiler)
+		return listener->HandleEvent(event);
+
+	ResTimer timer;
+	bool handled = listener->HandleEvent(event);
+	m_profiler->OnListener(event, listener, handled, timer.GetMicroseconds());
+	return handled;
+}
+
+// A batch is timed as one call.
+bool EventManager::callBatchListener(IEventBatchListener * listener, Event const * const * events, unsigned int count)
+{
+	if (!m_profiler)
+		return listener->HandleEvents(events, count);
+
+	ResTimer timer;
+	bool handled = listener->HandleEvents(events, count);
+	m_profiler->OnListener(*events[0], listener, handled, timer.GetMicroseconds());
+	return handled;
+}
+
+// Adds an event to the queue from any thread. It's held in a ring until the
+// next tick moves it to the back of the queue, so events from one thread keep
+// their order. Returns false if the ring is full, the caller can retry later.
+bool EventManager::threadSafeQueueEvent(EventPtr const & event)
+{
+	// The type and listener checks touch containers only the main thread may
+	// use, so they wait until tick.
+	EventType type = event->getType();
+	if (type.getName() == NULL || type.getId() == 0)
+		return false;
+
+	return m_threadSafeQueue.push(event);
+}
+
+// Goes through the event queues and processes events for the given time.
+// Lanes are handled in priority order and each is first in first out. Only
+// events queued before the tick started are handled, anything queued by a
+// listener or left when time runs out waits for the next tick.
 bool EventManager::tick(unsigned int maxMS)
 {
-	unsigned int curTick = GetTickCount();
-	unsigned int maxTime = maxMS + curTick;
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	LONGLONG startTime = now.QuadPart;
+	LONGLONG endTime = startTime + (LONGLONG)maxMS * m_frequency.QuadPart / 1000;
 
 	bool processed = false;
 
-	while (m_eventQueue.size() > 0)
+	// Events from other threads go after everything already queued. Their
+	// delay counts from here rather than from when they were sent.
+	EventPtr threadEvent;
+	unsigned int drained = 0;
+	while (m_threadSafeQueue.pop(threadEvent))
 	{
-		EventPtr event = m_eventQueue.front();
-		m_eventQueue.pop_front();
+		drained++;
+		if (validateType(threadEvent->getType()) && hasListeners(threadEvent->getType()))
+		{
+			if (m_journal)
+				m_journal->Record(*threadEvent, true, false);
+			enqueue(threadEvent);
+		}
+	}
+	m_threadSafeQueue.noteDrained(drained);
 
-		EventType type = event->getType();
-		EventListenerMap::iterator itMap = m_listenerMap.find(type.getId());
+	// Delayed events that are due join the back of their lane.
+	while (!m_delayed.empty() && m_delayed.front().m_due <= now.QuadPart)
+	{
+		std::pop_heap(m_delayed.begin(), m_delayed.end());
+		EventPtr event;
+		event.swap(m_delayed.back().m_event);
+		m_delayed.pop_back();
+		pushToLane(event);
+	}
 
-		if (itMap == m_listenerMap.end())
-			continue;
+	unsigned int counts[EventPriority_Last];
+	for (int lane = 0; lane < EventPriority_Last; lane++)
+		counts[lane] = m_eventQueues[lane].size();
 
-		EventListenerList theList = (*itMap).second;
+	bool outOfTime = false;
+	unsigned int dispatched = 0;
 
-		for (EventListenerList::iterator i = theList.begin(); i != theList.end(); i++)
+	for (int lane = 0; lane < EventPriority_Last; lane++)
+	{
+		EventQueue & queue = m_eventQueues[lane];
+
+		for (unsigned int handled = 0; handled < counts[lane] && !queue.empty(); handled++)
 		{
-			if ((*i)->HandleEvent(*event))
+			// Once out of time each lane still gets one event, so a busy
+			// higher lane can slow the lower ones but not starve them.
+			if (outOfTime && handled > 0)
 				break;
+
+			// Swapped out rather than copied to skip the reference count.
+			EventPtr event;
+			event.swap(queue.front());
+			queue.pop_front();
+
+			dispatchQueued(event);
+			processed = true;
+			dispatched++;
+
+			QueryPerformanceCounter(&now);
+			if (now.QuadPart >= endTime)
+				outOfTime = true;
 		}
 
-		curTick = GetTickCount();
-		if (curTick >= maxTime)
-			break;
+		// Batches go out before the next lane starts so they keep their priority.
+		dispatchBatches();
 	}
+
+	if (m_profiler)
+	{
+		unsigned int leftOver = 0;
+		for (int lane = 0; lane < EventPriority_Last; lane++)
+			leftOver += m_eventQueues[lane].size();
+
+		QueryPerformanceCounter(&now);
+		m_profiler->OnTick((double)(now.QuadPart - startTime) * 1000000.0 / (double)m_frequency.QuadPart, dispatched, leftOver);
+	}
+
 	return processed;
 }
 
 // Checks if type is valid. Does this by finding the hash value of the name
 // and then checking if the names match if that hash number is already taken.
+// Types are made from their gkName, which is what was registered, so the
+// names are almost always the same pointer and the strcmp is skipped.
 bool EventManager::validateType(EventType const & type)
 {
 	if (type.getName() == NULL)
@@ -219,13 +825,14 @@ bool EventManager::validateType(EventType const & type)
 	if (type.getId() == 0)
 		return false;
 
-	EventTypeSet::iterator it = m_eventTypes.find(type);
+	int index = m_listeners.find(type.getId());
 
-	if (it != m_eventTypes.end())
+	if (index >= 0)
 	{
-		EventType known = (*it);
-		char * const oldName = known.getName();
+		char * const oldName = m_listeners.getEntry(index).m_name;
 		char * const newName = type.getName();
+		if (oldName == newName)
+			return true;
 
 		int check = strcmp(oldName, newName);
 
@@ -7,7 +7,9 @@ I made some minor changes to things I didn't think I needed or to make the simpl
 #pragma once
 
 #include "StdHeader.h"
-#include <set>
+#include "EventPool.h"
+#include <vector>
+#include <algorithm>
 
 
 // Class that holds information on the event. Will be unique for each type of event, but the same for all events of the same type.
@@ -49,51 +51,363 @@ public:
 	}
 };
 
-// Base class for the events.
+// Queued events are handled a lane at a time in this order, so input and game
+// state aren't held up behind effects.
+enum EventPriority
+{
+	EventPriority_Input,
+	EventPriority_Game,
+	EventPriority_Cosmetic,
+	EventPriority_Last
+};
+
+// Binary stream events are saved to for the journal. Values are written as
+// their raw bytes, so a journal is only meant to be read by the same build.
+class EventWriter
+{
+	std::vector<char> & m_buffer;
+public:
+	EventWriter(std::vector<char> & buffer):m_buffer(buffer) {}
+
+	void write(const void * data, unsigned int size)
+	{
+		const char * p = (const char *)data;
+		m_buffer.insert(m_buffer.end(), p, p + size);
+	}
+
+	template<typename _T>
+	void put(_T const & value) { write(&value, sizeof(_T)); }
+
+	void putString(std::string const & str)
+	{
+		unsigned short len = (unsigned short)str.size();
+		put(len);
+		write(str.data(), len);
+	}
+};
+
+// Reads back what EventWriter wrote. Reading past the end fails and leaves ok() false.
+class EventReader
+{
+	const char * m_pos;
+	const char * m_end;
+	bool m_ok;
+public:
+	EventReader(const char * data, unsigned int size):m_pos(data), m_end(data + size), m_ok(true) {}
+
+	bool read(void * data, unsigned int size)
+	{
+		if (!m_ok || (unsigned int)(m_end - m_pos) < size)
+		{
+			m_ok = false;
+			return false;
+		}
+		memcpy(data, m_pos, size);
+		m_pos += size;
+		return true;
+	}
+
+	template<typename _T>
+	bool get(_T & value) { return read(&value, sizeof(_T)); }
+
+	bool getString(std::string & str)
+	{
+		unsigned short len;
+		if (!get(len) || (unsigned int)(m_end - m_pos) < len)
+		{
+			m_ok = false;
+			return false;
+		}
+		str.assign(m_pos, len);
+		m_pos += len;
+		return true;
+	}
+
+	bool ok() const { return m_ok; }
+};
+
+// Base class for the events. The events below keep their data as a member
+// so making one doesn't touch the heap, and queued events come from EventPool.
 class Event
 {
 	EventType m_type;
 	int m_timeIn;
-	EventDataPtr m_data;
+	IEventData * m_data;
+	EventDataPtr m_sharedData;
+
+	// Not copyable, inline data would still point at the original.
+	Event(Event const &);
+	Event & operator=(Event const &);
+
+protected:
+	// For events whose data is a member of the event.
+	Event (EventType const & type, int timeIn, IEventData * data):
+	  m_type(type), m_timeIn(timeIn), m_data(data) {};
+
 public:
+	// The event classes below pass their gkType so the name is only hashed once.
+	Event (EventType const & type, int timeIn, EventDataPtr data = EventDataPtr((IEventData *)NULL)):
+	  m_type(type), m_timeIn(timeIn), m_data(data.get()), m_sharedData(data) {};
 	Event (char * const name, int timeIn, EventDataPtr data = EventDataPtr((IEventData *)NULL)):
-	  m_type(name), m_timeIn(timeIn), m_data(data) {};
+	  m_type(name), m_timeIn(timeIn), m_data(data.get()), m_sharedData(data) {};
 	
-	  ~Event() {}
-	  unsigned int getId() {return m_type.getId();}
+	  virtual ~Event() {}
+	  unsigned int getId() const {return m_type.getId();}
 
 	  // Used to get the data from the event pointer. The data is dependant on the type of event.
 	  template<typename _T>
-	  _T * getData() const {return reinterpret_cast<_T *>(m_data.get());}
-
-	  char* const getName() {return m_type.getName();}
+	  _T * getData() const
+	  {
+		  assert((m_data == NULL || dynamic_cast<_T *>(m_data) != NULL) && "Wrong data type for event!");
+		  return static_cast<_T *>(m_data);
+	  }
+
+	  static void * operator new(size_t size) { return EventPool::Alloc(size); }
+	  static void operator delete(void * p, size_t size) { EventPool::Free(p, size); }
+#if defined(_DEBUG)
+	  // Matches SAFE_NEW. The delete only runs if a constructor throws, there's
+	  // no size to find the free list with so the block is left alone.
+	  static void * operator new(size_t size, int, const char *, int) { return EventPool::Alloc(size); }
+	  static void operator delete(void *, int, const char *, int) {}
+#endif
+
+	  char* const getName() const {return m_type.getName();}
+
+	  // Milliseconds a queued event waits before it's handled.
+	  int getTimeIn() const {return m_timeIn;}
+	  void setTimeIn(int timeIn) {m_timeIn = timeIn;}
+
+	  virtual EventPriority getPriority() const { return EventPriority_Game; }
+
+	  // Writes the event's data for the journal. Events that return false aren't
+	  // journaled. Those that don't have a static deserialize to read it back,
+	  // both are in EventJournal.cpp.
+	  virtual bool serialize(EventWriter & out) const { return false; }
+
+	  // Queued events that return true replace a queued event of the same type and key.
+	  virtual bool getCoalesceKey(unsigned int & key) const { return false; }
 	  EventType getType() const {return m_type;}
 };
 
 
-// Common definitions used for the events
-typedef std::set<EventType> EventTypeSet;
-typedef std::pair<EventTypeSet::iterator, bool> EventTypeSetRet;
-typedef std::list<EventPtr> EventQueue;
-typedef std::map<unsigned int, EventListenerList> EventListenerMap;
-typedef std::pair<EventListenerMap::iterator, bool> EventListenerMapRet;
-typedef std::pair<unsigned int, EventListenerList> EventListenerMapEntry;
+// First in first out queue of events kept in one ring buffer, so queueing
+// doesn't allocate a node per event. Grows by doubling when full.
+//
+// Events that give a coalescing key replace a waiting event of the same type
+// and key in its place, so only the latest of a run of updates is handled.
+// Positions are tracked by sequence number, an index entry is stale once its
+// event has been popped.
+class EventQueue
+{
+	struct CoalesceSlot
+	{
+		unsigned int m_id;			// 0 when empty
+		unsigned int m_key;
+		unsigned int m_seq;
+	};
+
+	std::vector<EventPtr> m_events;
+	unsigned int m_head;
+	unsigned int m_count;
+	unsigned int m_headSeq;			// sequence number of the event at m_head
+
+	std::vector<CoalesceSlot> m_coalesce;
+	unsigned int m_coalesceUsed;
+
+	void grow();
+	void growCoalesce();
+	void append(EventPtr const & event);
+	bool isWaiting(unsigned int seq) const { return seq - m_headSeq < m_count; }
+	EventPtr & atSeq(unsigned int seq) { return m_events[(m_head + (seq - m_headSeq)) & (m_events.size() - 1)]; }
+
+public:
+	EventQueue();
+
+	unsigned int size() const { return m_count; }
+	bool empty() const { return m_count == 0; }
+
+	// Returns true if the event replaced a waiting one rather than being added.
+	bool push_back(EventPtr const & event);
+
+	EventPtr & front() { return m_events[m_head]; }
+	void pop_front();
+};
+
+
+// Listeners for one event type. Dispatch walks the raw pointers, the shared
+// pointers only keep the listeners alive, so calling them costs no reference
+// counting. The name is kept to catch two names hashing to the same id.
+struct EventListenerEntry
+{
+	char * m_name;
+	unsigned int m_id;
+	std::vector<IEventListener *> m_listeners;
+	std::vector<IEventBatchListener *> m_batchListeners;
+	std::vector<EventListenerPtr> m_owners;
+
+	EventListenerEntry():m_name(NULL), m_id(0) {}
+	EventListenerEntry(EventType const & type):m_name(type.getName()), m_id(type.getId()) {}
+
+	bool add(EventListenerPtr const & listener);
+	bool addBatch(EventBatchListenerPtr const & listener);
+	unsigned int size() const { return (unsigned int)m_listeners.size(); }
+	unsigned int batchSize() const { return (unsigned int)m_batchListeners.size(); }
+	bool empty() const { return m_listeners.empty() && m_batchListeners.empty(); }
+};
+
+// Open addressing hash from event id to an entry. Ids are already a hash of
+// the name so they're used as is, and 0 marks an empty slot since it isn't a
+// valid id. Entries are referred to by index because adding a type can move them.
+class EventListenerTable
+{
+	struct Slot
+	{
+		unsigned int m_id;
+		int m_entry;
+	};
+
+	std::vector<Slot> m_slots;
+	unsigned int m_mask;
+	std::vector<EventListenerEntry> m_entries;
+
+	void grow();
+
+public:
+	EventListenerTable();
 
+	int find(unsigned int id) const;
+	int insert(EventType const & type);
+
+	EventListenerEntry & getEntry(int index) { return m_entries[index]; }
+	EventListenerEntry const & getEntry(int index) const { return m_entries[index]; }
+};
+
+
+// Counters for the thread safe queue, to see if producers are getting ahead of tick.
+struct EventRingStats
+{
+	unsigned int m_capacity;
+	unsigned int m_pushed;			// events queued from any thread
+	unsigned int m_rejected;		// pushes that found the ring full
+	unsigned int m_highWater;		// most events drained in one tick
+};
+
+// Bounded lock free queue that any number of threads can push to and one thread,
+// the one that calls tick, pops from. Each slot has a sequence number telling
+// pushers and the popper whose turn it is, so the only contention is pushers
+// racing on the enqueue position.
+class EventRing
+{
+	struct Cell
+	{
+		volatile LONG m_sequence;
+		EventPtr m_event;
+	};
+
+	Cell *m_cells;
+	LONG m_mask;
+
+	// Kept on separate cache lines, pushers hammer the first.
+	char m_pad0[64];
+	volatile LONG m_enqueuePos;
+	char m_pad1[64];
+	LONG m_dequeuePos;
+
+	volatile LONG m_pushed;
+	volatile LONG m_rejected;
+	unsigned int m_highWater;
+
+public:
+	EventRing(unsigned int capacity);
+	~EventRing();
+
+	bool push(EventPtr const & event);
+	bool pop(EventPtr & event);
+
+	void noteDrained(unsigned int count) { if (count > m_highWater) m_highWater = count; }
+	void getStats(EventRingStats & stats) const;
+};
+
+
+class EventJournal;
+class EventProfiler;
 
 // Class used to manage the events. This is a global class that manages itself. 
 class EventManager : public IEventManager
 {
-	EventTypeSet m_eventTypes;
-	EventListenerMap m_listenerMap;
-	EventQueue m_eventQueue;
+	// Queued event waiting for its time, ordered so the heap's top is the earliest.
+	struct DelayedEvent
+	{
+		LONGLONG m_due;				// performance counter time
+		unsigned int m_seq;			// keeps events due together in the order they were queued
+		EventPtr m_event;
+
+		bool operator< (DelayedEvent const & o) const
+		{
+			if (m_due != o.m_due)
+				return m_due > o.m_due;
+			return m_seq > o.m_seq;
+		}
+	};
+
+	EventListenerTable m_listeners;
+	EventListenerEntry m_wildcard;
+	EventQueue m_eventQueues[EventPriority_Last];
+	std::vector<DelayedEvent> m_delayed;
+	unsigned int m_delayedSeq;
+	LARGE_INTEGER m_frequency;
+	EventRing m_threadSafeQueue;
+	unsigned int m_coalesced;		// queued events that replaced a waiting one
+	EventJournal * m_journal;
+	EventProfiler * m_profiler;
+	int m_dispatchDepth;			// above 0 while listeners are running
+	int m_derivedDepth;				// above 0 between beginDerived and endDerived
+
+	// Queued events of types with batch listeners, held until the end of
+	// their lane. The span is rebuilt from them for each type.
+	std::vector<EventPtr> m_batched;
+	std::vector<Event const *> m_batchSpan;
+
+	enum { THREAD_SAFE_QUEUE_SIZE = 1024 };
+
+	bool hasListeners(EventType const & type) const;
+	void registerEventTypes();
+	void enqueue(EventPtr const & event);
+	void pushToLane(EventPtr const & event);
+	void dispatchQueued(EventPtr const & event);
+	void dispatchBatches();
+	bool callListener(IEventListener * listener, Event const & event);
+	bool callBatchListener(IEventBatchListener * listener, Event const * const * events, unsigned int count);
+	bool isDerived() const { return m_dispatchDepth > 0 || m_derivedDepth > 0; }
 	
 public:
-	EventManager(){};
+	// Listeners added with this type name get every event.
+	static char * const gkWildcard;
+
+	EventManager();
+	bool registerType(EventType const & type);
 	virtual bool addListener(EventListenerPtr const & listener, EventType const & type);
+	virtual bool addBatchListener(EventBatchListenerPtr const & listener, EventType const & type);
 	virtual bool triggerEvent(Event const & event);
 	virtual bool queueEvent(EventPtr const & event);
+	virtual bool threadSafeQueueEvent(EventPtr const & event);
 	virtual bool tick(unsigned int maxMS);
 	virtual bool validateType(EventType const & type);
+
+	void getThreadSafeQueueStats(EventRingStats & stats) const { m_threadSafeQueue.getStats(stats); }
+	unsigned int getCoalescedCount() const { return m_coalesced; }
+
+	// Every triggered and queued event is recorded while a journal is set.
+	void setJournal(EventJournal * journal) { m_journal = journal; }
+
+	// Events sent in between follow from ones already recorded, like those
+	// the simulation sends as it updates, so the journal marks them nested
+	// the same as events sent by listeners. Pairs can be nested.
+	virtual void beginDerived() { m_derivedDepth++; }
+	virtual void endDerived() { m_derivedDepth--; }
+
+	// Counts and times events and listeners while a profiler is set.
+	void setProfiler(EventProfiler * profiler) { m_profiler = profiler; }
 };
 
 // Event for adding new actor based on shared pointer of the actor interface class.
@@ -108,11 +422,14 @@ public:
 	}
 };
 
-class Evt_New_Actor :public Event
+class Evt_New_Actor : public Event
 {
+	EvtData_New_Actor m_payload;
 public:
+	typedef EvtData_New_Actor DataType;
 	static char * const gkName;
-	Evt_New_Actor(shared_ptr<ActorParams> p):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_New_Actor(p))){}
+	static const EventType gkType;
+	Evt_New_Actor(shared_ptr<ActorParams> p):Event(gkType, 0, &m_payload), m_payload(p) {}
 };
 
 
@@ -127,11 +444,17 @@ public:
 	EvtData_Remove_Actor(ActorId id):m_id(id) {}
 };
 
-class Evt_Remove_Actor :public Event
+class Evt_Remove_Actor : public Event
 {
+	EvtData_Remove_Actor m_payload;
 public:
+	typedef EvtData_Remove_Actor DataType;
 	static char * const gkName;
-	Evt_Remove_Actor(ActorId id):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Remove_Actor(id))){}
+	static const EventType gkType;
+	Evt_Remove_Actor(ActorId id):Event(gkType, 0, &m_payload), m_payload(id) {}
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 
@@ -146,11 +469,21 @@ public:
 	EvtData_Try_Move_Actor(ActorId id, Mat4x4 mat, float deltaMS):m_id(id),m_Mat(mat),m_deltaMS(deltaMS) {}
 };
 
-class Evt_Try_Move_Actor :public Event
+class Evt_Try_Move_Actor : public Event
 {
+	EvtData_Try_Move_Actor m_payload;
 public:
+	typedef EvtData_Try_Move_Actor DataType;
 	static char * const gkName;
-	Evt_Try_Move_Actor(ActorId id, Mat4x4 mat, float deltaMS):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Try_Move_Actor(id, mat, deltaMS))){}
+	static const EventType gkType;
+	Evt_Try_Move_Actor(ActorId id, Mat4x4 mat, float deltaMS):Event(gkType, 0, &m_payload), m_payload(id, mat, deltaMS) {}
+
+	// Only the latest position of each actor matters.
+	virtual bool getCoalesceKey(unsigned int & key) const { key = m_payload.m_id; return true; }
+	virtual EventPriority getPriority() const { return EventPriority_Input; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 
@@ -165,11 +498,20 @@ public:
 	EvtData_Move_Actor(ActorId id, Mat4x4 mat):m_id(id),m_Mat(mat) {}
 };
 
-class Evt_Move_Actor :public Event
+class Evt_Move_Actor : public Event
 {
+	EvtData_Move_Actor m_payload;
 public:
+	typedef EvtData_Move_Actor DataType;
 	static char * const gkName;
-	Evt_Move_Actor(ActorId id, Mat4x4 mat):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Move_Actor(id, mat))){}
+	static const EventType gkType;
+	Evt_Move_Actor(ActorId id, Mat4x4 mat):Event(gkType, 0, &m_payload), m_payload(id, mat) {}
+
+	// Only the latest position of each actor matters.
+	virtual bool getCoalesceKey(unsigned int & key) const { key = m_payload.m_id; return true; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 
@@ -183,11 +525,20 @@ public:
 	EvtData_Move_Camera(Mat4x4 mat):m_mat(mat) {}
 };
 
-class Evt_Move_Camera :public Event
+class Evt_Move_Camera : public Event
 {
+	EvtData_Move_Camera m_payload;
 public:
+	typedef EvtData_Move_Camera DataType;
 	static char * const gkName;
-	Evt_Move_Camera(Mat4x4 m_mat):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Move_Camera(m_mat))){}
+	static const EventType gkType;
+	Evt_Move_Camera(Mat4x4 m_mat):Event(gkType, 0, &m_payload), m_payload(m_mat) {}
+
+	// Only the latest one matters.
+	virtual bool getCoalesceKey(unsigned int & key) const { key = 0; return true; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 
@@ -203,11 +554,17 @@ public:
 	EvtData_Change_GameState(GameStatus state):m_state(state) {}
 };
 
-class Evt_Change_GameState :public Event
+class Evt_Change_GameState : public Event
 {
+	EvtData_Change_GameState m_payload;
 public:
+	typedef EvtData_Change_GameState DataType;
 	static char * const gkName;
-	Evt_Change_GameState(GameStatus state): Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Change_GameState(state))){} 
+	static const EventType gkType;
+	Evt_Change_GameState(GameStatus state):Event(gkType, 0, &m_payload), m_payload(state) {} 
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used to create a visual effect for the shot from a tower.
@@ -223,11 +580,18 @@ public:
 	EvtData_Shot(ActorId id, int time, Vec3 start, Vec3 end, std::string texture):m_start(start), m_end(end), m_id(id), m_time(time), m_texture(texture){}
 };
 
-class Evt_Shot :public Event
+class Evt_Shot : public Event
 {
+	EvtData_Shot m_payload;
 public:
+	typedef EvtData_Shot DataType;
 	static char * const gkName;
-	Evt_Shot(ActorId id, int time, Vec3 start, Vec3 end, std::string texture):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Shot(id, time, start, end, texture))) {}
+	static const EventType gkType;
+	Evt_Shot(ActorId id, int time, Vec3 start, Vec3 end, std::string texture):Event(gkType, 0, &m_payload), m_payload(id, time, start, end, texture) {}
+	virtual EventPriority getPriority() const { return EventPriority_Cosmetic; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used to remove a visual effect.
@@ -238,11 +602,18 @@ public:
 	EvtData_Remove_Effect(unsigned int num):m_eventNum(num) {}
 };
 
-class Evt_Remove_Effect: public Event
+class Evt_Remove_Effect : public Event
 {
+	EvtData_Remove_Effect m_payload;
 public:
+	typedef EvtData_Remove_Effect DataType;
 	static char * const gkName;
-	Evt_Remove_Effect(unsigned int num):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Remove_Effect(num))) {}
+	static const EventType gkType;
+	Evt_Remove_Effect(unsigned int num):Event(gkType, 0, &m_payload), m_payload(num) {}
+	virtual EventPriority getPriority() const { return EventPriority_Cosmetic; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used to remove an effect by its id.
@@ -253,11 +624,18 @@ public:
 	EvtData_Remove_Effect_By_Id(ActorId id):m_Id(id) {}
 };
 
-class Evt_Remove_Effect_By_Id: public Event
+class Evt_Remove_Effect_By_Id : public Event
 {
+	EvtData_Remove_Effect_By_Id m_payload;
 public:
+	typedef EvtData_Remove_Effect_By_Id DataType;
 	static char * const gkName;
-	Evt_Remove_Effect_By_Id(ActorId id):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Remove_Effect_By_Id(id))) {}
+	static const EventType gkType;
+	Evt_Remove_Effect_By_Id(ActorId id):Event(gkType, 0, &m_payload), m_payload(id) {}
+	virtual EventPriority getPriority() const { return EventPriority_Cosmetic; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used when the display device is created.
@@ -267,11 +645,14 @@ public:
 	IDirect3DDevice9 * m_device;
 	EvtData_Device_Created(IDirect3DDevice9 * device):m_device(device) {}
 };
-class Evt_Device_Created: public Event
+class Evt_Device_Created : public Event
 {
+	EvtData_Device_Created m_payload;
 public:
+	typedef EvtData_Device_Created DataType;
 	static char * const gkName;
-	Evt_Device_Created(IDirect3DDevice9 * device):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Device_Created(device))) {}
+	static const EventType gkType;
+	Evt_Device_Created(IDirect3DDevice9 * device):Event(gkType, 0, &m_payload), m_payload(device) {}
 };
 
 // Event sent to rebuild the ui. Used when the display changes or resets.
@@ -279,7 +660,11 @@ class Evt_RebuildUI: public Event
 {
 public:
 	static char * const gkName;
-	Evt_RebuildUI():Event(gkName, 0){}
+	static const EventType gkType;
+	Evt_RebuildUI():Event(gkType, 0){}
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used to deal damage to an actor.
@@ -293,9 +678,15 @@ public:
 
 class Evt_Damage_Actor : public Event
 {
+	EvtData_Damage_Actor m_payload;
 public:
+	typedef EvtData_Damage_Actor DataType;
 	static char * const gkName;
-	Evt_Damage_Actor(ActorId id, int damage): Event(gkName, 0, EventDataPtr( SAFE_NEW EvtData_Damage_Actor(id, damage))) {}
+	static const EventType gkType;
+	Evt_Damage_Actor(ActorId id, int damage):Event(gkType, 0, &m_payload), m_payload(id, damage) {}
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used to apply a buff (or modifier) to a target.
@@ -308,9 +699,12 @@ public:
 
 class Evt_Apply_Buff : public Event
 {
+	EvtData_Apply_Buff m_payload;
 public:
+	typedef EvtData_Apply_Buff DataType;
 	static char * const gkName;
-	Evt_Apply_Buff(shared_ptr<IBuff> buff): Event(gkName, 0, EventDataPtr( SAFE_NEW EvtData_Apply_Buff(buff) ) ) {}
+	static const EventType gkType;
+	Evt_Apply_Buff(shared_ptr<IBuff> buff):Event(gkType, 0, &m_payload), m_payload(buff) {}
 };
 
 // Event to create a missle type actor to target the given id.
@@ -323,9 +717,15 @@ public:
 
 class Evt_Create_Missile : public Event
 {
+	EvtData_Create_Missile m_payload;
 public:
+	typedef EvtData_Create_Missile DataType;
 	static char * const gkName;
-	Evt_Create_Missile(ActorId id):Event(gkName, 0 , EventDataPtr( SAFE_NEW EvtData_Create_Missile(id))) {}
+	static const EventType gkType;
+	Evt_Create_Missile(ActorId id):Event(gkType, 0, &m_payload), m_payload(id) {}
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event used when the right mouse button has been clicked.
@@ -338,9 +738,16 @@ public:
 
 class Evt_Left_Click : public Event
 {
+	EvtData_Right_Click m_payload;
 public:
+	typedef EvtData_Right_Click DataType;
 	static char * const gkName;
-	Evt_Left_Click(Vec3 l):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Right_Click(l))) {}
+	static const EventType gkType;
+	Evt_Left_Click(Vec3 l):Event(gkType, 0, &m_payload), m_payload(l) {}
+	virtual EventPriority getPriority() const { return EventPriority_Input; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
 };
 
 // Event for when the mouse has moved.
@@ -352,9 +759,50 @@ public:
 	EvtData_Mouse_Move(Vec3 pos):m_pos(pos) {}
 };
 
-class Evt_Mouse_Move :public Event
+class Evt_Mouse_Move : public Event
 {
+	EvtData_Mouse_Move m_payload;
 public:
+	typedef EvtData_Mouse_Move DataType;
 	static char * const gkName;
-	Evt_Mouse_Move(Vec3 pos):Event(gkName, 0, EventDataPtr(SAFE_NEW EvtData_Mouse_Move(pos))){}
-};
\ No newline at end of file
+	static const EventType gkType;
+	Evt_Mouse_Move(Vec3 pos):Event(gkType, 0, &m_payload), m_payload(pos) {}
+
+	// Only the latest one matters.
+	virtual bool getCoalesceKey(unsigned int & key) const { key = 0; return true; }
+	virtual EventPriority getPriority() const { return EventPriority_Input; }
+
+	virtual bool serialize(EventWriter & out) const;
+	static EventPtr deserialize(EventReader & in);
+};
+
+
+// Listener that calls a member function with the event's data already cast.
+// The handler has to take the event's DataType, so a mismatch won't compile.
+template <typename _Event, typename _Owner>
+class TypedEventListener : public IEventListener
+{
+public:
+	typedef bool (_Owner::*Handler)(typename _Event::DataType const & data);
+
+	TypedEventListener(_Owner * owner, Handler handler):m_owner(owner), m_handler(handler) {}
+
+	virtual bool HandleEvent(Event const & e)
+	{
+		return (m_owner->*m_handler)(*e.getData<typename _Event::DataType>());
+	}
+
+private:
+	_Owner * m_owner;
+	Handler m_handler;
+};
+
+// Adds a typed listener for _Event, e.g. safeAddTypedListener<Evt_Move_Actor>(this, &Foo::OnMove).
+template <typename _Event, typename _Owner>
+EventListenerPtr safeAddTypedListener(_Owner * owner, bool (_Owner::*handler)(typename _Event::DataType const &))
+{
+	EventListenerPtr listener(SAFE_NEW TypedEventListener<_Event, _Owner>(owner, handler));
+	if (!safeAddListener(listener, _Event::gkType))
+		listener.reset();
+	return listener;
+}
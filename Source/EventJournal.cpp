@@ -0,0 +1,560 @@
+/*
+Event journal, see EventJournal.h. The event classes' serialize and
+deserialize functions are here too, so a change to what an event carries
+only needs looking at in one place.
+*/
+
+#include "EventJournal.h"
+#include <process.h>
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////Event serialization////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+bool Evt_Remove_Actor::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_id);
+	return true;
+}
+
+EventPtr Evt_Remove_Actor::deserialize(EventReader & in)
+{
+	ActorId id;
+	in.get(id);
+	return EventPtr(SAFE_NEW Evt_Remove_Actor(id));
+}
+
+bool Evt_Try_Move_Actor::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_id);
+	out.put(m_payload.m_Mat);
+	out.put(m_payload.m_deltaMS);
+	return true;
+}
+
+EventPtr Evt_Try_Move_Actor::deserialize(EventReader & in)
+{
+	ActorId id;
+	Mat4x4 mat;
+	float deltaMS;
+	in.get(id);
+	in.get(mat);
+	in.get(deltaMS);
+	return EventPtr(SAFE_NEW Evt_Try_Move_Actor(id, mat, deltaMS));
+}
+
+bool Evt_Move_Actor::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_id);
+	out.put(m_payload.m_Mat);
+	return true;
+}
+
+EventPtr Evt_Move_Actor::deserialize(EventReader & in)
+{
+	ActorId id;
+	Mat4x4 mat;
+	in.get(id);
+	in.get(mat);
+	return EventPtr(SAFE_NEW Evt_Move_Actor(id, mat));
+}
+
+bool Evt_Move_Camera::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_mat);
+	return true;
+}
+
+EventPtr Evt_Move_Camera::deserialize(EventReader & in)
+{
+	Mat4x4 mat;
+	in.get(mat);
+	return EventPtr(SAFE_NEW Evt_Move_Camera(mat));
+}
+
+bool Evt_Change_GameState::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_state);
+	return true;
+}
+
+EventPtr Evt_Change_GameState::deserialize(EventReader & in)
+{
+	GameStatus state;
+	in.get(state);
+	return EventPtr(SAFE_NEW Evt_Change_GameState(state));
+}
+
+bool Evt_Shot::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_id);
+	out.put(m_payload.m_time);
+	out.put(m_payload.m_start);
+	out.put(m_payload.m_end);
+	out.putString(m_payload.m_texture);
+	return true;
+}
+
+EventPtr Evt_Shot::deserialize(EventReader & in)
+{
+	ActorId id;
+	int time;
+	Vec3 start, end;
+	std::string texture;
+	in.get(id);
+	in.get(time);
+	in.get(start);
+	in.get(end);
+	in.getString(texture);
+	return EventPtr(SAFE_NEW Evt_Shot(id, time, start, end, texture));
+}
+
+bool Evt_Remove_Effect::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_eventNum);
+	return true;
+}
+
+EventPtr Evt_Remove_Effect::deserialize(EventReader & in)
+{
+	unsigned int num;
+	in.get(num);
+	return EventPtr(SAFE_NEW Evt_Remove_Effect(num));
+}
+
+bool Evt_Remove_Effect_By_Id::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_Id);
+	return true;
+}
+
+EventPtr Evt_Remove_Effect_By_Id::deserialize(EventReader & in)
+{
+	ActorId id;
+	in.get(id);
+	return EventPtr(SAFE_NEW Evt_Remove_Effect_By_Id(id));
+}
+
+bool Evt_RebuildUI::serialize(EventWriter & out) const
+{
+	return true;
+}
+
+EventPtr Evt_RebuildUI::deserialize(EventReader & in)
+{
+	return EventPtr(SAFE_NEW Evt_RebuildUI());
+}
+
+bool Evt_Damage_Actor::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_id);
+	out.put(m_payload.m_damage);
+	return true;
+}
+
+EventPtr Evt_Damage_Actor::deserialize(EventReader & in)
+{
+	ActorId id;
+	int damage;
+	in.get(id);
+	in.get(damage);
+	return EventPtr(SAFE_NEW Evt_Damage_Actor(id, damage));
+}
+
+bool Evt_Create_Missile::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_id);
+	return true;
+}
+
+EventPtr Evt_Create_Missile::deserialize(EventReader & in)
+{
+	ActorId id;
+	in.get(id);
+	return EventPtr(SAFE_NEW Evt_Create_Missile(id));
+}
+
+bool Evt_Left_Click::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_loc);
+	return true;
+}
+
+EventPtr Evt_Left_Click::deserialize(EventReader & in)
+{
+	Vec3 loc;
+	in.get(loc);
+	return EventPtr(SAFE_NEW Evt_Left_Click(loc));
+}
+
+bool Evt_Mouse_Move::serialize(EventWriter & out) const
+{
+	out.put(m_payload.m_pos);
+	return true;
+}
+
+EventPtr Evt_Mouse_Move::deserialize(EventReader & in)
+{
+	Vec3 pos;
+	in.get(pos);
+	return EventPtr(SAFE_NEW Evt_Mouse_Move(pos));
+}
+
+// Events that can be read back. Names rather than gkTypes so the table is
+// constant initialised.
+struct EventFactoryEntry
+{
+	char * const * m_name;
+	EventPtr (*m_factory)(EventReader & in);
+};
+
+static const EventFactoryEntry s_eventFactories[] =
+{
+	{ &Evt_Remove_Actor::gkName, Evt_Remove_Actor::deserialize },
+	{ &Evt_Try_Move_Actor::gkName, Evt_Try_Move_Actor::deserialize },
+	{ &Evt_Move_Actor::gkName, Evt_Move_Actor::deserialize },
+	{ &Evt_Move_Camera::gkName, Evt_Move_Camera::deserialize },
+	{ &Evt_Change_GameState::gkName, Evt_Change_GameState::deserialize },
+	{ &Evt_Shot::gkName, Evt_Shot::deserialize },
+	{ &Evt_Remove_Effect::gkName, Evt_Remove_Effect::deserialize },
+	{ &Evt_Remove_Effect_By_Id::gkName, Evt_Remove_Effect_By_Id::deserialize },
+	{ &Evt_RebuildUI::gkName, Evt_RebuildUI::deserialize },
+	{ &Evt_Damage_Actor::gkName, Evt_Damage_Actor::deserialize },
+	{ &Evt_Create_Missile::gkName, Evt_Create_Missile::deserialize },
+	{ &Evt_Left_Click::gkName, Evt_Left_Click::deserialize },
+	{ &Evt_Mouse_Move::gkName, Evt_Mouse_Move::deserialize },
+};
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////EventJournal///////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+EventJournal::EventJournal()
+{
+	m_file = INVALID_HANDLE_VALUE;
+	m_thread = NULL;
+	m_wake = NULL;
+	m_stop = 0;
+	m_frame = 0;
+	m_recorded = 0;
+	m_skipped = 0;
+	InitializeCriticalSection(&m_cs);
+}
+
+EventJournal::~EventJournal()
+{
+	Close();
+	DeleteCriticalSection(&m_cs);
+}
+
+bool EventJournal::Open(const _TCHAR *fileName)
+{
+	Close();
+
+	m_file = CreateFileW(fileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!m_wake)
+	{
+		Close();
+		return false;
+	}
+
+	m_stop = 0;
+	m_thread = (HANDLE)_beginthreadex(NULL, 0, WriterThreadProc, this, 0, NULL);
+	if (!m_thread)
+	{
+		Close();
+		return false;
+	}
+
+	m_frame = 0;
+	m_recorded = 0;
+	m_skipped = 0;
+
+	TEventJournalHeader header;
+	header.m_signature = TEventJournalHeader::SIGNATURE;
+	header.m_version = TEventJournalHeader::VERSION;
+	header.m_reserved = 0;
+
+	m_buffer.clear();
+	EventWriter out(m_buffer);
+	out.put(header);
+	return true;
+}
+
+// Hands over whatever is left and waits for the writer to finish.
+void EventJournal::Close()
+{
+	if (m_thread)
+	{
+		Submit();
+		InterlockedExchange(&m_stop, 1);
+		SetEvent(m_wake);
+		WaitForSingleObject(m_thread, INFINITE);
+		CloseHandle(m_thread);
+		m_thread = NULL;
+	}
+
+	if (m_wake)
+	{
+		CloseHandle(m_wake);
+		m_wake = NULL;
+	}
+
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+
+	for (std::list<std::vector<char> *>::iterator it = m_pending.begin(); it != m_pending.end(); it++)
+		SAFE_DELETE(*it);
+	m_pending.clear();
+	m_buffer.clear();
+}
+
+// Starts a new frame. The last one's records go to the writer once enough have built up.
+void EventJournal::BeginFrame(unsigned int deltaMS)
+{
+	if (!IsOpen())
+		return;
+
+	if (m_buffer.size() >= SUBMIT_SIZE)
+		Submit();
+
+	m_frame++;
+
+	TEventJournalRecord record;
+	record.m_frame = m_frame;
+	record.m_typeId = 0;
+	record.m_timeIn = 0;
+	record.m_size = sizeof(deltaMS);
+	record.m_flags = TEventJournalRecord::FLAG_FRAME;
+
+	EventWriter out(m_buffer);
+	out.put(record);
+	out.put(deltaMS);
+}
+
+void EventJournal::Record(Event const & event, bool queued, bool nested)
+{
+	if (!IsOpen())
+		return;
+
+	// The header is filled in once the data's size is known.
+	unsigned int start = (unsigned int)m_buffer.size();
+	m_buffer.resize(start + sizeof(TEventJournalRecord));
+
+	EventWriter out(m_buffer);
+	if (!event.serialize(out))
+	{
+		m_buffer.resize(start);
+		m_skipped++;
+		return;
+	}
+
+	TEventJournalRecord record;
+	record.m_frame = m_frame;
+	record.m_typeId = event.getId();
+	record.m_timeIn = event.getTimeIn();
+	record.m_size = (unsigned short)(m_buffer.size() - start - sizeof(TEventJournalRecord));
+	record.m_flags = (queued ? TEventJournalRecord::FLAG_QUEUED : 0) | (nested ? TEventJournalRecord::FLAG_NESTED : 0);
+	memcpy(&m_buffer[start], &record, sizeof(record));
+
+	m_recorded++;
+}
+
+void EventJournal::Submit()
+{
+	if (m_buffer.empty())
+		return;
+
+	std::vector<char> *buffer = SAFE_NEW std::vector<char>();
+	buffer->swap(m_buffer);
+
+	EnterCriticalSection(&m_cs);
+	m_pending.push_back(buffer);
+	LeaveCriticalSection(&m_cs);
+
+	SetEvent(m_wake);
+}
+
+unsigned int __stdcall EventJournal::WriterThreadProc(void *pJournal)
+{
+	((EventJournal *)pJournal)->WriteAll();
+	return 0;
+}
+
+// Writer thread. Writes buffers as they're handed over until told to stop.
+// The stop flag is read before emptying the list so a buffer handed over
+// just before stopping is still written.
+void EventJournal::WriteAll()
+{
+	for (;;)
+	{
+		WaitForSingleObject(m_wake, INFINITE);
+		bool stop = m_stop != 0;
+
+		for (;;)
+		{
+			std::vector<char> *buffer = NULL;
+
+			EnterCriticalSection(&m_cs);
+			if (!m_pending.empty())
+			{
+				buffer = m_pending.front();
+				m_pending.pop_front();
+			}
+			LeaveCriticalSection(&m_cs);
+
+			if (!buffer)
+				break;
+
+			DWORD written;
+			::WriteFile(m_file, &(*buffer)[0], (DWORD)buffer->size(), &written, NULL);
+			SAFE_DELETE(buffer);
+		}
+
+		if (stop)
+			break;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////EventJournalPlayer/////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+EventJournalPlayer::EventJournalPlayer()
+{
+	m_pos = 0;
+	m_frameStart = 0;
+	m_frameEnd = 0;
+	m_sent = 0;
+
+	for (int i = 0; i < sizeof(s_eventFactories) / sizeof(s_eventFactories[0]); i++)
+		m_factories[EventType::hashName(*s_eventFactories[i].m_name)] = s_eventFactories[i].m_factory;
+}
+
+// Reads the whole journal in.
+bool EventJournalPlayer::Open(const _TCHAR *fileName)
+{
+	m_data.clear();
+	m_pos = m_frameStart = m_frameEnd = 0;
+	m_sent = 0;
+
+	HANDLE file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD size = GetFileSize(file, NULL);
+	DWORD bytesRead = 0;
+	if (size != INVALID_FILE_SIZE && size >= sizeof(TEventJournalHeader))
+	{
+		m_data.resize(size);
+		::ReadFile(file, &m_data[0], size, &bytesRead, NULL);
+	}
+	CloseHandle(file);
+
+	if (bytesRead < sizeof(TEventJournalHeader) || bytesRead != m_data.size())
+		return false;
+
+	TEventJournalHeader header;
+	memcpy(&header, &m_data[0], sizeof(header));
+	if (header.m_signature != TEventJournalHeader::SIGNATURE || header.m_version != TEventJournalHeader::VERSION)
+		return false;
+
+	m_pos = m_frameStart = m_frameEnd = sizeof(TEventJournalHeader);
+	return true;
+}
+
+// Copies out the record header at pos. False if the record runs off the end
+// of the journal. Records aren't aligned, so they're never read in place.
+bool EventJournalPlayer::RecordAt(unsigned int pos, TEventJournalRecord & record) const
+{
+	if (pos + sizeof(TEventJournalRecord) > m_data.size())
+		return false;
+
+	memcpy(&record, &m_data[pos], sizeof(record));
+	return pos + sizeof(TEventJournalRecord) + record.m_size <= m_data.size();
+}
+
+// Events before the first frame record, sent while the game started up, are
+// given a frame of their own with no time.
+bool EventJournalPlayer::NextFrame(unsigned int & deltaMS)
+{
+	m_pos = m_frameEnd;
+
+	TEventJournalRecord record;
+	if (!RecordAt(m_pos, record))
+		return false;
+
+	deltaMS = 0;
+	if (record.m_flags & TEventJournalRecord::FLAG_FRAME)
+	{
+		if (record.m_size >= sizeof(deltaMS))
+			memcpy(&deltaMS, &m_data[m_pos + sizeof(TEventJournalRecord)], sizeof(deltaMS));
+		m_pos += sizeof(TEventJournalRecord) + record.m_size;
+	}
+
+	m_frameStart = m_pos;
+	m_frameEnd = m_pos;
+
+	bool whole;
+	while ((whole = RecordAt(m_frameEnd, record)) && !(record.m_flags & TEventJournalRecord::FLAG_FRAME))
+		m_frameEnd += sizeof(TEventJournalRecord) + record.m_size;
+
+	// A record cut short at the end of the file is dropped.
+	if (!whole && m_frameEnd < m_data.size())
+		m_data.resize(m_frameEnd);
+
+	return true;
+}
+
+unsigned int EventJournalPlayer::SendFrameEvents()
+{
+	unsigned int sent = 0;
+
+	for (unsigned int pos = m_frameStart; pos < m_frameEnd; )
+	{
+		TEventJournalRecord record;
+		RecordAt(pos, record);
+		const char *data = &m_data[pos + sizeof(TEventJournalRecord)];
+		pos += sizeof(TEventJournalRecord) + record.m_size;
+
+		if (record.m_flags & TEventJournalRecord::FLAG_NESTED)
+			continue;
+
+		EventFactoryMap::iterator it = m_factories.find(record.m_typeId);
+		if (it == m_factories.end())
+			continue;
+
+		EventReader in(data, record.m_size);
+		EventPtr event = (*it).second(in);
+		if (!event || !in.ok())
+			continue;
+
+		event->setTimeIn(record.m_timeIn);
+
+		if (record.m_flags & TEventJournalRecord::FLAG_QUEUED)
+			safeQueueEvent(event);
+		else
+			safeTriggerEvent(*event);
+
+		sent++;
+	}
+
+	m_sent += sent;
+	return sent;
+}
@@ -0,0 +1,118 @@
+/*
+Records the events the EventManager sees to a binary file and plays them back.
+
+The game calls BeginFrame once per update with the frame's time, and the
+manager records every triggered and queued event after it. Records are
+gathered into a buffer that a background thread writes out, so recording
+doesn't wait on the disk.
+
+Events sent by a listener while another event is being handled are marked
+nested, and so are those the game sends from its own update, see
+EventManager::beginDerived. They're kept for looking at but not replayed,
+since handling the replayed events, or updating the game, sends them again.
+*/
+
+#pragma once
+
+#include "StdHeader.h"
+#include "Event.h"
+
+#pragma pack(push, 1)
+
+struct TEventJournalHeader
+{
+	enum { SIGNATURE = 0x4a564551, VERSION = 1 };	// "QEVJ"
+
+	unsigned int m_signature;
+	unsigned short m_version;
+	unsigned short m_reserved;
+};
+
+// Followed by m_size bytes of the event's data. A frame record has a type id
+// of 0 and the frame's time in ms as its data.
+struct TEventJournalRecord
+{
+	enum
+	{
+		FLAG_QUEUED = 1,
+		FLAG_NESTED = 2,
+		FLAG_FRAME = 4
+	};
+
+	unsigned int m_frame;
+	unsigned int m_typeId;
+	int m_timeIn;
+	unsigned short m_size;
+	unsigned char m_flags;
+};
+
+#pragma pack(pop)
+
+#define EVENT_JOURNAL _T("Q3Game.evj")
+
+class EventJournal
+{
+	HANDLE m_file;
+	HANDLE m_thread;
+	HANDLE m_wake;
+	CRITICAL_SECTION m_cs;
+	volatile LONG m_stop;
+
+	std::vector<char> m_buffer;					// filled by the game thread
+	std::list<std::vector<char> *> m_pending;	// waiting for the writer, guarded by m_cs
+
+	unsigned int m_frame;
+	unsigned int m_recorded;
+	unsigned int m_skipped;						// events with no serialize
+
+	enum { SUBMIT_SIZE = 64 * 1024 };
+
+	void Submit();
+	void WriteAll();
+	static unsigned int __stdcall WriterThreadProc(void *pJournal);
+
+public:
+	EventJournal();
+	~EventJournal();
+
+	bool Open(const _TCHAR *fileName);
+	void Close();
+	bool IsOpen() const { return m_file != INVALID_HANDLE_VALUE; }
+
+	void BeginFrame(unsigned int deltaMS);
+	void Record(Event const & event, bool queued, bool nested);
+
+	unsigned int GetFrame() const { return m_frame; }
+	unsigned int GetRecordedCount() const { return m_recorded; }
+	unsigned int GetSkippedCount() const { return m_skipped; }
+};
+
+
+// Reads a journal and sends its events again a frame at a time.
+class EventJournalPlayer
+{
+	std::vector<char> m_data;
+	unsigned int m_pos;
+	unsigned int m_frameStart;
+	unsigned int m_frameEnd;
+	unsigned int m_sent;
+
+	typedef EventPtr (*EventFactory)(EventReader & in);
+	typedef std::map<unsigned int, EventFactory> EventFactoryMap;
+	EventFactoryMap m_factories;
+
+	bool RecordAt(unsigned int pos, TEventJournalRecord & record) const;
+
+public:
+	EventJournalPlayer();
+
+	bool Open(const _TCHAR *fileName);
+
+	// Moves on to the next frame. Returns false when there are none left.
+	bool NextFrame(unsigned int & deltaMS);
+
+	// Triggers or queues the frame's events the way they were sent. Returns how many were sent.
+	unsigned int SendFrameEvents();
+
+	unsigned int GetSentCount() const { return m_sent; }
+};
@@ -0,0 +1,68 @@
+/*
+Fixed size blocks for events, see EventPool.h.
+*/
+
+#include "EventPool.h"
+
+SLIST_HEADER EventPool::s_freeLists[EventPool::NUM_CLASSES];
+volatile LONG EventPool::s_chunks = 0;
+
+void * EventPool::Alloc(size_t size)
+{
+	if (size == 0)
+		size = 1;
+
+	if (size > MAX_SIZE)
+		return ::operator new(size);
+
+	unsigned int sizeClass = (unsigned int)((size - 1) / GRANULARITY);
+
+	void * p = InterlockedPopEntrySList(&s_freeLists[sizeClass]);
+	if (p == NULL)
+		p = Refill(sizeClass);
+
+	// The class operator news aren't throw(), so the constructor would run on
+	// NULL. A whole block from the heap joins the free list when it's freed,
+	// and the heap throws if it's out too.
+	if (p == NULL)
+		p = ::operator new((sizeClass + 1) * GRANULARITY);
+
+	return p;
+}
+
+void EventPool::Free(void * p, size_t size)
+{
+	if (p == NULL)
+		return;
+
+	if (size == 0)
+		size = 1;
+
+	if (size > MAX_SIZE)
+	{
+		::operator delete(p);
+		return;
+	}
+
+	unsigned int sizeClass = (unsigned int)((size - 1) / GRANULARITY);
+	InterlockedPushEntrySList(&s_freeLists[sizeClass], (PSLIST_ENTRY)p);
+}
+
+// Gets a new chunk, keeps the first block and puts the rest on the free list.
+// Two threads refilling at once each add a chunk, which is harmless.
+void * EventPool::Refill(unsigned int sizeClass)
+{
+	char * chunk = (char *)VirtualAlloc(NULL, CHUNK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (chunk == NULL)
+		return NULL;
+
+	InterlockedIncrement(&s_chunks);
+
+	unsigned int blockSize = (sizeClass + 1) * GRANULARITY;
+	unsigned int count = CHUNK_SIZE / blockSize;
+
+	for (unsigned int i = 1; i < count; i++)
+		InterlockedPushEntrySList(&s_freeLists[sizeClass], (PSLIST_ENTRY)(chunk + i * blockSize));
+
+	return chunk;
+}
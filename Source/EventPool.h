@@ -0,0 +1,35 @@
+/*
+Fixed size blocks for events. Each size class has a lock free free list so
+events can be made and freed on any thread without going to the heap, and
+the blocks are carved out of chunks that are never given back.
+*/
+
+#pragma once
+
+#include "StdHeader.h"
+
+class EventPool
+{
+public:
+	enum
+	{
+		GRANULARITY = 16,				// also keeps the blocks aligned for the free list
+		NUM_CLASSES = 16,
+		MAX_SIZE = GRANULARITY * NUM_CLASSES,
+		CHUNK_SIZE = 64 * 1024
+	};
+
+	// Sizes over MAX_SIZE go to the heap. Free needs the size the block was allocated with.
+	// Never returns NULL, it throws std::bad_alloc like the heap.
+	static void * Alloc(size_t size);
+	static void Free(void * p, size_t size);
+
+	static unsigned int GetChunkCount() { return (unsigned int)s_chunks; }
+
+private:
+	// Zeroed static storage is an initialised SLIST_HEADER.
+	static SLIST_HEADER s_freeLists[NUM_CLASSES];
+	static volatile LONG s_chunks;
+
+	static void * Refill(unsigned int sizeClass);
+};
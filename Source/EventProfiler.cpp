@@ -0,0 +1,178 @@
+/*
+Event profiler, see EventProfiler.h.
+*/
+
+#include "EventProfiler.h"
+#include <typeinfo>
+
+
+EventProfiler::EventProfiler()
+{
+	m_budgetMicros = 1000.0;
+	Reset();
+}
+
+void EventProfiler::Reset()
+{
+	m_types.clear();
+	m_listeners.clear();
+	m_spikes.clear();
+	m_tickTime.Reset();
+	m_ticks = 0;
+	m_tickEvents = 0;
+	m_maxTickEvents = 0;
+	m_ticksOutOfTime = 0;
+}
+
+EventTypeStats & EventProfiler::GetTypeStats(Event const & event)
+{
+	EventTypeStats & stats = m_types[event.getId()];
+	if (!stats.m_name)
+		stats.m_name = event.getName();
+	return stats;
+}
+
+void EventProfiler::OnTriggered(Event const & event)
+{
+	GetTypeStats(event).m_triggered++;
+}
+
+void EventProfiler::OnQueued(Event const & event, bool coalesced)
+{
+	EventTypeStats & stats = GetTypeStats(event);
+	stats.m_queued++;
+
+	// A coalesced event took the place of one already counted as waiting.
+	if (coalesced)
+	{
+		stats.m_coalesced++;
+		return;
+	}
+
+	stats.m_pending++;
+	if (stats.m_pending > stats.m_maxPending)
+		stats.m_maxPending = stats.m_pending;
+}
+
+void EventProfiler::OnDispatched(Event const & event)
+{
+	EventTypeStats & stats = GetTypeStats(event);
+	stats.m_dispatched++;
+
+	// Events queued before the profiler was set weren't counted in.
+	if (stats.m_pending)
+		stats.m_pending--;
+}
+
+void EventProfiler::OnListener(Event const & event, IEventListener * listener, bool handled, double micros)
+{
+	const char * name = typeid(*listener).name();
+	EventListenerStats & stats = m_listeners[EventListenerKey(event.getId(), name)];
+	if (!stats.m_listener)
+	{
+		stats.m_listener = name;
+		stats.m_event = event.getName();
+	}
+
+	stats.m_time.Add(micros);
+	if (handled)
+		stats.m_handled++;
+
+	if (micros <= m_budgetMicros)
+		return;
+
+	stats.m_overBudget++;
+
+	EventSpike spike;
+	spike.m_tick = m_ticks;
+	spike.m_listener = name;
+	spike.m_event = event.getName();
+	spike.m_micros = micros;
+
+	if (m_spikes.size() >= MAX_SPIKES)
+		m_spikes.pop_front();
+	m_spikes.push_back(spike);
+}
+
+void EventProfiler::OnTick(double micros, unsigned int dispatched, unsigned int leftOver)
+{
+	m_ticks++;
+	m_tickTime.Add(micros);
+	m_tickEvents += dispatched;
+	if (dispatched > m_maxTickEvents)
+		m_maxTickEvents = dispatched;
+	if (leftOver)
+		m_ticksOutOfTime++;
+}
+
+
+// The tick totals, then "types", "listeners" and "spikes". Listeners are
+// listed under the event they were called for.
+std::string EventProfiler::GetReportJson() const
+{
+	char buf[256];
+	sprintf(buf, "{\n  \"ticks\": %u, \"ticksOutOfTime\": %u, \"tickEvents\": %u, \"maxTickEvents\": %u, \"budgetUs\": %.1f,\n  ",
+		m_ticks, m_ticksOutOfTime, m_tickEvents, m_maxTickEvents, m_budgetMicros);
+
+	std::string json = buf;
+	AppendJsonHistogram(json, "tickTime", m_tickTime);
+
+	json += ",\n  \"types\": {";
+	for (EventTypeStatsMap::const_iterator it = m_types.begin(); it != m_types.end(); it++)
+	{
+		EventTypeStats const & t = (*it).second;
+
+		if (it != m_types.begin())
+			json += ",";
+		json += "\n    ";
+		AppendJsonString(json, t.m_name);
+		sprintf(buf, ": {\"triggered\": %u, \"queued\": %u, \"coalesced\": %u, \"dispatched\": %u, \"pending\": %u, \"maxPending\": %u, \"listeners\": {",
+			t.m_triggered, t.m_queued, t.m_coalesced, t.m_dispatched, t.m_pending, t.m_maxPending);
+		json += buf;
+
+		// The map is ordered by type id first, so a type's listeners are together.
+		bool first = true;
+		for (EventListenerStatsMap::const_iterator l = m_listeners.lower_bound(EventListenerKey((*it).first, NULL));
+			l != m_listeners.end() && (*l).first.first == (*it).first; l++)
+		{
+			EventListenerStats const & s = (*l).second;
+
+			json += first ? "\n      " : ",\n      ";
+			first = false;
+			AppendJsonString(json, s.m_listener);
+			sprintf(buf, ": {\"handled\": %u, \"overBudget\": %u, ", s.m_handled, s.m_overBudget);
+			json += buf;
+			AppendJsonHistogram(json, "time", s.m_time);
+			json += "}";
+		}
+		json += first ? "}}" : "\n    }}";
+	}
+	json += "\n  },\n  \"spikes\": [";
+
+	for (EventSpikeList::const_iterator it = m_spikes.begin(); it != m_spikes.end(); it++)
+	{
+		if (it != m_spikes.begin())
+			json += ",";
+		sprintf(buf, "\n    {\"tick\": %u, \"us\": %.1f, \"event\": ", (*it).m_tick, (*it).m_micros);
+		json += buf;
+		AppendJsonString(json, (*it).m_event);
+		json += ", \"listener\": ";
+		AppendJsonString(json, (*it).m_listener);
+		json += "}";
+	}
+	json += "\n  ]\n}\n";
+
+	return json;
+}
+
+bool EventProfiler::DumpReport(const _TCHAR *fileName) const
+{
+	FILE *file = _wfopen(fileName, _T("wt"));
+	if (!file)
+		return false;
+
+	std::string json = GetReportJson();
+	fwrite(json.c_str(), json.size(), 1, file);
+	fclose(file);
+	return true;
+}
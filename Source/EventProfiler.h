@@ -0,0 +1,102 @@
+/*
+Counts and times what goes through the EventManager while it's set on the
+manager, so a slow frame can be traced back to the event and the listener
+that caused it.
+
+Every event type gets a count of how often it was triggered, queued and
+handled, and how many were waiting in the queue at most. Every listener gets
+a histogram of the time its HandleEvent took for each type it listens to.
+Calls over the budget are counted and the most recent ones kept with the
+tick they happened in.
+*/
+
+#pragma once
+
+#include "StdHeader.h"
+#include "Event.h"
+#include "ResourceCache\ResCacheStats.h"
+#include <deque>
+#include <string>
+
+struct EventTypeStats
+{
+	char * m_name;
+	unsigned int m_triggered;
+	unsigned int m_queued;
+	unsigned int m_coalesced;		// queued ones that replaced a waiting event
+	unsigned int m_dispatched;		// queued ones handed to listeners
+	unsigned int m_pending;			// waiting in the queue now
+	unsigned int m_maxPending;
+
+	EventTypeStats() : m_name(NULL), m_triggered(0), m_queued(0), m_coalesced(0), m_dispatched(0), m_pending(0), m_maxPending(0) { }
+};
+
+struct EventListenerStats
+{
+	const char * m_listener;		// class name of the listener
+	char * m_event;
+	unsigned int m_handled;			// calls that returned true
+	unsigned int m_overBudget;
+	ResHistogram m_time;
+
+	EventListenerStats() : m_listener(NULL), m_event(NULL), m_handled(0), m_overBudget(0) { }
+};
+
+// A listener call that went over the budget.
+struct EventSpike
+{
+	unsigned int m_tick;
+	const char * m_listener;
+	char * m_event;
+	double m_micros;
+};
+
+// Keyed by event type id, then by listener class name. The names come from
+// typeid so the same pointer is always used for a class.
+typedef std::map<unsigned int, EventTypeStats> EventTypeStatsMap;
+typedef std::pair<unsigned int, const char *> EventListenerKey;
+typedef std::map<EventListenerKey, EventListenerStats> EventListenerStatsMap;
+typedef std::deque<EventSpike> EventSpikeList;
+
+class EventProfiler
+{
+	EventTypeStatsMap m_types;
+	EventListenerStatsMap m_listeners;
+	EventSpikeList m_spikes;
+
+	ResHistogram m_tickTime;
+	unsigned int m_ticks;
+	unsigned int m_tickEvents;		// queued events handled by all the ticks
+	unsigned int m_maxTickEvents;
+	unsigned int m_ticksOutOfTime;	// ticks that left events for the next one
+	double m_budgetMicros;
+
+	enum { MAX_SPIKES = 64 };
+
+	EventTypeStats & GetTypeStats(Event const & event);
+
+public:
+	EventProfiler();
+
+	// Time a single HandleEvent call may take before it's flagged.
+	void SetBudget(double micros) { m_budgetMicros = micros; }
+	double GetBudget() const { return m_budgetMicros; }
+
+	// Called by the EventManager.
+	void OnTriggered(Event const & event);
+	void OnQueued(Event const & event, bool coalesced);
+	void OnDispatched(Event const & event);
+	void OnListener(Event const & event, IEventListener * listener, bool handled, double micros);
+	void OnTick(double micros, unsigned int dispatched, unsigned int leftOver);
+
+	void Reset();
+
+	const EventTypeStatsMap & GetTypeStats() const { return m_types; }
+	const EventListenerStatsMap & GetListenerStats() const { return m_listeners; }
+	const EventSpikeList & GetSpikes() const { return m_spikes; }
+	const ResHistogram & GetTickTime() const { return m_tickTime; }
+	unsigned int GetTickCount() const { return m_ticks; }
+
+	std::string GetReportJson() const;
+	bool DumpReport(const _TCHAR *fileName) const;
+};
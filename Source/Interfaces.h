@@ -9,10 +9,30 @@ public:
 	virtual bool VOpen()=0;
 	virtual int VGetResourceSize(const Resource &r)=0;
 	virtual int VGetResource(const Resource &r, char *buffer)=0;
+
+	// Raw (still compressed) access so the cache can keep a compressed copy around.
+	// Files that don't support it report a size of 0.
+	virtual int VGetRawResourceSize(const Resource &r) { return 0; }
+	virtual bool VGetRawResource(const Resource &r, char *rawBuffer) { return false; }
+	virtual bool VDecodeRawResource(const Resource &r, const char *rawBuffer, char *buffer) { return false; }
+
+	// Pointer to a resource that can be used in place, valid until the file is closed.
+	// NULL if it has to be copied out with VGetResource.
+	virtual const char *VGetResourceView(const Resource &r) { return NULL; }
 	virtual ~IResourceFile() { }
 };
 
 typedef unsigned int ActorId;
+const ActorId INVALID_ACTOR_ID = (ActorId)-1;		// what the -1 defaults come out as
+
+// An id is the actor's slot in the ActorStore in the low bits and the
+// slot's generation in the rest, so an old id doesn't find a new actor.
+const unsigned int ACTOR_INDEX_BITS = 20;
+const unsigned int ACTOR_INDEX_MASK = (1 << ACTOR_INDEX_BITS) - 1;
+const unsigned int ACTOR_GENERATION_MASK = (1 << (32 - ACTOR_INDEX_BITS)) - 1;
+
+inline unsigned int ActorIndex(ActorId id) { return id & ACTOR_INDEX_MASK; }
+inline ActorId MakeActorId(unsigned int index, unsigned int generation) { return (generation << ACTOR_INDEX_BITS) | index; }
 
 enum ActorType
 {
@@ -50,9 +70,10 @@ struct ActorParams
 	ActorId				m_Id;
 	ActorType			m_Type;
 	Mat4x4				m_Mat;
+	int					m_Health;
 
 
-	ActorParams(){ m_Mat=Mat4x4::g_Identity; m_Type=AT_UNKNOWN; m_Size=sizeof(ActorParams);}
+	ActorParams(){ m_Mat=Mat4x4::g_Identity; m_Type=AT_UNKNOWN; m_Health=100; m_Size=sizeof(ActorParams);}
 
 	int GetSize() { return m_Size; }
 	virtual bool VInit(std::istrstream &in){ return true; }
@@ -71,28 +92,11 @@ public:
 	virtual ~IBuff() {};
 	virtual void VApply()=0;
 	virtual void VRemove()=0;
-	virtual bool VOnUpdate(int deltaMS)=0;
+	virtual int VGetDuration()=0;
 	virtual BuffType VGetType()=0;
 	virtual ActorId VGetActorId()=0;
 };
 
-typedef std::list<shared_ptr<IBuff> > BuffList;
-
-class IActor
-{
-public:
-	virtual ~IActor() { };
-	virtual void VSetParams(shared_ptr<ActorParams> p)=0;
-	virtual Mat4x4 const &VGetMat()=0;
-	virtual void VSetMat(const Mat4x4 &m)=0;
-	virtual void VOnUpdate(int deltaMS)=0;
-	virtual shared_ptr<ActorParams> VGet()=0;
-	virtual void VSetId(ActorId id)=0;
-	virtual void VApplyBuff(shared_ptr<IBuff> buff)=0;
-};
-
-typedef std::map<ActorId, shared_ptr<IActor> > ActorMap;
-
 class IScreenElement
 {
 public:
@@ -128,6 +132,7 @@ public:
 	virtual void VRemoveActor(ActorId id)=0;
 	virtual void VGameStatusChange(GameStatus status)=0;
 	virtual void VMoveActor(ActorId id, Mat4x4 const &m)=0;
+	virtual void VInterpolate(float alpha)=0;
 	virtual void VRenderText(CDXUTTextHelper &txtHelper)=0;
 };
 
@@ -138,7 +143,7 @@ class IGame
 public:
 	virtual ~IGame() {};
 	virtual void OnUpdate(int deltaMS)=0;
-	virtual void VAddActor(shared_ptr<IActor> actor)=0;
+	virtual ActorId VAddActor(shared_ptr<ActorParams> p)=0;
 	virtual void VRemoveActor(ActorId id)=0;
 	virtual void VMoveActor(ActorId id, const Mat4x4 &m)=0;
 	virtual void VAddView(shared_ptr<IGameView> view)=0;
@@ -190,6 +195,7 @@ protected:
 public:
 	virtual const SceneNodeProperties * const VGet() const =0;
 	virtual void VSetTransform(const Mat4x4 *toWorld, const Mat4x4 *fromWorld=NULL)=0;
+	virtual void VSetRenderTransform(const Mat4x4 *renderToWorld)=0;
 	virtual HRESULT VOnUpdate(Scene *, DWORD const elapsed)=0;
 	virtual HRESULT VOnRestore(Scene *pScene)=0;
 
@@ -241,7 +247,16 @@ public:
 	virtual bool HandleEvent(Event const & e)=0;
 };
 
+// Listener that takes all the queued events of a type from a tick at once.
+// Triggered events come one at a time as a batch of one.
+class IEventBatchListener : public IEventListener
+{
+public:
+	virtual bool HandleEvents(Event const * const * events, unsigned int count)=0;
+};
+
 typedef shared_ptr<IEventListener> EventListenerPtr;
+typedef shared_ptr<IEventBatchListener> EventBatchListenerPtr;
 typedef std::list<EventListenerPtr> EventListenerList;
 typedef shared_ptr<Event> EventPtr;
 
@@ -253,22 +268,34 @@ public:
 
 	static IEventManager * Get();
 	virtual bool addListener(EventListenerPtr const & listener, EventType const & type)=0;
+	virtual bool addBatchListener(EventBatchListenerPtr const & listener, EventType const & type)=0;
 	virtual bool triggerEvent(Event const & event)=0;
 	virtual bool queueEvent(EventPtr const & event)=0;
+	virtual bool threadSafeQueueEvent(EventPtr const & event)=0;
 	virtual bool tick(unsigned int maxMS)=0;
 	virtual bool validateType(EventType const & type)=0;
+	virtual void beginDerived()=0;
+	virtual void endDerived()=0;
 
 	friend bool safeAddListener(EventListenerPtr const & listener, EventType const & type);
+	friend bool safeAddBatchListener(EventBatchListenerPtr const & listener, EventType const & type);
 	friend bool safeTriggerEvent(Event const & event);
 	friend bool safeQueueEvent(EventPtr const & event);
+	friend bool safeThreadSafeQueueEvent(EventPtr const & event);
 	friend bool safeTick(unsigned int maxMS);
 	friend bool safeValidateType(EventType const & type);
+	friend void safeBeginDerived();
+	friend void safeEndDerived();
 };
 
 	bool safeAddListener(EventListenerPtr const & listener, EventType const & type);
+	bool safeAddBatchListener(EventBatchListenerPtr const & listener, EventType const & type);
 	bool safeTriggerEvent(Event const & event);
 	bool safeQueueEvent(EventPtr const & event);
+	bool safeThreadSafeQueueEvent(EventPtr const & event);
 	bool safeTick(unsigned int maxMS);
 	bool safeValidateType(EventType const & type);
+	void safeBeginDerived();
+	void safeEndDerived();
 
 	static IEventManager* g_EventManager = NULL;
\ No newline at end of file
@@ -0,0 +1,200 @@
+//========================================================================
+// LZBlock.cpp : Small, fast LZ compression for independent blocks of data.
+//
+// Sequence layout:
+//   token        high nibble literal count, low nibble match length - 4.
+//                15 means more length bytes follow, each adding up to 255.
+//   literals
+//   offset       2 bytes, little endian, back from the current position.
+//                The last sequence of a block has literals only.
+//========================================================================
+
+#include <string.h>
+
+#include "LZBlock.h"
+
+enum
+{
+	MIN_MATCH = 4,
+	MAX_OFFSET = 65535,
+	HASH_BITS = 14,
+	LAST_LITERALS = 5			// the end of a block is always literals
+};
+
+static inline unsigned int Read32(const unsigned char *p)
+{
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline unsigned int Hash4(const unsigned char *p)
+{
+	return (Read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline unsigned char *WriteLength(unsigned char *op, int len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (unsigned char)len;
+	return op;
+}
+
+int LZBlockBound(int srcLen)
+{
+	return srcLen + srcLen / 255 + 16;
+}
+
+int LZBlockCompress(const char *src, int srcLen, char *dst, int dstCapacity)
+{
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *start = ip;
+	const unsigned char *end = ip + srcLen;
+	const unsigned char *matchLimit = end - LAST_LITERALS;
+	const unsigned char *anchor = ip;
+	unsigned char *op = (unsigned char *)dst;
+	unsigned char *opEnd = op + dstCapacity;
+
+	// Positions of the last time each hashed 4 bytes were seen, +1 so 0 is empty.
+	static const int TABLE_SIZE = 1 << HASH_BITS;
+	int table[TABLE_SIZE];
+	memset(table, 0, sizeof(table));
+
+	if (srcLen > LAST_LITERALS + MIN_MATCH)
+	{
+		while (ip < matchLimit - MIN_MATCH)
+		{
+			unsigned int h = Hash4(ip);
+			int candidate = table[h] - 1;
+			table[h] = (int)(ip - start) + 1;
+
+			const unsigned char *ref = start + candidate;
+			if (candidate < 0 || ip - ref > MAX_OFFSET || Read32(ref) != Read32(ip))
+			{
+				ip++;
+				continue;
+			}
+
+			// Extend the match, stopping short of the literal-only end.
+			const unsigned char *mp = ip + MIN_MATCH;
+			const unsigned char *rp = ref + MIN_MATCH;
+			while (mp < matchLimit && *mp == *rp)
+			{
+				mp++;
+				rp++;
+			}
+
+			int litLen = (int)(ip - anchor);
+			int matchLen = (int)(mp - ip) - MIN_MATCH;
+
+			// Token, lengths, literals and offset, with room for the worst case.
+			if (op + 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1 > opEnd)
+				return 0;
+
+			unsigned char *token = op++;
+			*token = (unsigned char)(((litLen < 15 ? litLen : 15) << 4) | (matchLen < 15 ? matchLen : 15));
+			if (litLen >= 15)
+				op = WriteLength(op, litLen - 15);
+			memcpy(op, anchor, litLen);
+			op += litLen;
+
+			unsigned int offset = (unsigned int)(ip - ref);
+			*op++ = (unsigned char)(offset & 0xff);
+			*op++ = (unsigned char)(offset >> 8);
+
+			if (matchLen >= 15)
+				op = WriteLength(op, matchLen - 15);
+
+			ip = mp;
+			anchor = ip;
+		}
+	}
+
+	// The rest goes out as literals.
+	int litLen = (int)(end - anchor);
+	if (op + 1 + litLen / 255 + 1 + litLen > opEnd)
+		return 0;
+
+	unsigned char *token = op++;
+	*token = (unsigned char)((litLen < 15 ? litLen : 15) << 4);
+	if (litLen >= 15)
+		op = WriteLength(op, litLen - 15);
+	memcpy(op, anchor, litLen);
+	op += litLen;
+
+	return (int)(op - (unsigned char *)dst);
+}
+
+static inline bool ReadLength(const unsigned char *&ip, const unsigned char *ipEnd, int &len)
+{
+	unsigned int s;
+	do
+	{
+		if (ip >= ipEnd)
+			return false;
+		s = *ip++;
+		len += s;
+	}
+	while (s == 255);
+	return true;
+}
+
+bool LZBlockDecompress(const char *src, int srcLen, char *dst, int dstLen)
+{
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *ipEnd = ip + srcLen;
+	unsigned char *op = (unsigned char *)dst;
+	unsigned char *opStart = op;
+	unsigned char *opEnd = op + dstLen;
+
+	while (ip < ipEnd)
+	{
+		unsigned int token = *ip++;
+
+		int litLen = token >> 4;
+		if (litLen == 15 && !ReadLength(ip, ipEnd, litLen))
+			return false;
+
+		if (litLen > ipEnd - ip || litLen > opEnd - op)
+			return false;
+		memcpy(op, ip, litLen);
+		ip += litLen;
+		op += litLen;
+
+		// Literal-only sequence, the end of the block.
+		if (ip == ipEnd)
+			break;
+
+		if (ipEnd - ip < 2)
+			return false;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		int matchLen = token & 15;
+		if (matchLen == 15 && !ReadLength(ip, ipEnd, matchLen))
+			return false;
+		matchLen += MIN_MATCH;
+
+		if (offset == 0 || offset > op - opStart || matchLen > opEnd - op)
+			return false;
+
+		// Byte by byte, since the copy may overlap what it's writing.
+		const unsigned char *ref = op - offset;
+		if (offset >= matchLen)
+		{
+			memcpy(op, ref, matchLen);
+			op += matchLen;
+		}
+		else
+		{
+			for (int i = 0; i < matchLen; i++)
+				*op++ = *ref++;
+		}
+	}
+
+	return op == opEnd;
+}
@@ -0,0 +1,22 @@
+#pragma once
+//========================================================================
+// LZBlock.h : Small, fast LZ compression for independent blocks of data.
+//
+// Made for decode speed rather than ratio: a block is a run of sequences,
+// each some literal bytes followed by a copy from earlier in the same
+// block. There's no entropy coding and no state between blocks, so any
+// block can be decoded on its own, on any thread.
+//
+// Doesn't need anything from the engine so the pack tools can use it too.
+//========================================================================
+
+// Worst case compressed size, for sizing the output buffer.
+int LZBlockBound(int srcLen);
+
+// Returns the compressed size, or 0 if it didn't fit in dstCapacity (the
+// data is probably incompressible, store it as it is).
+int LZBlockCompress(const char *src, int srcLen, char *dst, int dstCapacity);
+
+// Decodes a block that must come out to exactly dstLen bytes. Never reads or
+// writes outside the buffers, and returns false on corrupt data.
+bool LZBlockDecompress(const char *src, int srcLen, char *dst, int dstLen);
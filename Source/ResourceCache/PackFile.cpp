@@ -0,0 +1,333 @@
+// --------------------------------------------------------------------------
+// File:        PackFile.cpp
+//
+// Purpose:     Reader for the native resource pack. See PackFormat.h for the
+//              layout and ZipPack -pak for the tool that writes it.
+// --------------------------------------------------------------------------
+#include "StdHeader.h"
+
+#include "PackFile.h"
+#include "LZBlock.h"
+#include "ResWorkers.h"
+
+// --------------------------------------------------------------------------
+// Function:      CPackFile
+// Purpose:       Set up a closed pack
+// --------------------------------------------------------------------------
+CPackFile::CPackFile()
+{
+  m_hFile = NULL;
+  m_hMapping = NULL;
+  m_pMapped = NULL;
+  m_fileSize = 0;
+  m_pToc = NULL;
+  m_pHeader = NULL;
+  m_pSlots = NULL;
+  m_pEntries = NULL;
+  m_pBlocks = NULL;
+  m_pNames = NULL;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Init
+// Purpose:       Open the pack and find the table of contents in it
+// Parameters:    The pack file name
+// --------------------------------------------------------------------------
+bool CPackFile::Init(const _TCHAR *resFileName)
+{
+  End();
+
+  m_hFile = CreateFileW(resFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+  if (m_hFile == INVALID_HANDLE_VALUE)
+  {
+    m_hFile = NULL;
+    return false;
+  }
+
+  m_fileSize = GetFileSize(m_hFile, NULL);
+
+  m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (m_hMapping)
+    m_pMapped = (const char *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+
+  TPackHeader header;
+  if (!ReadAt(0, &header, sizeof(header)) ||
+      header.sig != TPackHeader::SIGNATURE || header.version != TPackHeader::VERSION ||
+      header.blockSize == 0 || header.numSlots == 0 || (header.numSlots & (header.numSlots - 1)) != 0 ||
+      header.numSlots > 0x1000000 || header.numEntries > header.numSlots ||
+      header.numBlocks > 0x1000000 || header.namesSize > m_fileSize)
+  {
+    End();
+    return false;
+  }
+
+  unsigned long tocSize = sizeof(TPackHeader) + header.numSlots * sizeof(unsigned long) +
+    header.numEntries * sizeof(TPackEntry) + header.numBlocks * sizeof(TPackBlock) + header.namesSize;
+  if (tocSize > header.dataOffset || header.dataOffset > m_fileSize)
+  {
+    End();
+    return false;
+  }
+
+  const char *pToc = m_pMapped;
+  if (!pToc)
+  {
+    m_pToc = SAFE_NEW char[tocSize];
+    if (!ReadAt(0, m_pToc, tocSize))
+    {
+      End();
+      return false;
+    }
+    pToc = m_pToc;
+  }
+
+  m_pHeader = (const TPackHeader *)pToc;
+  m_pSlots = (const unsigned long *)(m_pHeader + 1);
+  m_pEntries = (const TPackEntry *)(m_pSlots + header.numSlots);
+  m_pBlocks = (const TPackBlock *)(m_pEntries + header.numEntries);
+  m_pNames = (const char *)(m_pBlocks + header.numBlocks);
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Function:      End
+// Purpose:       Close the pack
+// --------------------------------------------------------------------------
+void CPackFile::End()
+{
+  SAFE_DELETE_ARRAY(m_pToc);
+  m_pHeader = NULL;
+  m_pSlots = NULL;
+  m_pEntries = NULL;
+  m_pBlocks = NULL;
+  m_pNames = NULL;
+
+  if (m_pMapped)
+    UnmapViewOfFile(m_pMapped);
+  if (m_hMapping)
+    CloseHandle(m_hMapping);
+  if (m_hFile)
+    CloseHandle(m_hFile);
+
+  m_pMapped = NULL;
+  m_hMapping = NULL;
+  m_hFile = NULL;
+  m_fileSize = 0;
+}
+
+// --------------------------------------------------------------------------
+// Function:      ReadAt
+// Purpose:       Copy part of the pack into a buffer, from any thread
+// Parameters:    The offset in the file, the buffer and the number of bytes
+// --------------------------------------------------------------------------
+bool CPackFile::ReadAt(unsigned long offset, void *pBuf, unsigned long size) const
+{
+  if (offset > m_fileSize || size > m_fileSize - offset)
+    return false;
+
+  if (m_pMapped)
+  {
+    memcpy(pBuf, m_pMapped + offset, size);
+    return true;
+  }
+
+  if (size == 0)
+    return true;
+
+  OVERLAPPED overlapped;
+  memset(&overlapped, 0, sizeof(overlapped));
+  overlapped.Offset = offset;
+
+  DWORD bytesRead = 0;
+  return ::ReadFile(m_hFile, pBuf, size, &bytesRead, &overlapped) && bytesRead == size;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Find
+// Purpose:       Find a file by name, ignoring case and slash direction
+// Parameters:    The name, and its length if it isn't NUL terminated.
+//                Returns the file index or -1.
+// --------------------------------------------------------------------------
+int CPackFile::Find(const char *path) const
+{
+  if (path == NULL)
+    return -1;
+  return Find(path, (int)strlen(path));
+}
+
+int CPackFile::Find(const char *path, int len) const
+{
+  if (path == NULL || m_pHeader == NULL)
+    return -1;
+
+  unsigned long hash = PackHashName(path, len);
+  unsigned long mask = m_pHeader->numSlots - 1;
+  unsigned long slot = hash & mask;
+
+  // The table is never full, so there's always an empty slot to stop at.
+  for (unsigned long probes = 0; probes < m_pHeader->numSlots; probes++)
+  {
+    unsigned long i = m_pSlots[slot];
+    if (i == PACK_EMPTY_SLOT || i >= m_pHeader->numEntries)
+      return -1;
+
+    const TPackEntry &entry = m_pEntries[i];
+    if (entry.nameHash == hash && entry.nameLen == len &&
+        entry.nameOffset <= m_pHeader->namesSize && (unsigned long)len <= m_pHeader->namesSize - entry.nameOffset)
+    {
+      const char *pName = m_pNames + entry.nameOffset;
+      int c = 0;
+      while (c < len && pName[c] == PackFoldChar(path[c]))
+        c++;
+      if (c == len)
+        return (int)i;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return -1;
+}
+
+// --------------------------------------------------------------------------
+// Function:      GetFileLen
+// Purpose:       Return the length of a file so a buffer can be allocated
+// Parameters:    The file index.
+// --------------------------------------------------------------------------
+int CPackFile::GetFileLen(int i) const
+{
+  if (i < 0 || i >= GetNumFiles())
+    return -1;
+  return m_pEntries[i].size;
+}
+
+// --------------------------------------------------------------------------
+// Function:      IsValidEntry
+// Purpose:       Check an entry's blocks are all inside the file
+// Parameters:    The file index.
+// --------------------------------------------------------------------------
+bool CPackFile::IsValidEntry(int i) const
+{
+  if (i < 0 || i >= GetNumFiles())
+    return false;
+
+  const TPackEntry &entry = m_pEntries[i];
+  if (entry.firstBlock > m_pHeader->numBlocks || entry.numBlocks > m_pHeader->numBlocks - entry.firstBlock)
+    return false;
+
+  unsigned long blockSize = m_pHeader->blockSize;
+  if (entry.numBlocks != (entry.size + blockSize - 1) / blockSize)
+    return false;
+
+  for (unsigned long b = 0; b < entry.numBlocks; b++)
+  {
+    const TPackBlock &block = m_pBlocks[entry.firstBlock + b];
+    unsigned long size = block.compressedSize & ~TPackBlock::STORED;
+    if (block.offset > m_fileSize || size > m_fileSize - block.offset)
+      return false;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Function:      DecodeBlock
+// Purpose:       Decode one block of an entry into its place in the buffer
+// Parameters:    The entry, the block number in it and the whole file buffer
+// --------------------------------------------------------------------------
+bool CPackFile::DecodeBlock(const TPackEntry &entry, unsigned long b, char *pBuf) const
+{
+  const TPackBlock &block = m_pBlocks[entry.firstBlock + b];
+  unsigned long start = b * m_pHeader->blockSize;
+  unsigned long len = entry.size - start;
+  if (len > m_pHeader->blockSize)
+    len = m_pHeader->blockSize;
+
+  unsigned long compressedSize = block.compressedSize & ~TPackBlock::STORED;
+
+  if (block.compressedSize & TPackBlock::STORED)
+    return compressedSize == len && ReadAt(block.offset, pBuf + start, len);
+
+  if (m_pMapped)
+    return LZBlockDecompress(m_pMapped + block.offset, compressedSize, pBuf + start, len);
+
+  char *pcData = SAFE_NEW char[compressedSize];
+  bool ok = ReadAt(block.offset, pcData, compressedSize) &&
+            LZBlockDecompress(pcData, compressedSize, pBuf + start, len);
+  delete [] pcData;
+  return ok;
+}
+
+struct TPackDecodeBatch
+{
+  const CPackFile *pPack;
+  const TPackEntry *pEntry;
+  char *pBuf;
+  volatile LONG failed;
+};
+
+void CPackFile::DecodeBlockProc(void *pContext, int b)
+{
+  TPackDecodeBatch *pBatch = (TPackDecodeBatch *)pContext;
+  if (!pBatch->pPack->DecodeBlock(*pBatch->pEntry, b, pBatch->pBuf))
+    InterlockedExchange(&pBatch->failed, 1);
+}
+
+// --------------------------------------------------------------------------
+// Function:      ReadFile
+// Purpose:       Decode a complete file. The blocks are spread over the
+//                job system's threads, see ResParallelFor.
+// Parameters:    The file index, the pre-allocated buffer and the number of
+//                threads (1 to stay on this one, anything else uses the
+//                job system's)
+// --------------------------------------------------------------------------
+bool CPackFile::ReadFile(int i, char *pBuf, int numThreads)
+{
+  if (pBuf == NULL || !IsValidEntry(i))
+    return false;
+
+  const TPackEntry &entry = m_pEntries[i];
+
+  if (entry.numBlocks == 1 || numThreads == 1)
+  {
+    for (unsigned long b = 0; b < entry.numBlocks; b++)
+      if (!DecodeBlock(entry, b, pBuf))
+        return false;
+    return true;
+  }
+
+  TPackDecodeBatch batch;
+  batch.pPack = this;
+  batch.pEntry = &entry;
+  batch.pBuf = pBuf;
+  batch.failed = 0;
+
+  ResParallelFor(entry.numBlocks, numThreads, DecodeBlockProc, &batch);
+
+  return batch.failed == 0;
+}
+
+// --------------------------------------------------------------------------
+// Function:      GetView
+// Purpose:       Point straight into the mapped pack for a stored file
+// Parameters:    The file index. Returns NULL if the file is compressed or
+//                the pack couldn't be mapped, use ReadFile then.
+// --------------------------------------------------------------------------
+const char *CPackFile::GetView(int i) const
+{
+  if (!m_pMapped || !IsValidEntry(i))
+    return NULL;
+
+  const TPackEntry &entry = m_pEntries[i];
+  if (!(entry.flags & TPackEntry::STORED) || entry.numBlocks == 0)
+    return NULL;
+
+  // Stored blocks are written one after the other, check that they were.
+  const TPackBlock *pBlocks = m_pBlocks + entry.firstBlock;
+  for (unsigned long b = 0; b < entry.numBlocks; b++)
+  {
+    if (!(pBlocks[b].compressedSize & TPackBlock::STORED) ||
+        pBlocks[b].offset != pBlocks[0].offset + b * m_pHeader->blockSize)
+      return NULL;
+  }
+
+  return m_pMapped + pBlocks[0].offset;
+}
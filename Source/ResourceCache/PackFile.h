@@ -0,0 +1,46 @@
+#pragma once
+//========================================================================
+// PackFile.h : Reader for the native resource pack (.pak)
+//
+// The pack is mapped like CZipFile maps a zip, with positional reads when
+// it can't be. The table of contents is used as it is in the file, and
+// entries made of several blocks are decoded on several threads.
+//========================================================================
+
+#include "PackFormat.h"
+
+class CPackFile
+{
+  public:
+    CPackFile();
+    virtual ~CPackFile() { End(); }
+
+    bool Init(const _TCHAR *resFileName);
+    void End();
+
+    int GetNumFiles() const { return m_pHeader ? (int)m_pHeader->numEntries : 0; }
+    int GetFileLen(int i) const;
+    bool ReadFile(int i, char *pBuf, int numThreads = 0);
+    const char *GetView(int i) const;
+    int Find(const char *path) const;
+    int Find(const char *path, int len) const;
+
+  private:
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+    const char *m_pMapped;
+    unsigned long m_fileSize;
+
+    char *m_pToc;				// Table of contents, when it couldn't be mapped
+    const TPackHeader *m_pHeader;
+    const unsigned long *m_pSlots;
+    const TPackEntry *m_pEntries;
+    const TPackBlock *m_pBlocks;
+    const char *m_pNames;
+
+    bool ReadAt(unsigned long offset, void *pBuf, unsigned long size) const;
+    bool IsValidEntry(int i) const;
+    bool DecodeBlock(const TPackEntry &entry, unsigned long b, char *pBuf) const;
+
+    static void DecodeBlockProc(void *pContext, int b);
+};
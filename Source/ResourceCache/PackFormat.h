@@ -0,0 +1,88 @@
+#pragma once
+//========================================================================
+// PackFormat.h : Layout of the native resource pack (.pak).
+//
+// [TPackHeader]
+// [hash table]     numSlots entry indices, PACK_EMPTY_SLOT if unused
+// [TPackEntry]     numEntries
+// [TPackBlock]     numBlocks
+// [names]          folded, not NUL terminated
+// [block data]
+//
+// Everything up to the block data is the table of contents, which is used
+// as it is read, without building anything. Each entry's data is split
+// into blockSize pieces, each compressed on its own with LZBlock, so the
+// blocks of one entry can be decoded in parallel.
+//
+// Doesn't need anything from the engine so the pack tools can use it too.
+//========================================================================
+
+#pragma pack(1)
+
+struct TPackHeader
+{
+  enum
+  {
+    SIGNATURE = 0x4b415051,		// "QPAK"
+    VERSION = 1
+  };
+  unsigned long   sig;
+  unsigned long   version;
+  unsigned long   blockSize;	// Uncompressed size of every block but an entry's last
+  unsigned long   numSlots;		// Hash table size, a power of two
+  unsigned long   numEntries;
+  unsigned long   numBlocks;
+  unsigned long   namesSize;
+  unsigned long   dataOffset;	// Where the block data starts
+};
+
+struct TPackEntry
+{
+  enum
+  {
+    STORED = 1					// Every block is stored, the data can be used in place
+  };
+  unsigned long   nameHash;
+  unsigned long   nameOffset;
+  unsigned short  nameLen;
+  unsigned short  flags;
+  unsigned long   size;
+  unsigned long   firstBlock;
+  unsigned long   numBlocks;
+};
+
+struct TPackBlock
+{
+  enum
+  {
+    STORED = 0x80000000			// Set in compressedSize if the block isn't compressed
+  };
+  unsigned long   offset;		// From the start of the file
+  unsigned long   compressedSize;
+};
+
+#pragma pack()
+
+#define PACK_EMPTY_SLOT 0xffffffff
+
+// Names are found without regard to case or which slashes they use.
+inline char PackFoldChar(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 'a';
+  if (c == '/')
+    return '\\';
+  return c;
+}
+
+// FNV-1a over the folded name.
+inline unsigned long PackHashName(const char *name, int len)
+{
+  unsigned long hash = 2166136261u;
+  for (int i = 0; i < len; i++)
+  {
+    hash ^= (unsigned char)PackFoldChar(name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
@@ -37,11 +37,14 @@
 
 #include "StdHeader.h"
 #include <assert.h>
+#include <limits.h>
 #include <list>
 #include <map>
+#include <process.h>
 
 #include "ResCache2.h"
 #include "ZipFile.h"
+#include "PackFile.h"
 
 #pragma comment(lib, "zlib.lib")
 
@@ -63,7 +66,7 @@ bool ResourceZipFile::VOpen()
 int ResourceZipFile::VGetResourceSize(const Resource &r)
 {
 	int size = 0;
-	int resourceNum = m_pZipFile->Find(r.m_name.c_str());
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
 	if (resourceNum>=0)
 	{
 		size = m_pZipFile->GetFileLen(resourceNum);
@@ -74,7 +77,7 @@ int ResourceZipFile::VGetResourceSize(const Resource &r)
 int ResourceZipFile::VGetResource(const Resource &r, char *buffer)
 {
 	int size = 0;
-	int resourceNum = m_pZipFile->Find(r.m_name.c_str());
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
 	if (resourceNum>=0)
 	{
 		size = m_pZipFile->GetFileLen(resourceNum);
@@ -83,47 +86,199 @@ int ResourceZipFile::VGetResource(const Resource &r, char *buffer)
 	return 0;	
 }
 
+int ResourceZipFile::VGetRawResourceSize(const Resource &r)
+{
+	int size = 0;
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		size = m_pZipFile->GetCompressedLen(resourceNum);
+	}
+	return size;
+}
+
+bool ResourceZipFile::VGetRawResource(const Resource &r, char *rawBuffer)
+{
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		return m_pZipFile->ReadCompressed(resourceNum, rawBuffer);
+	}
+	return false;
+}
+
+bool ResourceZipFile::VDecodeRawResource(const Resource &r, const char *rawBuffer, char *buffer)
+{
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		return m_pZipFile->Inflate(resourceNum, rawBuffer, buffer);
+	}
+	return false;
+}
 
+const char *ResourceZipFile::VGetResourceView(const Resource &r)
+{
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		return m_pZipFile->GetView(resourceNum);
+	}
+	return NULL;
+}
 
-ResHandle::ResHandle(const Resource & resource, const char *buffer)
+bool ResourceZipFile::OpenStream(const Resource &r, CZipStream &stream)
+{
+	int resourceNum = m_pZipFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		return stream.Open(m_pZipFile, resourceNum);
+	}
+	return false;
+}
+
+
+ResourcePackFile::~ResourcePackFile()
+{
+	SAFE_DELETE(m_pPackFile);
+}
+
+bool ResourcePackFile::VOpen()
+{
+	m_pPackFile = SAFE_NEW CPackFile;
+	if (m_pPackFile)
+	{
+		return m_pPackFile->Init(m_resFileName.c_str());
+	}
+	return false;
+}
+
+int ResourcePackFile::VGetResourceSize(const Resource &r)
+{
+	int size = 0;
+	int resourceNum = m_pPackFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		size = m_pPackFile->GetFileLen(resourceNum);
+	}
+	return size;
+}
+
+int ResourcePackFile::VGetResource(const Resource &r, char *buffer)
+{
+	int resourceNum = m_pPackFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		m_pPackFile->ReadFile(resourceNum, buffer);
+	}
+	return 0;
+}
+
+const char *ResourcePackFile::VGetResourceView(const Resource &r)
+{
+	int resourceNum = m_pPackFile->Find(r.m_name.c_str(), (int)r.m_name.size());
+	if (resourceNum>=0)
+	{
+		return m_pPackFile->GetView(resourceNum);
+	}
+	return NULL;
+}
+
+
+ResHandle::ResHandle(const Resource & resource, const char *buffer, bool owned)
 : m_resource(resource)
 {
 	m_buffer = buffer;
+	m_owned = owned;
 }
 
 ResHandle::~ResHandle()
+{
+	if (m_buffer && m_owned) delete [] m_buffer;
+}
+
+CompressedResHandle::CompressedResHandle(const std::string &name, unsigned int size, const char *buffer)
+: m_name(name), m_size(size), m_buffer(buffer)
+{
+}
+
+CompressedResHandle::~CompressedResHandle()
 {
 	if (m_buffer) delete [] m_buffer;
 }
 
-ResCache::ResCache(const unsigned int sizeInMb, IResourceFile *resFile )
+ResCache::ResCache(const unsigned int sizeInMb, IResourceFile *resFile, const unsigned int compressedSizeInMb )
 {
 	m_cacheSize = sizeInMb * 1024 * 1024;				// total memory size
 	m_allocated = 0;									// total memory allocated
 	m_file = resFile;
+
+	m_compressedCacheSize = compressedSizeInMb * 1024 * 1024;
+	m_compressedAllocated = 0;
+
+	InitializeCriticalSection(&m_cs);
+
+	m_recording = false;
+	m_recordStart = 0;
+
+	m_prefetchThread = NULL;
+	m_stopPrefetch = 0;
+
+	m_loadThread = NULL;
+	m_loadWake = NULL;
+	m_stopLoads = 0;
+	m_loadingNow = NULL;
 }
 
 ResCache::~ResCache()
 {
+	StopPrefetch();
+	StopLoads();
+	DeleteCriticalSection(&m_cs);
+
 	while (!m_lru.empty())
 	{
 		FreeOneResource();
 	}
+	while (!m_compressedLru.empty())
+	{
+		FreeOneCompressed();
+	}
 	SAFE_DELETE(m_file);
 }
 
 
 int ResCache::Create(Resource &r)
 {
+	EnterCriticalSection(&m_cs);
 	r.m_size = m_file->VGetResourceSize(r);
+	LeaveCriticalSection(&m_cs);
 	return (r.m_size);
 }
 
 
 const void *ResCache::Get(const Resource & r )
 {
+	EnterCriticalSection(&m_cs);
+
+	const void *buffer;
 	ResHandle *handle = Find(r);
-	return (handle!=NULL) ? Update(handle) : Load(r);
+	if (handle!=NULL)
+	{
+		m_stats.OnHit(r.m_name);
+		buffer = Update(handle);
+	}
+	else
+	{
+		buffer = Load(r);
+		handle = Find(r);
+	}
+
+	if (m_recording && handle)
+		Record(r, handle->m_resource.m_size);
+
+	LeaveCriticalSection(&m_cs);
+	return buffer;
 }
 
 
@@ -138,6 +293,14 @@ const void * ResCache::Load(const Resource & r)
 	// length of the resource in bytes.
 
 	int size = m_file->VGetResourceSize(r);
+
+	// Stored resources in a mapped file are used in place, no copy and no cache memory.
+	const char *view = m_file->VGetResourceView(r);
+	if (view)
+	{
+		return LoadView(r, view, size);
+	}
+
 	char *buffer = Allocate(size);
 	if (buffer==NULL)
 	{
@@ -146,13 +309,126 @@ const void * ResCache::Load(const Resource & r)
 
 	memset(buffer,0,sizeof(buffer));
 	// Create a new resource and add it to the lru list and map
-	ResHandle *handle = SAFE_NEW ResHandle(r, buffer);
+	ResHandle *handle = Insert(r, buffer, size, true);
+
+	// A compressed copy only needs to be inflated, no file access.
+	CompressedResHandle *compressed = FindCompressed(r);
+	if (compressed)
+	{
+		ResTimer timer;
+		if (m_file->VDecodeRawResource(r, compressed->m_buffer, buffer))
+		{
+			m_stats.OnCompressedHit(r.m_name, size, timer.GetMicroseconds());
+			m_compressedLru.remove(compressed);
+			m_compressedLru.push_front(compressed);
+			return buffer;
+		}
+	}
+
+	// A failed read would leave a half filled buffer looking like the resource.
+	if (!LoadFromFile(r, buffer, size))
+	{
+		Free(handle);
+		return NULL;
+	}
+
+	return buffer;
+}
+
+// The view costs nothing until its pages are touched.
+const void *ResCache::LoadView(const Resource & r, const char *view, unsigned int size)
+{
+	Insert(r, view, size, false);
+	m_stats.OnMiss(r.m_name, size, 0, 0.0, 0.0);
+
+	return view;
+}
+
+// Adds a handle for the resource to the lru list and map.
+ResHandle *ResCache::Insert(const Resource & r, const char *buffer, unsigned int size, bool owned)
+{
+	ResHandle *handle = SAFE_NEW ResHandle(r, buffer, owned);
+	handle->m_resource.m_size = size;
 	m_lru.push_front(handle);
 	m_resources[r.m_name] = handle;
+	return handle;
+}
 
-	m_file->VGetResource(r, buffer);
+// Reads the resource from the file. If the second tier is enabled the raw bytes
+// are kept around after being inflated into the buffer.
+bool ResCache::LoadFromFile(const Resource & r, char *buffer, unsigned int size)
+{
+	unsigned int bytesRead = 0;
+	double ioMicros = 0.0;
+	double inflateMicros = 0.0;
+	char *raw = NULL;
+	unsigned int rawSize = 0;
 
-	return buffer;
+	bool ok = ReadFromFile(r, buffer, size, raw, rawSize, bytesRead, ioMicros, inflateMicros);
+	if (ok)
+		KeepCompressed(r, raw, rawSize);
+	else
+		delete [] raw;
+
+	m_stats.OnMiss(r.m_name, size, bytesRead, ioMicros, inflateMicros);
+
+	return ok;
+}
+
+// Reading the raw bytes and inflating them separately lets the two be timed apart.
+// Files without raw access, and stored resources, are timed as I/O only and
+// gain nothing from a compressed copy. Nothing in the cache is touched, so the
+// prefetch thread can call it without the lock. The raw bytes, if there were
+// any, are handed back for KeepCompressed.
+bool ResCache::ReadFromFile(const Resource & r, char *buffer, unsigned int size, char *&raw, unsigned int &rawSize, unsigned int &bytesRead, double &ioMicros, double &inflateMicros)
+{
+	raw = NULL;
+	rawSize = m_file->VGetRawResourceSize(r);
+
+	ResTimer timer;
+	if (rawSize==0 || rawSize>=size)
+	{
+		m_file->VGetResource(r, buffer);
+		ioMicros = timer.GetMicroseconds();
+		bytesRead = rawSize ? rawSize : size;
+		return true;
+	}
+
+	raw = SAFE_NEW char[rawSize];
+	if (!raw)
+		return false;
+
+	bool ok = m_file->VGetRawResource(r, raw);
+	ioMicros = timer.GetMicroseconds();
+	bytesRead = rawSize;
+
+	if (ok)
+	{
+		timer.Restart();
+		ok = m_file->VDecodeRawResource(r, raw, buffer);
+		inflateMicros = timer.GetMicroseconds();
+	}
+
+	return ok;
+}
+
+// Keeps the raw bytes as the compressed copy if the second tier has room,
+// otherwise they're thrown away.
+void ResCache::KeepCompressed(const Resource & r, char *raw, unsigned int rawSize)
+{
+	if (!raw)
+		return;
+
+	if (!m_compressedCacheSize || FindCompressed(r) || !MakeCompressedRoom(rawSize))
+	{
+		delete [] raw;
+		return;
+	}
+
+	CompressedResHandle *compressed = SAFE_NEW CompressedResHandle(r.m_name, rawSize, raw);
+	m_compressedLru.push_front(compressed);
+	m_compressed[r.m_name] = compressed;
+	m_compressedAllocated += rawSize;
 }
 
 
@@ -165,6 +441,15 @@ ResHandle *ResCache::Find(const Resource & r)
 	return (*i).second;
 }
 
+CompressedResHandle *ResCache::FindCompressed(const Resource & r)
+{
+	CompressedResHandleMap::iterator i = m_compressed.find(r.m_name);
+	if (i==m_compressed.end())
+		return NULL;
+
+	return (*i).second;
+}
+
 const void *ResCache::Update(ResHandle *handle)
 {
 	m_lru.remove(handle);
@@ -200,21 +485,47 @@ void ResCache::FreeOneResource()
 
 	m_lru.pop_back();							
 	m_resources.erase(handle->m_resource.m_name);
-	m_allocated -= handle->m_resource.m_size ;
+	if (handle->m_owned)
+		m_allocated -= handle->m_resource.m_size ;
+	m_stats.OnEviction(handle->m_resource.m_name);
+
+	// The compressed copy is now the only one left, keep it around the longest.
+	CompressedResHandle *compressed = FindCompressed(handle->m_resource);
+	if (compressed)
+	{
+		m_compressedLru.remove(compressed);
+		m_compressedLru.push_front(compressed);
+	}
+
 	delete handle;
 }
 
+void ResCache::FreeOneCompressed()
+{
+	CompressedResHandle *compressed = m_compressedLru.back();
+
+	m_compressedLru.pop_back();
+	m_compressed.erase(compressed->m_name);
+	m_compressedAllocated -= compressed->m_size;
+	delete compressed;
+}
+
 
 
 
 void ResCache::Flush()
 {
+	EnterCriticalSection(&m_cs);
 	while (!m_lru.empty())
 	{
 		ResHandle *handle = *(m_lru.begin());
 		Free(handle);
-		m_lru.pop_front();
 	}
+	while (!m_compressedLru.empty())
+	{
+		FreeOneCompressed();
+	}
+	LeaveCriticalSection(&m_cs);
 }
 
 
@@ -239,14 +550,431 @@ bool ResCache::MakeRoom(unsigned int size)
 	return true;
 }
 
+bool ResCache::MakeCompressedRoom(unsigned int size)
+{
+	if (size > m_compressedCacheSize)
+	{
+		return false;
+	}
+
+	while (size > (m_compressedCacheSize - m_compressedAllocated))
+	{
+		if (m_compressedLru.empty())
+			return false;
+
+		FreeOneCompressed();
+	}
+
+	return true;
+}
+
 
 
 void ResCache::Free(ResHandle *gonner)
 {
 	m_lru.remove(gonner);
 	m_resources.erase(gonner->m_resource.m_name);
-	m_allocated -= gonner->m_resource.m_size;
+	if (gonner->m_owned)
+		m_allocated -= gonner->m_resource.m_size;
 	delete gonner;
 }
 
+// Fraction of Get calls that found the resource already decompressed.
+float ResCache::GetResidentHitRate() const
+{
+	const ResStatCounters &total = m_stats.GetTotal();
+	return total.GetRequests() ? (float)total.m_hits / total.GetRequests() : 0.0f;
+}
+
+// Fraction of Get calls that were served by inflating a compressed copy.
+float ResCache::GetCompressedHitRate() const
+{
+	const ResStatCounters &total = m_stats.GetTotal();
+	return total.GetRequests() ? (float)total.m_compressedHits / total.GetRequests() : 0.0f;
+}
+
+// Copy of the statistics, safe to read while the prefetch thread runs.
+ResCacheStats ResCache::GetStats()
+{
+	EnterCriticalSection(&m_cs);
+	ResCacheStats stats = m_stats;
+	LeaveCriticalSection(&m_cs);
+	return stats;
+}
+
+void ResCache::ResetStats()
+{
+	EnterCriticalSection(&m_cs);
+	m_stats.Reset();
+	LeaveCriticalSection(&m_cs);
+}
+
+// The cache sizes and all the statistics as a json object.
+std::string ResCache::GetStatsJson()
+{
+	EnterCriticalSection(&m_cs);
+
+	char buf[256];
+	sprintf(buf, "{\n  \"cache\": {\"size\": %u, \"allocated\": %u, \"resources\": %u, "
+		"\"compressedSize\": %u, \"compressedAllocated\": %u, \"compressedResources\": %u},\n",
+		m_cacheSize, m_allocated, (unsigned int)m_resources.size(),
+		m_compressedCacheSize, m_compressedAllocated, (unsigned int)m_compressed.size());
+
+	std::string json = buf;
+	m_stats.AppendJson(json);
+	json += "\n}\n";
+
+	LeaveCriticalSection(&m_cs);
+	return json;
+}
+
+bool ResCache::DumpStats(const _TCHAR *fileName)
+{
+	FILE *file = _wfopen(fileName, _T("wt"));
+	if (!file)
+		return false;
+
+	std::string json = GetStatsJson();
+	fwrite(json.c_str(), json.size(), 1, file);
+	fclose(file);
+	return true;
+}
+
+
+
+// Starts recording the order resources are first asked for.
+void ResCache::StartRecording()
+{
+	EnterCriticalSection(&m_cs);
+	m_trace.clear();
+	m_traced.clear();
+	m_recordStart = timeGetTime();
+	m_recording = true;
+	LeaveCriticalSection(&m_cs);
+}
+
+void ResCache::Record(const Resource & r, unsigned int size)
+{
+	if (!m_traced.insert(r.m_name).second)
+		return;
+
+	ResAccessRecord record;
+	record.m_name = r.m_name;
+	record.m_size = size;
+	record.m_time = timeGetTime() - m_recordStart;
+	m_trace.push_back(record);
+}
+
+// Stops recording and writes the trace out as a manifest, one "time size name" per line.
+bool ResCache::StopRecording(const _TCHAR *manifestFile)
+{
+	EnterCriticalSection(&m_cs);
+	m_recording = false;
+	ResAccessTrace trace;
+	trace.swap(m_trace);
+	m_traced.clear();
+	LeaveCriticalSection(&m_cs);
+
+	FILE *file = _wfopen(manifestFile, _T("wt"));
+	if (!file)
+		return false;
+
+	fprintf(file, "# resource manifest: time(ms) size name\n");
+	for (ResAccessTrace::iterator it = trace.begin(); it != trace.end(); it++)
+	{
+		fprintf(file, "%u %u %s\n", (*it).m_time, (*it).m_size, (*it).m_name.c_str());
+	}
+
+	fclose(file);
+	return true;
+}
+
+// Reads a manifest written by StopRecording and loads its resources in the
+// background, in the order they were used last time.
+bool ResCache::Prefetch(const _TCHAR *manifestFile)
+{
+	StopPrefetch();
+
+	FILE *file = _wfopen(manifestFile, _T("rt"));
+	if (!file)
+		return false;
+
+	m_prefetchList.clear();
 
+	char line[_MAX_PATH + 64];
+	while (fgets(line, sizeof(line), file))
+	{
+		if (line[0] == '#')
+			continue;
+
+		ResAccessRecord record;
+		int nameStart = 0;
+		if (sscanf(line, "%u %u %n", &record.m_time, &record.m_size, &nameStart) < 2 || nameStart == 0)
+			continue;
+
+		char *name = line + nameStart;
+		name[strcspn(name, "\r\n")] = 0;
+		if (name[0] == 0)
+			continue;
+
+		record.m_name = name;
+		m_prefetchList.push_back(record);
+	}
+	fclose(file);
+
+	if (m_prefetchList.empty())
+		return false;
+
+	m_stopPrefetch = 0;
+	m_prefetchThread = (HANDLE)_beginthreadex(NULL, 0, PrefetchThreadProc, this, CREATE_SUSPENDED, NULL);
+	if (!m_prefetchThread)
+		return false;
+
+	SetThreadPriority(m_prefetchThread, THREAD_PRIORITY_BELOW_NORMAL);
+	ResumeThread(m_prefetchThread);
+	return true;
+}
+
+// Stops the prefetch thread and waits for it to finish the resource it's on.
+void ResCache::StopPrefetch()
+{
+	if (!m_prefetchThread)
+		return;
+
+	InterlockedExchange(&m_stopPrefetch, 1);
+	WaitForSingleObject(m_prefetchThread, INFINITE);
+	CloseHandle(m_prefetchThread);
+	m_prefetchThread = NULL;
+}
+
+unsigned int __stdcall ResCache::PrefetchThreadProc(void *pCache)
+{
+	((ResCache *)pCache)->PrefetchAll();
+	return 0;
+}
+
+// Only the checks and the bookkeeping hold the lock. The read and the
+// inflate go into a buffer of the thread's own, so the game's Gets, hits
+// included, never wait on them. The space is taken before letting go of the
+// lock, and given back if the game loaded the resource in the meantime.
+// The files read at a given offset and keep no state, so both threads can
+// read at once.
+void ResCache::PrefetchAll()
+{
+	for (ResAccessTrace::iterator it = m_prefetchList.begin(); it != m_prefetchList.end() && !m_stopPrefetch; it++)
+	{
+		Resource r((*it).m_name);
+
+		EnterCriticalSection(&m_cs);
+		if (Find(r) != NULL)
+		{
+			LeaveCriticalSection(&m_cs);
+			continue;
+		}
+
+		// Only use free space, never evict something the game may be holding.
+		int size = m_file->VGetResourceSize(r);
+		const char *view = size > 0 ? m_file->VGetResourceView(r) : NULL;
+		if (size <= 0 || (!view && (unsigned int)size > m_cacheSize - m_allocated))
+		{
+			LeaveCriticalSection(&m_cs);
+			continue;
+		}
+
+		// The compressed copy may be freed once the lock's let go, so it's copied.
+		char *raw = NULL;
+		if (!view)
+		{
+			m_allocated += size;
+
+			CompressedResHandle *compressed = FindCompressed(r);
+			if (compressed)
+			{
+				raw = SAFE_NEW char[compressed->m_size];
+				memcpy(raw, compressed->m_buffer, compressed->m_size);
+				m_compressedLru.remove(compressed);
+				m_compressedLru.push_front(compressed);
+			}
+		}
+		LeaveCriticalSection(&m_cs);
+
+		if (view)
+			PrefetchView(r, view, size);
+		else
+			PrefetchLoad(r, size, raw);
+	}
+}
+
+// Touches the view's pages so the game doesn't take the page faults later.
+void ResCache::PrefetchView(const Resource & r, const char *view, unsigned int size)
+{
+	ResTimer timer;
+	volatile char touch = 0;
+	for (unsigned int i = 0; i < size; i += 4096)
+		touch += view[i];
+	double ioMicros = timer.GetMicroseconds();
+
+	EnterCriticalSection(&m_cs);
+	if (Find(r) == NULL)
+	{
+		Insert(r, view, size, false);
+		m_stats.OnPrefetch(r.m_name, size, size, ioMicros, 0.0);
+	}
+	LeaveCriticalSection(&m_cs);
+}
+
+// The size is already counted in m_allocated. raw is a copy of the compressed
+// bytes to inflate instead of reading the file, and is deleted here.
+void ResCache::PrefetchLoad(const Resource & r, unsigned int size, char *raw)
+{
+	char *buffer = SAFE_NEW char[size];
+	char *keep = NULL;
+	unsigned int keepSize = 0;
+	unsigned int bytesRead = 0;
+	double ioMicros = 0.0;
+	double inflateMicros = 0.0;
+
+	bool ok = false;
+	if (raw)
+	{
+		ResTimer timer;
+		ok = m_file->VDecodeRawResource(r, raw, buffer);
+		inflateMicros = timer.GetMicroseconds();
+		delete [] raw;
+	}
+	if (!ok)
+		ok = ReadFromFile(r, buffer, size, keep, keepSize, bytesRead, ioMicros, inflateMicros);
+
+	EnterCriticalSection(&m_cs);
+	if (ok && Find(r) == NULL)
+	{
+		Insert(r, buffer, size, true);
+		KeepCompressed(r, keep, keepSize);
+		m_stats.OnPrefetch(r.m_name, size, bytesRead, ioMicros, inflateMicros);
+	}
+	else
+	{
+		m_allocated -= size;
+		delete [] buffer;
+		delete [] keep;
+	}
+	LeaveCriticalSection(&m_cs);
+}
+
+
+// The thread is started by the first request. If it can't be, the
+// resource is loaded there and then.
+void ResCache::LoadAsync(const std::string &name, volatile LONG *done)
+{
+	*done = 0;
+
+	EnterCriticalSection(&m_cs);
+	if (!m_loadThread)
+	{
+		m_stopLoads = 0;
+		m_loadWake = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+		if (m_loadWake)
+			m_loadThread = (HANDLE)_beginthreadex(NULL, 0, LoadThreadProc, this, 0, NULL);
+
+		if (!m_loadThread && m_loadWake)
+		{
+			CloseHandle(m_loadWake);
+			m_loadWake = NULL;
+		}
+	}
+
+	if (m_loadThread)
+	{
+		ResLoadRequest request;
+		request.m_name = name;
+		request.m_done = done;
+		m_loadQueue.push_back(request);
+		ReleaseSemaphore(m_loadWake, 1, NULL);
+		LeaveCriticalSection(&m_cs);
+		return;
+	}
+	LeaveCriticalSection(&m_cs);
+
+	Get(Resource(name));
+	*done = 1;
+}
+
+// The load thread only writes the flag under the lock, so once it's no
+// longer the one being loaded nothing will touch it.
+void ResCache::CancelLoad(volatile LONG *done)
+{
+	for (;;)
+	{
+		EnterCriticalSection(&m_cs);
+		for (ResLoadQueue::iterator it = m_loadQueue.begin(); it != m_loadQueue.end(); it++)
+		{
+			if ((*it).m_done == done)
+			{
+				m_loadQueue.erase(it);
+				break;
+			}
+		}
+		bool loading = m_loadingNow == done;
+		LeaveCriticalSection(&m_cs);
+
+		if (!loading)
+			return;
+		Sleep(1);
+	}
+}
+
+// Requests still waiting are dropped.
+void ResCache::StopLoads()
+{
+	if (!m_loadThread)
+		return;
+
+	InterlockedExchange(&m_stopLoads, 1);
+	ReleaseSemaphore(m_loadWake, 1, NULL);
+	WaitForSingleObject(m_loadThread, INFINITE);
+	CloseHandle(m_loadThread);
+	CloseHandle(m_loadWake);
+	m_loadThread = NULL;
+	m_loadWake = NULL;
+
+	EnterCriticalSection(&m_cs);
+	m_loadQueue.clear();
+	LeaveCriticalSection(&m_cs);
+}
+
+unsigned int __stdcall ResCache::LoadThreadProc(void *pCache)
+{
+	((ResCache *)pCache)->LoadAll();
+	return 0;
+}
+
+// Each request is a Get, the same as the game's own, and counts as a miss
+// or a hit the same way. A cancelled request leaves its count on the
+// semaphore, so the queue may be empty.
+void ResCache::LoadAll()
+{
+	for (;;)
+	{
+		WaitForSingleObject(m_loadWake, INFINITE);
+		if (m_stopLoads)
+			break;
+
+		EnterCriticalSection(&m_cs);
+		if (m_loadQueue.empty())
+		{
+			LeaveCriticalSection(&m_cs);
+			continue;
+		}
+		ResLoadRequest request = m_loadQueue.front();
+		m_loadQueue.pop_front();
+		m_loadingNow = request.m_done;
+		LeaveCriticalSection(&m_cs);
+
+		Get(Resource(request.m_name));
+
+		EnterCriticalSection(&m_cs);
+		*request.m_done = 1;
+		m_loadingNow = NULL;
+		LeaveCriticalSection(&m_cs);
+	}
+}
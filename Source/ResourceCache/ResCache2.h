@@ -37,6 +37,9 @@
 //========================================================================
 
 #include "StdHeader.h"
+#include <set>
+#include <vector>
+#include "ResCacheStats.h"
 
 // Note: this was renamed from struct Resource in the book.
 class Resource
@@ -50,6 +53,7 @@ public:
 
 
 class CZipFile;
+class CZipStream;
 
 class ResourceZipFile : public IResourceFile
 {
@@ -63,6 +67,33 @@ public:
 	virtual bool VOpen();
 	virtual int VGetResourceSize(const Resource &r);
 	virtual int VGetResource(const Resource &r, char *buffer);
+
+	virtual int VGetRawResourceSize(const Resource &r);
+	virtual bool VGetRawResource(const Resource &r, char *rawBuffer);
+	virtual bool VDecodeRawResource(const Resource &r, const char *rawBuffer, char *buffer);
+	virtual const char *VGetResourceView(const Resource &r);
+
+	// For resources too big to load whole, like music.
+	bool OpenStream(const Resource &r, CZipStream &stream);
+};
+
+
+class CPackFile;
+
+// The native pack format, see PackFormat.h. Decodes faster than a zip.
+class ResourcePackFile : public IResourceFile
+{
+	CPackFile *m_pPackFile;
+	std::wstring m_resFileName;
+
+public:
+	ResourcePackFile(const _TCHAR *resFileName) { m_pPackFile = NULL; m_resFileName=resFileName; }
+	virtual ~ResourcePackFile();
+
+	virtual bool VOpen();
+	virtual int VGetResourceSize(const Resource &r);
+	virtual int VGetResource(const Resource &r, char *buffer);
+	virtual const char *VGetResourceView(const Resource &r);
 };
 
 
@@ -73,9 +104,10 @@ class ResHandle
 protected:
 	Resource m_resource;
 	const char *m_buffer;						
+	bool m_owned;				// false if m_buffer points into the resource file
 
 public:
-	ResHandle(const Resource & resource, const char *buffer);
+	ResHandle(const Resource & resource, const char *buffer, bool owned = true);
 	virtual ~ResHandle();
 };
 
@@ -83,6 +115,46 @@ public:
 typedef std::list<ResHandle *> ResHandleList;			// lru list
 typedef std::map<std::string, ResHandle *> ResHandleMap;		// maps indentifiers to resource data
 
+
+// Compressed bytes of a resource, kept so a reload only has to inflate instead of
+// going back to the file.
+class CompressedResHandle
+{
+	friend class ResCache;
+
+protected:
+	std::string m_name;
+	unsigned int m_size;
+	const char *m_buffer;
+
+public:
+	CompressedResHandle(const std::string &name, unsigned int size, const char *buffer);
+	virtual ~CompressedResHandle();
+};
+
+typedef std::list<CompressedResHandle *> CompressedResHandleList;
+typedef std::map<std::string, CompressedResHandle *> CompressedResHandleMap;
+
+
+// One line of a prefetch manifest: a resource in the order it was first asked for.
+struct ResAccessRecord
+{
+	std::string m_name;
+	unsigned int m_size;
+	DWORD m_time;				// ms since recording started
+};
+
+typedef std::vector<ResAccessRecord> ResAccessTrace;
+
+// A load the game asked to have done in the background.
+struct ResLoadRequest
+{
+	std::string m_name;
+	volatile LONG *m_done;		// set to 1 once it's in
+};
+
+typedef std::list<ResLoadRequest> ResLoadQueue;
+
 class ResCache
 {
 	ResHandleList m_lru;								// lru list
@@ -92,6 +164,44 @@ class ResCache
 	unsigned int			m_cacheSize;			// total memory size
 	unsigned int			m_allocated;			// total memory allocated
 
+	// Second tier holding the compressed bytes of recently loaded resources.
+	CompressedResHandleList	m_compressedLru;
+	CompressedResHandleMap	m_compressed;
+	unsigned int			m_compressedCacheSize;
+	unsigned int			m_compressedAllocated;
+
+	ResCacheStats			m_stats;
+
+	// Everything above is shared with the prefetch thread.
+	CRITICAL_SECTION		m_cs;
+
+	// Access trace recording
+	bool					m_recording;
+	DWORD					m_recordStart;
+	ResAccessTrace			m_trace;
+	std::set<std::string>	m_traced;
+
+	// Manifest replay
+	HANDLE					m_prefetchThread;
+	volatile LONG			m_stopPrefetch;
+	ResAccessTrace			m_prefetchList;
+
+	static unsigned int __stdcall PrefetchThreadProc(void *pCache);
+	void PrefetchAll();
+	void PrefetchView(const Resource & r, const char *view, unsigned int size);
+	void PrefetchLoad(const Resource & r, unsigned int size, char *raw);
+	void Record(const Resource & r, unsigned int size);
+
+	// Background loads
+	HANDLE					m_loadThread;
+	HANDLE					m_loadWake;				// semaphore, a count for each request
+	volatile LONG			m_stopLoads;
+	ResLoadQueue			m_loadQueue;
+	volatile LONG			*m_loadingNow;			// done flag of the request being loaded
+
+	static unsigned int __stdcall LoadThreadProc(void *pCache);
+	void LoadAll();
+
 protected:
 
 	bool MakeRoom(unsigned int size);
@@ -99,13 +209,22 @@ protected:
 	void Free(ResHandle *gonner);
 
 	const void *Load(const Resource & r);
+	const void *LoadView(const Resource & r, const char *view, unsigned int size);
+	ResHandle *Insert(const Resource & r, const char *buffer, unsigned int size, bool owned);
 	ResHandle *Find(const Resource & r);
 	const void *Update(ResHandle *handle);
 
 	void FreeOneResource();
 
+	bool LoadFromFile(const Resource & r, char *buffer, unsigned int size);
+	bool ReadFromFile(const Resource & r, char *buffer, unsigned int size, char *&raw, unsigned int &rawSize, unsigned int &bytesRead, double &ioMicros, double &inflateMicros);
+	void KeepCompressed(const Resource & r, char *raw, unsigned int rawSize);
+	CompressedResHandle *FindCompressed(const Resource & r);
+	bool MakeCompressedRoom(unsigned int size);
+	void FreeOneCompressed();
+
 public:
-	ResCache(const unsigned int sizeInMb, IResourceFile *file);
+	ResCache(const unsigned int sizeInMb, IResourceFile *file, const unsigned int compressedSizeInMb = 0);
 	virtual ~ResCache();
 
 	bool Init() { return m_file->VOpen(); }
@@ -114,6 +233,31 @@ public:
 
 	void Flush(void);
 
+	void StartRecording();
+	bool StopRecording(const _TCHAR *manifestFile);
+	bool IsRecording() const { return m_recording; }
+	bool Prefetch(const _TCHAR *manifestFile);
+	void StopPrefetch();
+	unsigned int GetPrefetched() const { return m_stats.GetTotal().m_prefetched; }
+
+	// Loads the resource on the cache's own thread, so the caller's thread
+	// never waits on the disk, and sets *done to 1 once it's in. done has to
+	// stay where it is until then or until CancelLoad.
+	void LoadAsync(const std::string &name, volatile LONG *done);
+	// Drops the request, or waits for it if it's being loaded already.
+	void CancelLoad(volatile LONG *done);
+	void StopLoads();
+
+	float GetResidentHitRate() const;
+	float GetCompressedHitRate() const;
+	unsigned int GetResidentHits() const { return m_stats.GetTotal().m_hits; }
+	unsigned int GetCompressedHits() const { return m_stats.GetTotal().m_compressedHits; }
+	unsigned int GetMisses() const { return m_stats.GetTotal().m_misses; }
+
+	ResCacheStats GetStats();
+	void ResetStats();
+	std::string GetStatsJson();
+	bool DumpStats(const _TCHAR *fileName);
 };
 
 
@@ -0,0 +1,234 @@
+//========================================================================
+// ResCacheStats.cpp : Counters and timing histograms for the resource cache.
+//========================================================================
+
+#include "StdHeader.h"
+#include "ResCacheStats.h"
+
+LARGE_INTEGER ResTimer::s_frequency = { 0 };
+
+double ResTimer::GetMicroseconds() const
+{
+	if (s_frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&s_frequency);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double)(now.QuadPart - m_start.QuadPart) * 1000000.0 / (double)s_frequency.QuadPart;
+}
+
+
+void ResHistogram::Reset()
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+	m_count = 0;
+	m_total = 0.0;
+	m_max = 0.0;
+}
+
+void ResHistogram::Add(double value)
+{
+	unsigned int v = (value > 0.0) ? (unsigned int)value : 0;
+	int bucket = 0;
+	while (v && bucket < NUM_BUCKETS - 1)
+	{
+		v >>= 1;
+		bucket++;
+	}
+
+	m_buckets[bucket]++;
+	m_count++;
+	m_total += value;
+	if (value > m_max)
+		m_max = value;
+}
+
+
+void ResStatCounters::Reset()
+{
+	m_hits = 0;
+	m_compressedHits = 0;
+	m_misses = 0;
+	m_evictions = 0;
+	m_prefetched = 0;
+	m_bytesLoaded = 0;
+	m_bytesRead = 0;
+	m_ioTime.Reset();
+	m_inflateTime.Reset();
+}
+
+
+// Lower case extension without the dot, or an empty string if there is none.
+std::string ResCacheStats::GetExtension(const std::string &name)
+{
+	std::string::size_type dot = name.find_last_of('.');
+	std::string::size_type slash = name.find_last_of("\\/");
+	if (dot == std::string::npos || (slash != std::string::npos && slash > dot))
+		return std::string();
+
+	std::string ext = name.substr(dot + 1);
+	for (std::string::size_type i = 0; i < ext.size(); i++)
+		ext[i] = (char)tolower(ext[i]);
+	return ext;
+}
+
+void ResCacheStats::GetCounters(const std::string &name, ResStatCounters *counters[NUM_SCOPES])
+{
+	counters[0] = &m_total;
+	counters[1] = &m_byResource[name];
+	counters[2] = &m_byExtension[GetExtension(name)];
+}
+
+void ResCacheStats::OnHit(const std::string &name)
+{
+	ResStatCounters *counters[NUM_SCOPES];
+	GetCounters(name, counters);
+	for (int i = 0; i < NUM_SCOPES; i++)
+		counters[i]->m_hits++;
+}
+
+void ResCacheStats::OnCompressedHit(const std::string &name, unsigned int size, double inflateMicros)
+{
+	ResStatCounters *counters[NUM_SCOPES];
+	GetCounters(name, counters);
+	for (int i = 0; i < NUM_SCOPES; i++)
+	{
+		counters[i]->m_compressedHits++;
+		counters[i]->m_bytesLoaded += size;
+		counters[i]->m_inflateTime.Add(inflateMicros);
+	}
+}
+
+void ResCacheStats::OnMiss(const std::string &name, unsigned int size, unsigned int bytesRead, double ioMicros, double inflateMicros)
+{
+	ResStatCounters *counters[NUM_SCOPES];
+	GetCounters(name, counters);
+	for (int i = 0; i < NUM_SCOPES; i++)
+	{
+		counters[i]->m_misses++;
+		counters[i]->m_bytesLoaded += size;
+		counters[i]->m_bytesRead += bytesRead;
+		counters[i]->m_ioTime.Add(ioMicros);
+		if (inflateMicros > 0.0)
+			counters[i]->m_inflateTime.Add(inflateMicros);
+	}
+}
+
+void ResCacheStats::OnPrefetch(const std::string &name, unsigned int size, unsigned int bytesRead, double ioMicros, double inflateMicros)
+{
+	ResStatCounters *counters[NUM_SCOPES];
+	GetCounters(name, counters);
+	for (int i = 0; i < NUM_SCOPES; i++)
+	{
+		counters[i]->m_prefetched++;
+		counters[i]->m_bytesLoaded += size;
+		counters[i]->m_bytesRead += bytesRead;
+		counters[i]->m_ioTime.Add(ioMicros);
+		if (inflateMicros > 0.0)
+			counters[i]->m_inflateTime.Add(inflateMicros);
+	}
+}
+
+void ResCacheStats::OnEviction(const std::string &name)
+{
+	ResStatCounters *counters[NUM_SCOPES];
+	GetCounters(name, counters);
+	for (int i = 0; i < NUM_SCOPES; i++)
+		counters[i]->m_evictions++;
+}
+
+void ResCacheStats::Reset()
+{
+	m_total.Reset();
+	m_byResource.clear();
+	m_byExtension.clear();
+}
+
+
+void AppendJsonString(std::string &json, const std::string &str)
+{
+	json += '"';
+	for (std::string::size_type i = 0; i < str.size(); i++)
+	{
+		unsigned char c = (unsigned char)str[i];
+		if (c == '"' || c == '\\')
+		{
+			json += '\\';
+			json += (char)c;
+		}
+		else if (c < 0x20)
+		{
+			char esc[8];
+			sprintf(esc, "\\u%04x", c);
+			json += esc;
+		}
+		else
+			json += (char)c;
+	}
+	json += '"';
+}
+
+void AppendJsonHistogram(std::string &json, const char *name, const ResHistogram &h)
+{
+	// The name goes in on its own and the numbers are bounded, as the totals
+	// for a whole session can run long.
+	AppendJsonString(json, name);
+
+	char buf[256];
+	_snprintf(buf, sizeof(buf), ": {\"count\": %u, \"totalUs\": %.1f, \"avgUs\": %.1f, \"maxUs\": %.1f, \"buckets\": [",
+		h.m_count, h.m_total, h.GetAverage(), h.m_max);
+	buf[sizeof(buf) - 1] = 0;
+	json += buf;
+
+	// Trailing empty buckets are left off.
+	int last = ResHistogram::NUM_BUCKETS - 1;
+	while (last > 0 && h.m_buckets[last] == 0)
+		last--;
+
+	for (int i = 0; i <= last; i++)
+	{
+		sprintf(buf, i ? ", %u" : "%u", h.m_buckets[i]);
+		json += buf;
+	}
+	json += "]}";
+}
+
+static void AppendJsonCounters(std::string &json, const ResStatCounters &c)
+{
+	char buf[384];
+	_snprintf(buf, sizeof(buf), "{\"hits\": %u, \"compressedHits\": %u, \"misses\": %u, \"evictions\": %u, \"prefetched\": %u, "
+		"\"bytesLoaded\": %I64u, \"bytesRead\": %I64u, ",
+		c.m_hits, c.m_compressedHits, c.m_misses, c.m_evictions, c.m_prefetched, c.m_bytesLoaded, c.m_bytesRead);
+	buf[sizeof(buf) - 1] = 0;
+	json += buf;
+	AppendJsonHistogram(json, "ioTime", c.m_ioTime);
+	json += ", ";
+	AppendJsonHistogram(json, "inflateTime", c.m_inflateTime);
+	json += "}";
+}
+
+static void AppendJsonCountersMap(std::string &json, const ResStatCountersMap &counters)
+{
+	json += "{";
+	for (ResStatCountersMap::const_iterator it = counters.begin(); it != counters.end(); it++)
+	{
+		if (it != counters.begin())
+			json += ",";
+		json += "\n    ";
+		AppendJsonString(json, (*it).first);
+		json += ": ";
+		AppendJsonCounters(json, (*it).second);
+	}
+	json += "\n  }";
+}
+
+// Adds the "total", "extensions" and "resources" members of a json object.
+void ResCacheStats::AppendJson(std::string &json) const
+{
+	json += "  \"total\": ";
+	AppendJsonCounters(json, m_total);
+	json += ",\n  \"extensions\": ";
+	AppendJsonCountersMap(json, m_byExtension);
+	json += ",\n  \"resources\": ";
+	AppendJsonCountersMap(json, m_byResource);
+}
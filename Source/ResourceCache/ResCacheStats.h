@@ -0,0 +1,91 @@
+#pragma once
+//========================================================================
+// ResCacheStats.h : Counters and timing histograms for the resource cache.
+//
+// Everything is kept as a total, per resource name and per file extension
+// so it's possible to tell which kind of asset is costing the load time.
+//========================================================================
+
+#include "StdHeader.h"
+#include <map>
+
+// Histogram with power of two buckets. Bucket 0 holds 0, bucket n holds
+// values in [2^(n-1), 2^n). Times are in microseconds.
+class ResHistogram
+{
+public:
+	enum { NUM_BUCKETS = 24 };
+
+	unsigned int m_buckets[NUM_BUCKETS];
+	unsigned int m_count;
+	double m_total;
+	double m_max;
+
+	ResHistogram() { Reset(); }
+	void Reset();
+	void Add(double value);
+	double GetAverage() const { return m_count ? m_total / m_count : 0.0; }
+};
+
+// Json helpers, also used by the event profiler.
+void AppendJsonString(std::string &json, const std::string &str);
+void AppendJsonHistogram(std::string &json, const char *name, const ResHistogram &h);
+
+struct ResStatCounters
+{
+	unsigned int m_hits;				// found decompressed
+	unsigned int m_compressedHits;		// found compressed, only needed an inflate
+	unsigned int m_misses;				// had to go to the file
+	unsigned int m_evictions;
+	unsigned int m_prefetched;			// loaded by the prefetch thread
+	unsigned __int64 m_bytesLoaded;		// decompressed bytes put in the cache
+	unsigned __int64 m_bytesRead;		// bytes read from the file
+
+	ResHistogram m_ioTime;
+	ResHistogram m_inflateTime;
+
+	ResStatCounters() { Reset(); }
+	void Reset();
+	unsigned int GetRequests() const { return m_hits + m_compressedHits + m_misses; }
+};
+
+typedef std::map<std::string, ResStatCounters> ResStatCountersMap;
+
+// Times a single operation with the performance counter.
+class ResTimer
+{
+	LARGE_INTEGER m_start;
+	static LARGE_INTEGER s_frequency;
+public:
+	ResTimer() { Restart(); }
+	void Restart() { QueryPerformanceCounter(&m_start); }
+	double GetMicroseconds() const;
+};
+
+class ResCacheStats
+{
+	ResStatCounters m_total;
+	ResStatCountersMap m_byResource;
+	ResStatCountersMap m_byExtension;
+
+	enum { NUM_SCOPES = 3 };
+
+	static std::string GetExtension(const std::string &name);
+
+	// The total, per resource and per extension counters a name adds to.
+	void GetCounters(const std::string &name, ResStatCounters *counters[NUM_SCOPES]);
+
+public:
+	void OnHit(const std::string &name);
+	void OnCompressedHit(const std::string &name, unsigned int size, double inflateMicros);
+	void OnMiss(const std::string &name, unsigned int size, unsigned int bytesRead, double ioMicros, double inflateMicros);
+	void OnPrefetch(const std::string &name, unsigned int size, unsigned int bytesRead, double ioMicros, double inflateMicros);
+	void OnEviction(const std::string &name);
+	void Reset();
+
+	const ResStatCounters &GetTotal() const { return m_total; }
+	const ResStatCountersMap &GetByResource() const { return m_byResource; }
+	const ResStatCountersMap &GetByExtension() const { return m_byExtension; }
+
+	void AppendJson(std::string &json) const;
+};
@@ -0,0 +1,39 @@
+//========================================================================
+// ResWorkers.cpp : Spreads independent pieces of resource work over threads.
+//========================================================================
+
+#include "StdHeader.h"
+
+#include "ResWorkers.h"
+#include "EngineFiles\JobSystem.h"
+
+struct ResWorkBatch
+{
+	ResWorkFunc m_func;
+	void *m_pContext;
+};
+
+static void DoRange(void *pBatch, int begin, int end)
+{
+	ResWorkBatch *batch = (ResWorkBatch *)pBatch;
+	for (int i = begin; i < end; i++)
+		batch->m_func(batch->m_pContext, i);
+}
+
+// Items are a block or a whole file, big enough to be a range of their own,
+// so a slow one doesn't hold up the rest.
+void ResParallelFor(int count, int numThreads, ResWorkFunc func, void *pContext)
+{
+	if (count <= 0)
+		return;
+
+	ResWorkBatch batch;
+	batch.m_func = func;
+	batch.m_pContext = pContext;
+
+	JobSystem *jobs = JobSystem::Get();
+	if (numThreads == 1 || !jobs)
+		DoRange(&batch, 0, count);
+	else
+		jobs->ParallelFor(count, 1, DoRange, &batch);
+}
@@ -0,0 +1,17 @@
+#pragma once
+//========================================================================
+// ResWorkers.h : Spreads independent pieces of resource work over threads.
+//========================================================================
+
+#include "StdHeader.h"
+
+// Does item i of a batch. Called from several threads at once, so it may only
+// touch item i and things that are safe to share.
+typedef void (*ResWorkFunc)(void *pContext, int i);
+
+// Calls func for every item in [0, count) on the job system's threads, the
+// calling thread being one of them, and returns once every item is done.
+// numThreads == 1 keeps them all on the calling thread. So do calls from
+// threads that aren't the job system's, like the prefetch thread, which
+// leaves the workers to the game.
+void ResParallelFor(int count, int numThreads, ResWorkFunc func, void *pContext);
@@ -41,6 +41,8 @@
 #include "StdHeader.h"
 
 #include "ZipFile.h"
+#include "ResWorkers.h"
+#include "ZipPackIndex.h"
 #include "zlib\zlib.h"
 #include <string.h>
 
@@ -128,99 +130,422 @@ struct CZipFile::TZipDirFileHeader
 
 #pragma pack()
 
+// --------------------------------------------------------------------------
+// Names are found without regard to case or which slashes they use.
+// --------------------------------------------------------------------------
+static inline char FoldChar(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 'a';
+  if (c == '/')
+    return '\\';
+  return c;
+}
+
+// FNV-1a over the folded name.
+static unsigned int HashName(const char *name, int len)
+{
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < len; i++)
+  {
+    hash ^= (byte)FoldChar(name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static bool MatchName(const char *folded, const char *name, int len)
+{
+  for (int i = 0; i < len; i++)
+    if (folded[i] != FoldChar(name[i]))
+      return false;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// What CZipFile keeps about each file, from the central directory or a pack
+// index.
+// --------------------------------------------------------------------------
+struct CZipFile::TZipEntry
+{
+  dword   hdrOffset;        // Local header
+  dword   dataOffset;       // File data, 0 until known from a pack index
+  dword   cSize;
+  dword   ucSize;
+  word    compression;
+  word    nameLen;
+  const char *pName;        // As stored, with backslashes
+  dword   foldedName;       // Offset of the folded name in m_pNames
+  dword   hash;
+  dword   firstCheckpoint;
+  dword   numCheckpoints;
+};
+
 // --------------------------------------------------------------------------
 // Function:      Init
-// Purpose:       Initialize the object and read the zip file directory.
-// Parameters:    A stdio FILE* used for reading.
+// Purpose:       Initialize the object and read the zip file directory, or
+//                the pack index next to it if there is an up to date one.
+// Parameters:    The zip file name
 // --------------------------------------------------------------------------
 bool CZipFile::Init(const _TCHAR *resFileName)
 {
   End();
 
-  m_pFile = _wfopen(resFileName, _T("rb"));
-  if (!m_pFile)
+  if (!Open(resFileName))
     return false;
 
   // Assuming no extra comment at the end, read the whole end record.
   TZipDirHeader dh;
 
-  fseek(m_pFile, -(int)sizeof(dh), SEEK_END);
-  long dhOffset = ftell(m_pFile);
+  if (m_fileSize < sizeof(dh))
+    return false;
+  dword dhOffset = m_fileSize - sizeof(dh);
   memset(&dh, 0, sizeof(dh));
-  fread(&dh, sizeof(dh), 1, m_pFile);
+  ReadAt(dhOffset, &dh, sizeof(dh));
 
   // Check
-  if (dh.sig != TZipDirHeader::SIGNATURE)
+  if (dh.sig != TZipDirHeader::SIGNATURE || dh.dirSize > dhOffset)
     return false;
 
-  // Go to the beginning of the directory.
-  fseek(m_pFile, dhOffset - dh.dirSize, SEEK_SET);
+  bool success = ReadPackIndex(resFileName, dh) || ReadDirectory(dh);
+  if (!success)
+    End();
+
+  return success;
+}
 
+// --------------------------------------------------------------------------
+// Function:      ReadDirectory
+// Purpose:       Fill in the entries from the central directory
+// Parameters:    The end of directory record
+// --------------------------------------------------------------------------
+bool CZipFile::ReadDirectory(const TZipDirHeader &dh)
+{
   // Allocate the data buffer, and read the whole thing.
-  m_pDirData = SAFE_NEW char[dh.dirSize + dh.nDirEntries*sizeof(*m_papDir)];
+  m_pDirData = SAFE_NEW char[dh.dirSize];
   if (!m_pDirData)
     return false;
-  memset(m_pDirData, 0, dh.dirSize + dh.nDirEntries*sizeof(*m_papDir));
-  fread(m_pDirData, dh.dirSize, 1, m_pFile);
+  if (!ReadAt(m_fileSize - sizeof(dh) - dh.dirSize, m_pDirData, dh.dirSize))
+    return false;
+
+  m_pEntries = SAFE_NEW TZipEntry[dh.nDirEntries];
+  memset(m_pEntries, 0, dh.nDirEntries * sizeof(TZipEntry));
 
   // Now process each entry.
   char *pfh = m_pDirData;
-  m_papDir = (const TZipDirFileHeader **)(m_pDirData + dh.dirSize);
+  char *pEnd = m_pDirData + dh.dirSize;
+  unsigned int namesSize = 0;
 
-  bool success = true;
-
-  for (int i = 0; i < dh.nDirEntries && success; i++)
+  for (int i = 0; i < dh.nDirEntries; i++)
   {
     TZipDirFileHeader &fh = *(TZipDirFileHeader*)pfh;
 
-    // Store the address of nth file for quicker access.
-    m_papDir[i] = &fh;
-
     // Check the directory entry integrity.
-    if (fh.sig != TZipDirFileHeader::SIGNATURE)
-      success = false;
-    else
+    if (pfh + sizeof(fh) > pEnd || fh.sig != TZipDirFileHeader::SIGNATURE)
+      return false;
+
+    pfh += sizeof(fh);
+    if (pfh + fh.fnameLen + fh.xtraLen + fh.cmntLen > pEnd)
+      return false;
+
+    // Convert UNIX slashes to DOS backlashes.
+    for (int j = 0; j < fh.fnameLen; j++)
+      if (pfh[j] == '/')
+        pfh[j] = '\\';
+
+    TZipEntry &entry = m_pEntries[i];
+    entry.hdrOffset = fh.hdrOffset;
+    entry.cSize = fh.cSize;
+    entry.ucSize = fh.ucSize;
+    entry.compression = fh.compression;
+    entry.nameLen = fh.fnameLen;
+    entry.pName = pfh;
+    namesSize += fh.fnameLen + 1;
+
+    // Skip name, extra and comment fields.
+    pfh += fh.fnameLen + fh.xtraLen + fh.cmntLen;
+  }
+
+  m_nEntries = dh.nDirEntries;
+  return BuildNameIndex(namesSize);
+}
+
+// --------------------------------------------------------------------------
+// Function:      ReadPackIndex
+// Purpose:       Fill in the entries from the index written by ZipPack. This
+//                is one read, and the data offsets and sync points in it
+//                save reading each local header.
+// Parameters:    The zip file name and its end of directory record
+// --------------------------------------------------------------------------
+bool CZipFile::ReadPackIndex(const _TCHAR *resFileName, const TZipDirHeader &dh)
+{
+  std::wstring indexName = resFileName;
+  indexName += ZIP_PACK_INDEX_EXT;
+
+  HANDLE hIndex = CreateFileW(indexName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hIndex == INVALID_HANDLE_VALUE)
+    return false;
+
+  DWORD indexSize = GetFileSize(hIndex, NULL);
+  DWORD bytesRead = 0;
+  bool ok = indexSize >= sizeof(TZipPackIndexHeader) && indexSize != INVALID_FILE_SIZE;
+
+  if (ok)
+  {
+    m_pDirData = SAFE_NEW char[indexSize];
+    ok = ::ReadFile(hIndex, m_pDirData, indexSize, &bytesRead, NULL) && bytesRead == indexSize;
+  }
+  CloseHandle(hIndex);
+
+  // A stale index, from before the zip was rebuilt, is ignored.
+  const TZipPackIndexHeader *pHeader = (const TZipPackIndexHeader *)m_pDirData;
+  if (ok)
+  {
+    ok = pHeader->sig == TZipPackIndexHeader::SIGNATURE && pHeader->version == TZipPackIndexHeader::VERSION &&
+         pHeader->archiveSize == m_fileSize && pHeader->dirOffset == dh.dirOffset &&
+         pHeader->numEntries == dh.nDirEntries && pHeader->numSyncPoints < 0x1000000 &&
+         sizeof(TZipPackIndexHeader) + pHeader->numEntries * sizeof(TZipPackIndexEntry) +
+         pHeader->numSyncPoints * sizeof(TZipPackSyncPoint) + pHeader->namesSize == indexSize;
+  }
+  if (!ok)
+  {
+    SAFE_DELETE_ARRAY(m_pDirData);
+    return false;
+  }
+
+  const TZipPackIndexEntry *pIndexEntries = (const TZipPackIndexEntry *)(pHeader + 1);
+  const TZipPackSyncPoint *pSyncPoints = (const TZipPackSyncPoint *)(pIndexEntries + pHeader->numEntries);
+  const char *pNames = (const char *)(pSyncPoints + pHeader->numSyncPoints);
+
+  m_pEntries = SAFE_NEW TZipEntry[pHeader->numEntries];
+  memset(m_pEntries, 0, pHeader->numEntries * sizeof(TZipEntry));
+  m_pCheckpoints = SAFE_NEW ZipCheckpoint[pHeader->numSyncPoints + 1];
+
+  unsigned int namesSize = 0;
+
+  for (unsigned int i = 0; i < pHeader->numEntries; i++)
+  {
+    const TZipPackIndexEntry &ie = pIndexEntries[i];
+    if (ie.nameOffset > pHeader->namesSize || ie.nameLen > pHeader->namesSize - ie.nameOffset ||
+        ie.firstSyncPoint > pHeader->numSyncPoints || ie.numSyncPoints > pHeader->numSyncPoints - ie.firstSyncPoint ||
+        ie.dataOffset > m_fileSize || ie.cSize > m_fileSize - ie.dataOffset)
     {
-      pfh += sizeof(fh);
-
-      // Convert UNIX slashes to DOS backlashes.
-      for (int j = 0; j < fh.fnameLen; j++)
-        if (pfh[j] == '/')
-          pfh[j] = '\\';
-
-	  char fileName[_MAX_PATH];
-	  memcpy(fileName, pfh, fh.fnameLen);
-	  fileName[fh.fnameLen]=0;
-	  _strlwr(fileName);
-	  std::string spath = fileName;
-	  m_ZipContentsMap[spath] = i;
-
-      // Skip name, extra and comment fields.
-      pfh += fh.fnameLen + fh.xtraLen + fh.cmntLen;
+      SAFE_DELETE_ARRAY(m_pEntries);
+      SAFE_DELETE_ARRAY(m_pCheckpoints);
+      SAFE_DELETE_ARRAY(m_pDirData);
+      return false;
     }
+
+    TZipEntry &entry = m_pEntries[i];
+    entry.hdrOffset = ie.hdrOffset;
+    entry.dataOffset = ie.dataOffset;
+    entry.cSize = ie.cSize;
+    entry.ucSize = ie.ucSize;
+    entry.compression = ie.compression;
+    entry.nameLen = ie.nameLen;
+    entry.pName = pNames + ie.nameOffset;
+    entry.firstCheckpoint = ie.firstSyncPoint;
+    entry.numCheckpoints = ie.numSyncPoints;
+    namesSize += ie.nameLen + 1;
   }
-  if (!success)
+
+  for (unsigned int c = 0; c < pHeader->numSyncPoints; c++)
   {
-    SAFE_DELETE_ARRAY(m_pDirData);
+    m_pCheckpoints[c].m_compressed = pSyncPoints[c].compressed;
+    m_pCheckpoints[c].m_uncompressed = pSyncPoints[c].uncompressed;
   }
-  else
+
+  m_nEntries = pHeader->numEntries;
+  return BuildNameIndex(namesSize);
+}
+
+// --------------------------------------------------------------------------
+// Function:      BuildNameIndex
+// Purpose:       Fold every name into the name pool and hash it. A later
+//                entry with the same name wins.
+// Parameters:    The size of all the names with a NUL after each
+// --------------------------------------------------------------------------
+bool CZipFile::BuildNameIndex(unsigned int namesSize)
+{
+  unsigned int tableSize = 16;
+  while (tableSize < (unsigned int)m_nEntries * 2)
+    tableSize <<= 1;
+
+  m_pNames = SAFE_NEW char[namesSize];
+  m_pHashTable = SAFE_NEW int[tableSize];
+  m_hashMask = tableSize - 1;
+  memset(m_pHashTable, -1, tableSize * sizeof(int));
+
+  unsigned int namesUsed = 0;
+
+  for (int i = 0; i < m_nEntries; i++)
   {
-    m_nEntries = dh.nDirEntries;
+    TZipEntry &entry = m_pEntries[i];
+
+    char *pName = m_pNames + namesUsed;
+    for (int j = 0; j < entry.nameLen; j++)
+      pName[j] = FoldChar(entry.pName[j]);
+    pName[entry.nameLen] = 0;
+
+    entry.foldedName = namesUsed;
+    entry.hash = HashName(pName, entry.nameLen);
+    namesUsed += entry.nameLen + 1;
+
+    unsigned int slot = entry.hash & m_hashMask;
+    while (m_pHashTable[slot] >= 0)
+    {
+      const TZipEntry &other = m_pEntries[m_pHashTable[slot]];
+      if (other.hash == entry.hash && other.nameLen == entry.nameLen &&
+          memcmp(m_pNames + other.foldedName, pName, entry.nameLen) == 0)
+        break;
+      slot = (slot + 1) & m_hashMask;
+    }
+    m_pHashTable[slot] = i;
   }
 
-  return success;
+  return true;
 }
 
+// --------------------------------------------------------------------------
+// Function:      Open
+// Purpose:       Open the zip file and map it into memory.
+// Parameters:    The zip file name
+// --------------------------------------------------------------------------
+bool CZipFile::Open(const _TCHAR *resFileName)
+{
+  m_hFile = CreateFileW(resFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+  if (m_hFile == INVALID_HANDLE_VALUE)
+  {
+    m_hFile = NULL;
+    return false;
+  }
+
+  m_fileSize = GetFileSize(m_hFile, NULL);
+
+  m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (m_hMapping)
+    m_pMapped = (const char *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+
+  // Not enough address space to map it, ReadAt will read from the file then.
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Function:      ReadAt
+// Purpose:       Copy part of the zip file into a buffer. There's no shared
+//                file position, so any number of threads can read at once.
+// Parameters:    The offset in the file, the buffer and the number of bytes
+// --------------------------------------------------------------------------
+bool CZipFile::ReadAt(unsigned long offset, void *pBuf, unsigned long size)
+{
+  if (offset > m_fileSize || size > m_fileSize - offset)
+    return false;
+
+  if (m_pMapped)
+  {
+    memcpy(pBuf, m_pMapped + offset, size);
+    return true;
+  }
+
+  if (size == 0)
+    return true;
+
+  OVERLAPPED overlapped;
+  memset(&overlapped, 0, sizeof(overlapped));
+  overlapped.Offset = offset;
+
+  DWORD bytesRead = 0;
+  return ::ReadFile(m_hFile, pBuf, size, &bytesRead, &overlapped) && bytesRead == size;
+}
+
+// --------------------------------------------------------------------------
+// Function:      GetDataOffset
+// Purpose:       Find where the data of a file starts, after its local header
+// Parameters:    The file index and where to put the offset
+// --------------------------------------------------------------------------
+bool CZipFile::GetDataOffset(int i, unsigned long &offset)
+{
+  const TZipEntry &entry = m_pEntries[i];
+  if (entry.dataOffset)
+  {
+    offset = entry.dataOffset;
+    return true;
+  }
+
+  TZipLocalHeader h;
+
+  memset(&h, 0, sizeof(h));
+  if (!ReadAt(entry.hdrOffset, &h, sizeof(h)) || h.sig != TZipLocalHeader::SIGNATURE)
+    return false;
+
+  offset = entry.hdrOffset + sizeof(h) + h.fnameLen + h.xtraLen;
+
+  // The local header sizes are zero when the zip was written with a data
+  // descriptor, so trust the directory entry for the length.
+  return offset <= m_fileSize && entry.cSize <= m_fileSize - offset;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Find
+// Purpose:       Find a file by name, ignoring case and slash direction
+// Parameters:    The name, and its length if it isn't NUL terminated.
+//                Returns the file index or -1.
+// --------------------------------------------------------------------------
 int CZipFile::Find(const char *path) const
 {
-	char lwrPath[_MAX_PATH];
-	strcpy(lwrPath, path);
-	_strlwr(lwrPath);
-	ZipContentsMap::const_iterator i = m_ZipContentsMap.find(lwrPath);
-	if (i==m_ZipContentsMap.end())
-		return -1;
+  if (path == NULL)
+    return -1;
+  return Find(path, (int)strlen(path));
+}
+
+int CZipFile::Find(const char *path, int len) const
+{
+  if (path == NULL || m_pHashTable == NULL)
+    return -1;
 
-	return (*i).second;
+  unsigned int hash = HashName(path, len);
+  unsigned int slot = hash & m_hashMask;
+  int i;
+
+  while ((i = m_pHashTable[slot]) >= 0)
+  {
+    if (m_pEntries[i].hash == hash && m_pEntries[i].nameLen == len &&
+        MatchName(m_pNames + m_pEntries[i].foldedName, path, len))
+      return i;
+    slot = (slot + 1) & m_hashMask;
+  }
+  return -1;
+}
+
+// --------------------------------------------------------------------------
+// Function:      FindAll
+// Purpose:       List every file under a directory, in the order they are in
+//                the zip. The names are packed together, so this is a quick
+//                walk over them.
+// Parameters:    The directory, "" for everything, and the list to fill in
+// --------------------------------------------------------------------------
+void CZipFile::FindAll(const char *dir, std::vector<int> &indices) const
+{
+  indices.clear();
+
+  int len = dir ? (int)strlen(dir) : 0;
+  bool addSlash = len > 0 && FoldChar(dir[len - 1]) != '\\';
+
+  for (int i = 0; i < m_nEntries; i++)
+  {
+    const char *pName = m_pNames + m_pEntries[i].foldedName;
+    if (m_pEntries[i].nameLen < len + (addSlash ? 1 : 0))
+      continue;
+    if (!MatchName(pName, dir, len))
+      continue;
+    if (addSlash && pName[len] != '\\')
+      continue;
+
+    // Directories have entries of their own, leave them out.
+    if (m_pEntries[i].nameLen > 0 && pName[m_pEntries[i].nameLen - 1] == '\\')
+      continue;
+    indices.push_back(i);
+  }
 }
 
 
@@ -232,9 +557,25 @@ int CZipFile::Find(const char *path) const
 // --------------------------------------------------------------------------
 void CZipFile::End()
 {
-	m_ZipContentsMap.empty();
     SAFE_DELETE_ARRAY(m_pDirData);
+    SAFE_DELETE_ARRAY(m_pEntries);
+    SAFE_DELETE_ARRAY(m_pCheckpoints);
+    SAFE_DELETE_ARRAY(m_pNames);
+    SAFE_DELETE_ARRAY(m_pHashTable);
+    m_hashMask = 0;
     m_nEntries = 0;
+
+    if (m_pMapped)
+      UnmapViewOfFile(m_pMapped);
+    if (m_hMapping)
+      CloseHandle(m_hMapping);
+    if (m_hFile)
+      CloseHandle(m_hFile);
+
+    m_pMapped = NULL;
+    m_hMapping = NULL;
+    m_hFile = NULL;
+    m_fileSize = 0;
 }
 
 // --------------------------------------------------------------------------
@@ -250,8 +591,8 @@ void CZipFile::GetFilename(int i, char *pszDest)  const
       *pszDest = '\0';
     else
     {
-      memcpy(pszDest, m_papDir[i]->GetName(), m_papDir[i]->fnameLen);
-      pszDest[m_papDir[i]->fnameLen] = '\0';
+      memcpy(pszDest, m_pEntries[i].pName, m_pEntries[i].nameLen);
+      pszDest[m_pEntries[i].nameLen] = '\0';
     }
   }
 }
@@ -267,7 +608,20 @@ int CZipFile::GetFileLen(int i) const
   if (i < 0 || i >= m_nEntries)
     return -1;
   else
-    return m_papDir[i]->ucSize;
+    return m_pEntries[i].ucSize;
+}
+
+// --------------------------------------------------------------------------
+// Function:      GetCompressedLen
+// Purpose:       Return the length of a file as it is stored in the zip
+// Parameters:    The file index.
+// --------------------------------------------------------------------------
+int CZipFile::GetCompressedLen(int i) const
+{
+  if (i < 0 || i >= m_nEntries)
+    return -1;
+  else
+    return m_pEntries[i].cSize;
 }
 
 // --------------------------------------------------------------------------
@@ -280,48 +634,142 @@ bool CZipFile::ReadFile(int i, char *pBuf)
   if (pBuf == NULL || i < 0 || i >= m_nEntries)
     return false;
 
-  // Quick'n dirty read, the whole file at once.
-  // Ungood if the ZIP has huge files inside
+  // Stored data goes straight into the caller's buffer.
+  if (m_pEntries[i].compression == Z_NO_COMPRESSION)
+    return ReadCompressed(i, pBuf);
 
-  // Go to the actual file and read the local header.
-  fseek(m_pFile, m_papDir[i]->hdrOffset, SEEK_SET);
-  TZipLocalHeader h;
+  // A mapped file can be inflated in place.
+  unsigned long offset;
+  if (m_pMapped)
+    return GetDataOffset(i, offset) && Inflate(i, m_pMapped + offset, pBuf);
 
-  memset(&h, 0, sizeof(h));
-  fread(&h, sizeof(h), 1, m_pFile);
-  if (h.sig != TZipLocalHeader::SIGNATURE)
-    return false;
+  // Otherwise stream it, so only a piece of the compressed data is in memory.
+  CZipStream stream;
+  int len = GetFileLen(i);
 
-  // Skip extra fields
-  fseek(m_pFile, h.fnameLen + h.xtraLen, SEEK_CUR);
+  return stream.Open(this, i) && stream.Read(pBuf, len) == len;
+}
 
-  if (h.compression == Z_NO_COMPRESSION)
-  {
-    // Simply read in raw stored data.
-    fread(pBuf, h.cSize, 1, m_pFile);
+struct TZipReadBatch
+{
+  CZipFile *pZip;
+  const int *pIndices;
+  char **ppBufs;
+  bool *pResults;
+};
+
+static void ReadOneFile(void *pContext, int n)
+{
+  TZipReadBatch *pBatch = (TZipReadBatch *)pContext;
+  pBatch->pResults[n] = pBatch->pZip->ReadFile(pBatch->pIndices[n], pBatch->ppBufs[n]);
+}
+
+// --------------------------------------------------------------------------
+// Function:      ReadFiles
+// Purpose:       Uncompress several complete files, spread over the job
+//                system's threads, see ResParallelFor
+// Parameters:    The number of files, their indices and pre-allocated buffers,
+//                optionally where to put whether each one worked and the
+//                number of threads (1 to stay on this one, anything else uses
+//                the job system's). Returns true if they all worked.
+// --------------------------------------------------------------------------
+bool CZipFile::ReadFiles(int count, const int *pIndices, char **ppBufs, bool *pResults, int numThreads)
+{
+  if (count <= 0)
     return true;
-  }
-  else if (h.compression != Z_DEFLATED)
+  if (pIndices == NULL || ppBufs == NULL)
     return false;
 
-  // Alloc compressed data buffer and read the whole stream
-  char *pcData = SAFE_NEW char[h.cSize];
-  if (!pcData)
-    return false;
+  bool *pOwnResults = NULL;
+  if (pResults == NULL)
+    pResults = pOwnResults = SAFE_NEW bool[count];
 
-  memset(pcData, 0, h.cSize);
-  fread(pcData, h.cSize, 1, m_pFile);
+  TZipReadBatch batch;
+  batch.pZip = this;
+  batch.pIndices = pIndices;
+  batch.ppBufs = ppBufs;
+  batch.pResults = pResults;
+
+  ResParallelFor(count, numThreads, ReadOneFile, &batch);
 
   bool ret = true;
+  for (int n = 0; n < count; n++)
+    ret = ret && pResults[n];
+
+  SAFE_DELETE_ARRAY(pOwnResults);
+  return ret;
+}
+
+// --------------------------------------------------------------------------
+// Function:      ReadCompressed
+// Purpose:       Read the raw bytes of a file without uncompressing them
+// Parameters:    The file index and a buffer of GetCompressedLen() bytes
+// --------------------------------------------------------------------------
+bool CZipFile::ReadCompressed(int i, char *pBuf)
+{
+  if (pBuf == NULL || i < 0 || i >= m_nEntries)
+    return false;
+
+  if (m_pEntries[i].compression != Z_NO_COMPRESSION && m_pEntries[i].compression != Z_DEFLATED)
+    return false;
+
+  // Skip the local header and extra fields, then read the data.
+  unsigned long offset;
+  if (!GetDataOffset(i, offset))
+    return false;
+
+  return ReadAt(offset, pBuf, m_pEntries[i].cSize);
+}
+
+// --------------------------------------------------------------------------
+// Function:      GetView
+// Purpose:       Point straight into the mapped zip for a stored file, no copy
+// Parameters:    The file index. Returns NULL if the file is compressed or the
+//                zip couldn't be mapped, use ReadFile then.
+// --------------------------------------------------------------------------
+const char *CZipFile::GetView(int i)
+{
+  if (!m_pMapped || i < 0 || i >= m_nEntries)
+    return NULL;
+
+  if (m_pEntries[i].compression != Z_NO_COMPRESSION)
+    return NULL;
+
+  unsigned long offset;
+  if (!GetDataOffset(i, offset))
+    return NULL;
+
+  return m_pMapped + offset;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Inflate
+// Purpose:       Uncompress the raw bytes of a file read by ReadCompressed
+// Parameters:    The file index, the raw data and the pre-allocated buffer
+// --------------------------------------------------------------------------
+bool CZipFile::Inflate(int i, const char *pcData, char *pBuf) const
+{
+  if (pcData == NULL || pBuf == NULL || i < 0 || i >= m_nEntries)
+    return false;
+
+  const TZipEntry &fh = m_pEntries[i];
+
+  if (fh.compression == Z_NO_COMPRESSION)
+  {
+    memcpy(pBuf, pcData, fh.cSize);
+    return true;
+  }
+  else if (fh.compression != Z_DEFLATED)
+    return false;
 
   // Setup the inflate stream.
   z_stream stream;
   int err;
 
   stream.next_in = (Bytef*)pcData;
-  stream.avail_in = (uInt)h.cSize;
+  stream.avail_in = (uInt)fh.cSize;
   stream.next_out = (Bytef*)pBuf;
-  stream.avail_out = (uInt)h.ucSize;
+  stream.avail_out = (uInt)fh.ucSize;
   stream.zalloc = (alloc_func)0;
   stream.zfree = (free_func)0;
 
@@ -333,13 +781,276 @@ bool CZipFile::ReadFile(int i, char *pBuf)
     inflateEnd(&stream);
     if (err == Z_STREAM_END)
       err = Z_OK;
-    inflateEnd(&stream);
   }
-  if (err != Z_OK)
-    ret = false;
 
-  delete[] pcData;
-  return ret;
+  return err == Z_OK;
+}
+
+
+// --------------------------------------------------------------------------
+// Function:      GetCheckpoints
+// Purpose:       List the places inflating a file can start from
+// Parameters:    The file index and the list to fill in. The start of the
+//                file is always the first one, zips built by ZipPack add
+//                their full flush points.
+// --------------------------------------------------------------------------
+void CZipFile::GetCheckpoints(int i, ZipCheckpointList &checkpoints) const
+{
+  checkpoints.clear();
+
+  ZipCheckpoint start;
+  start.m_compressed = 0;
+  start.m_uncompressed = 0;
+  checkpoints.push_back(start);
+
+  if (i < 0 || i >= m_nEntries)
+    return;
+
+  const TZipEntry &entry = m_pEntries[i];
+  for (dword c = 0; c < entry.numCheckpoints; c++)
+    checkpoints.push_back(m_pCheckpoints[entry.firstCheckpoint + c]);
+}
+
+
+
+// --------------------------------------------------------------------------
+// Function:      CZipStream
+// Purpose:       Set up a closed stream
+// --------------------------------------------------------------------------
+CZipStream::CZipStream()
+{
+  m_pZip = NULL;
+  m_index = -1;
+  m_deflated = false;
+  m_dataOffset = 0;
+  m_compressedLength = 0;
+  m_length = 0;
+  m_pos = 0;
+  m_inPos = 0;
+  m_ended = false;
+  m_pStream = NULL;
+  m_pInput = NULL;
+  m_pSkip = NULL;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Open
+// Purpose:       Start reading a file from the beginning
+// Parameters:    The zip and the file index
+// --------------------------------------------------------------------------
+bool CZipStream::Open(CZipFile *pZip, int i)
+{
+  Close();
+
+  if (pZip == NULL || i < 0 || i >= pZip->m_nEntries)
+    return false;
+
+  const CZipFile::TZipEntry &fh = pZip->m_pEntries[i];
+  if (fh.compression != Z_NO_COMPRESSION && fh.compression != Z_DEFLATED)
+    return false;
+
+  if (!pZip->GetDataOffset(i, m_dataOffset))
+    return false;
+
+  m_pZip = pZip;
+  m_index = i;
+  m_deflated = fh.compression == Z_DEFLATED;
+  m_compressedLength = fh.cSize;
+  m_length = fh.ucSize;
+  m_pos = 0;
+
+  if (!m_deflated)
+    return true;
+
+  pZip->GetCheckpoints(i, m_checkpoints);
+
+  if (!Restart(m_checkpoints.front()))
+  {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Close
+// Purpose:       Free the inflate state and buffers
+// --------------------------------------------------------------------------
+void CZipStream::Close()
+{
+  if (m_pStream)
+  {
+    inflateEnd(m_pStream);
+    SAFE_DELETE(m_pStream);
+  }
+  SAFE_DELETE_ARRAY(m_pInput);
+  SAFE_DELETE_ARRAY(m_pSkip);
+  m_checkpoints.clear();
+
+  m_pZip = NULL;
+  m_index = -1;
+  m_length = 0;
+  m_pos = 0;
+  m_inPos = 0;
+  m_ended = false;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Restart
+// Purpose:       Throw away the inflate state and start over at a checkpoint
+// Parameters:    The checkpoint
+// --------------------------------------------------------------------------
+bool CZipStream::Restart(const ZipCheckpoint &checkpoint)
+{
+  if (m_pStream)
+    inflateEnd(m_pStream);
+  else
+    m_pStream = SAFE_NEW z_stream;
+
+  memset(m_pStream, 0, sizeof(z_stream));
+  m_pStream->zalloc = (alloc_func)0;
+  m_pStream->zfree = (free_func)0;
+
+  m_inPos = checkpoint.m_compressed;
+  m_pos = checkpoint.m_uncompressed;
+  m_ended = false;
+
+  // wbits < 0 indicates no zlib header inside the data.
+  if (inflateInit2(m_pStream, -MAX_WBITS) != Z_OK)
+  {
+    SAFE_DELETE(m_pStream);
+    return false;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Function:      FillInput
+// Purpose:       Give zlib more compressed data. A mapped zip hands over the
+//                rest of the file at once, otherwise it's read in pieces.
+// --------------------------------------------------------------------------
+bool CZipStream::FillInput()
+{
+  unsigned long left = m_compressedLength - m_inPos;
+  if (left == 0)
+    return false;
+
+  if (m_pZip->m_pMapped)
+  {
+    m_pStream->next_in = (Bytef*)(m_pZip->m_pMapped + m_dataOffset + m_inPos);
+  }
+  else
+  {
+    if (!m_pInput)
+      m_pInput = SAFE_NEW char[INPUT_SIZE];
+    if (left > INPUT_SIZE)
+      left = INPUT_SIZE;
+    if (!m_pZip->ReadAt(m_dataOffset + m_inPos, m_pInput, left))
+      return false;
+    m_pStream->next_in = (Bytef*)m_pInput;
+  }
+
+  m_pStream->avail_in = (uInt)left;
+  m_inPos += left;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Inflate
+// Purpose:       Inflate up to n bytes at the current position
+// Parameters:    The buffer and the number of bytes. Returns how many were
+//                inflated.
+// --------------------------------------------------------------------------
+int CZipStream::Inflate(char *pBuf, int n)
+{
+  m_pStream->next_out = (Bytef*)pBuf;
+  m_pStream->avail_out = (uInt)n;
+
+  while (m_pStream->avail_out > 0 && !m_ended)
+  {
+    if (m_pStream->avail_in == 0 && !FillInput())
+      break;
+
+    int err = inflate(m_pStream, Z_SYNC_FLUSH);
+    if (err == Z_STREAM_END)
+      m_ended = true;
+    else if (err != Z_OK)
+      break;
+  }
+
+  int done = n - (int)m_pStream->avail_out;
+  m_pos += done;
+  return done;
+}
+
+// --------------------------------------------------------------------------
+// Function:      Read
+// Purpose:       Read from the current position
+// Parameters:    The buffer and the number of bytes. Returns how many were
+//                read, less than asked for at the end of the file.
+// --------------------------------------------------------------------------
+int CZipStream::Read(void *pBuf, int n)
+{
+  if (!IsOpen() || pBuf == NULL || n <= 0)
+    return 0;
+
+  if (n > m_length - m_pos)
+    n = m_length - m_pos;
+
+  if (!m_deflated)
+  {
+    if (!m_pZip->ReadAt(m_dataOffset + m_pos, pBuf, n))
+      return 0;
+    m_pos += n;
+    return n;
+  }
+
+  return Inflate((char *)pBuf, n);
+}
+
+// --------------------------------------------------------------------------
+// Function:      Seek
+// Purpose:       Move to an uncompressed position
+// Parameters:    The position from the start of the file
+// --------------------------------------------------------------------------
+bool CZipStream::Seek(int pos)
+{
+  if (!IsOpen() || pos < 0 || pos > m_length)
+    return false;
+
+  if (!m_deflated)
+  {
+    m_pos = pos;
+    return true;
+  }
+
+  // Start over from the closest checkpoint if going backwards, or if there's
+  // one between here and there.
+  int best = 0;
+  for (int c = 1; c < (int)m_checkpoints.size(); c++)
+  {
+    if (m_checkpoints[c].m_uncompressed <= (unsigned long)pos)
+      best = c;
+  }
+
+  if (pos < m_pos || (int)m_checkpoints[best].m_uncompressed > m_pos)
+  {
+    if (!Restart(m_checkpoints[best]))
+      return false;
+  }
+
+  if (m_pos < pos && !m_pSkip)
+    m_pSkip = SAFE_NEW char[SKIP_SIZE];
+
+  while (m_pos < pos)
+  {
+    int n = pos - m_pos;
+    if (n > SKIP_SIZE)
+      n = SKIP_SIZE;
+    if (Inflate(m_pSkip, n) == 0)
+      return false;
+  }
+  return true;
 }
 
 
@@ -42,14 +42,27 @@
 
 
 #include <stdio.h>
+#include <vector>
 
-typedef std::map<std::string, int> ZipContentsMap;		// maps path to a zip content id
+// A place inflating can start over from: the compressed offset (from the start
+// of the file data) and the uncompressed offset it decodes to.
+struct ZipCheckpoint
+{
+  unsigned long m_compressed;
+  unsigned long m_uncompressed;
+};
+
+typedef std::vector<ZipCheckpoint> ZipCheckpointList;
+
+class CZipStream;
 
 class CZipFile
 {
+  friend class CZipStream;
+
   public:
-    CZipFile() { m_nEntries=0; m_pFile=NULL; m_pDirData=NULL; }
-    virtual ~CZipFile() { End(); fclose(m_pFile); }
+    CZipFile() { m_nEntries=0; m_pDirData=NULL; m_pEntries=NULL; m_pCheckpoints=NULL; m_pNames=NULL; m_pHashTable=NULL; m_hashMask=0; m_hFile=NULL; m_hMapping=NULL; m_pMapped=NULL; m_fileSize=0; }
+    virtual ~CZipFile() { End(); }
 
     bool Init(const _TCHAR *resFileName);
     void End();
@@ -57,22 +70,95 @@ class CZipFile
     int GetNumFiles()const { return m_nEntries; }
     void GetFilename(int i, char *pszDest) const;
     int GetFileLen(int i) const;
+    int GetCompressedLen(int i) const;
     bool ReadFile(int i, char *pBuf);
+    bool ReadFiles(int count, const int *pIndices, char **ppBufs, bool *pResults = NULL, int numThreads = 0);
+    bool ReadCompressed(int i, char *pBuf);
+    bool Inflate(int i, const char *pcData, char *pBuf) const;
+    const char *GetView(int i);
+    void GetCheckpoints(int i, ZipCheckpointList &checkpoints) const;
 	int Find(const char *path) const;
-
-	ZipContentsMap m_ZipContentsMap;
+	int Find(const char *path, int len) const;
+	void FindAll(const char *dir, std::vector<int> &indices) const;
 
   private:
     struct TZipDirHeader;
     struct TZipDirFileHeader;
     struct TZipLocalHeader;
+    struct TZipEntry;
 
-    FILE *m_pFile;		// Zip file
-    char *m_pDirData;	// Raw data buffer.
+    HANDLE m_hFile;		// Zip file, only read from when it couldn't be mapped
+    HANDLE m_hMapping;
+    const char *m_pMapped;	// The whole zip file mapped into memory
+    unsigned long m_fileSize;
+    char *m_pDirData;	// Raw central directory or pack index.
     int  m_nEntries;	// Number of entries.
 
-    // Pointers to the dir entries in pDirData.
-    const TZipDirFileHeader **m_papDir;   
+    // One per file, filled in from whichever of the two was read.
+    TZipEntry *m_pEntries;
+    ZipCheckpoint *m_pCheckpoints;
+
+    // Name index. Names are lower case with backslashes, one after the other.
+    char *m_pNames;
+    int *m_pHashTable;				// open addressing, entry index or -1
+    unsigned int m_hashMask;
+
+    bool Open(const _TCHAR *resFileName);
+    bool ReadDirectory(const TZipDirHeader &dh);
+    bool ReadPackIndex(const _TCHAR *resFileName, const TZipDirHeader &dh);
+    bool BuildNameIndex(unsigned int namesSize);
+    bool ReadAt(unsigned long offset, void *pBuf, unsigned long size);
+    bool GetDataOffset(int i, unsigned long &offset);
 };
 
 
+struct z_stream_s;
+
+// --------------------------------------------------------------------------
+// Class:         CZipStream
+// Purpose:       Reads a file inside the zip a piece at a time so large files
+//                never have to be in memory all at once. Seeking backwards
+//                starts inflating again from the closest checkpoint, seeking
+//                forwards inflates and throws away what is skipped.
+// --------------------------------------------------------------------------
+class CZipStream
+{
+  public:
+    CZipStream();
+    ~CZipStream() { Close(); }
+
+    bool Open(CZipFile *pZip, int i);
+    void Close();
+
+    int Read(void *pBuf, int n);
+    bool Seek(int pos);
+    int Tell() const { return m_pos; }
+    int GetLength() const { return m_length; }
+    bool IsOpen() const { return m_pZip != NULL; }
+
+  private:
+    enum
+    {
+      INPUT_SIZE = 64 * 1024,		// compressed bytes read at once when not mapped
+      SKIP_SIZE = 32 * 1024			// scratch for data skipped by a seek
+    };
+
+    CZipFile *m_pZip;
+    int m_index;
+    bool m_deflated;
+    unsigned long m_dataOffset;		// where the file data starts in the zip
+    unsigned long m_compressedLength;
+    int m_length;
+    int m_pos;						// uncompressed position
+    unsigned long m_inPos;			// compressed bytes handed to zlib so far
+    bool m_ended;
+    ZipCheckpointList m_checkpoints;
+
+    z_stream_s *m_pStream;
+    char *m_pInput;
+    char *m_pSkip;
+
+    bool Restart(const ZipCheckpoint &checkpoint);
+    bool FillInput();
+    int Inflate(char *pBuf, int n);
+};
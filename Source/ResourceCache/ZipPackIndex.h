@@ -0,0 +1,53 @@
+#pragma once
+//========================================================================
+// ZipPackIndex.h : Layout of the sidecar index written by the ZipPack tool.
+//
+// The index sits next to the zip as <zip name>.idx and holds what CZipFile
+// needs to open the zip without parsing the central directory: where the
+// data of each file starts, and the full flush points inside deflated
+// files that inflating can be restarted from.
+//========================================================================
+
+#pragma pack(1)
+
+struct TZipPackIndexHeader
+{
+  enum
+  {
+    SIGNATURE = 0x5844495a,		// "ZIDX"
+    VERSION = 1
+  };
+  unsigned long   sig;
+  unsigned long   version;
+  unsigned long   archiveSize;	// The index is ignored if these two don't
+  unsigned long   dirOffset;	// match the zip next to it.
+  unsigned long   numEntries;
+  unsigned long   numSyncPoints;
+  unsigned long   namesSize;
+};
+
+// The header is followed by numEntries entries, numSyncPoints sync points and
+// then the names, which aren't NUL terminated and use backslashes.
+struct TZipPackIndexEntry
+{
+  unsigned long   hdrOffset;		// Local header
+  unsigned long   dataOffset;		// File data, past the local header
+  unsigned long   cSize;
+  unsigned long   ucSize;
+  unsigned long   crc32;
+  unsigned short  compression;
+  unsigned short  nameLen;
+  unsigned long   nameOffset;
+  unsigned long   firstSyncPoint;
+  unsigned long   numSyncPoints;
+};
+
+struct TZipPackSyncPoint
+{
+  unsigned long   compressed;		// From the start of the file data
+  unsigned long   uncompressed;
+};
+
+#pragma pack()
+
+#define ZIP_PACK_INDEX_EXT L".idx"
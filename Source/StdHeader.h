@@ -34,6 +34,8 @@
 #include <dxstdafx.h>
 #include <d3dx9tex.h>
 
+// shared_ptr control blocks come from a pool instead of the heap.
+#define BOOST_SP_USE_QUICK_ALLOCATOR
 #include <boost\config.hpp>
 #include <boost\shared_ptr.hpp>
 
@@ -0,0 +1,692 @@
+//========================================================================
+// ZipPack.cpp : Builds resource zips laid out for the way the game reads them.
+//
+// Usage: ZipPack [-pak] <source dir> <output zip> [manifest]
+//
+// - Files named in the manifest (a resource manifest recorded with
+//   -recordmanifest, or just one name per line) are written first, in the
+//   order they are listed, so a cold load reads the zip front to back.
+//   Everything else follows, sorted by name so directories stay together.
+// - Formats that are already compressed, and files deflate can't shrink,
+//   are stored. Stored data is aligned to a page so CZipFile can hand it
+//   out straight from the mapped zip.
+// - Large deflated files get a full flush every SYNC_INTERVAL bytes, so
+//   CZipStream can seek without inflating from the start.
+// - <output zip>.idx is written next to the zip, see ZipPackIndex.h.
+//
+// With -pak it writes the native pack instead (see PackFormat.h), in the
+// same order, with LZBlock compressed blocks and no index file.
+//========================================================================
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "ResourceCache\zlib\zlib.h"
+#include "ResourceCache\ZipPackIndex.h"
+#include "ResourceCache\PackFormat.h"
+#include "ResourceCache\LZBlock.h"
+
+#pragma comment(lib, "zlib.lib")
+
+typedef unsigned long dword;
+typedef unsigned short word;
+
+enum
+{
+	DATA_ALIGNMENT = 4096,				// stored data starts on a page
+	SYNC_INTERVAL = 256 * 1024,			// uncompressed bytes between full flushes
+	DEFLATE_CHUNK = 64 * 1024,
+	PACK_BLOCK_SIZE = 64 * 1024,		// uncompressed bytes per pack block
+	PADDING_EXTRA_ID = 0xd935			// extra field id used for alignment padding
+};
+
+// Extensions that are already compressed and only get bigger in a deflate stream.
+static const char *g_storedExtensions[] = { "ogg", "mp3", "jpg", "jpeg", "png", "zip", "gz", "pk3", NULL };
+
+#pragma pack(1)
+struct TZipLocalHeader
+{
+	enum { SIGNATURE = 0x04034b50 };
+	dword   sig;
+	word    version;
+	word    flag;
+	word    compression;
+	word    modTime;
+	word    modDate;
+	dword   crc32;
+	dword   cSize;
+	dword   ucSize;
+	word    fnameLen;
+	word    xtraLen;
+};
+
+struct TZipDirFileHeader
+{
+	enum { SIGNATURE = 0x02014b50 };
+	dword   sig;
+	word    verMade;
+	word    verNeeded;
+	word    flag;
+	word    compression;
+	word    modTime;
+	word    modDate;
+	dword   crc32;
+	dword   cSize;
+	dword   ucSize;
+	word    fnameLen;
+	word    xtraLen;
+	word    cmntLen;
+	word    diskStart;
+	word    intAttr;
+	dword   extAttr;
+	dword   hdrOffset;
+};
+
+struct TZipDirHeader
+{
+	enum { SIGNATURE = 0x06054b50 };
+	dword   sig;
+	word    nDisk;
+	word    nStartDisk;
+	word    nDirEntries;
+	word    totalDirEntries;
+	dword   dirSize;
+	dword   dirOffset;
+	word    cmntLen;
+};
+#pragma pack()
+
+struct PackFile
+{
+	std::string m_path;					// on disk
+	std::string m_name;					// in the zip, with forward slashes
+	dword m_size;
+	word m_modTime;
+	word m_modDate;
+
+	TZipDirFileHeader m_dir;
+	dword m_dataOffset;
+	std::vector<TZipPackSyncPoint> m_syncPoints;
+};
+
+typedef std::vector<PackFile> PackFileList;
+
+
+static std::string FoldName(const std::string &name)
+{
+	std::string folded = name;
+	for (std::string::size_type i = 0; i < folded.size(); i++)
+	{
+		if (folded[i] == '\\')
+			folded[i] = '/';
+		else
+			folded[i] = (char)tolower((unsigned char)folded[i]);
+	}
+	return folded;
+}
+
+static bool SortByName(const PackFile &a, const PackFile &b)
+{
+	return FoldName(a.m_name) < FoldName(b.m_name);
+}
+
+static bool IsStoredExtension(const std::string &name)
+{
+	std::string::size_type dot = name.find_last_of('.');
+	if (dot == std::string::npos || name.find('/', dot) != std::string::npos)
+		return false;
+
+	std::string ext = FoldName(name.substr(dot + 1));
+	for (int i = 0; g_storedExtensions[i]; i++)
+		if (ext == g_storedExtensions[i])
+			return true;
+	return false;
+}
+
+// Adds every file under dir, recursively. prefix is dir relative to the source dir.
+static void FindFiles(const std::string &dir, const std::string &prefix, PackFileList &files)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		if (!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, ".."))
+			continue;
+
+		std::string path = dir + "\\" + data.cFileName;
+		std::string name = prefix + data.cFileName;
+
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			FindFiles(path, name + "/", files);
+			continue;
+		}
+
+		PackFile file;
+		file.m_path = path;
+		file.m_name = name;
+		file.m_size = data.nFileSizeLow;
+		FILETIME local;
+		FileTimeToLocalFileTime(&data.ftLastWriteTime, &local);
+		FileTimeToDosDateTime(&local, &file.m_modDate, &file.m_modTime);
+		file.m_dataOffset = 0;
+		memset(&file.m_dir, 0, sizeof(file.m_dir));
+		files.push_back(file);
+	}
+	while (FindNextFileA(find, &data));
+
+	FindClose(find);
+}
+
+// Reads the names out of a manifest, in order. Lines are either "time size name"
+// as written by ResCache::StopRecording or just a name.
+static void ReadManifest(const char *fileName, std::vector<std::string> &names)
+{
+	FILE *file = fopen(fileName, "rt");
+	if (!file)
+	{
+		printf("Can't open manifest %s, using name order\n", fileName);
+		return;
+	}
+
+	char line[_MAX_PATH + 64];
+	while (fgets(line, sizeof(line), file))
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == '#' || line[0] == 0)
+			continue;
+
+		unsigned int time, size;
+		int nameStart = 0;
+		const char *name = line;
+		if (sscanf(line, "%u %u %n", &time, &size, &nameStart) == 2 && nameStart > 0)
+			name = line + nameStart;
+
+		if (name[0])
+			names.push_back(FoldName(name));
+	}
+	fclose(file);
+}
+
+// Manifest files first in manifest order, then the rest by name. Each name
+// is folded once, and a file found is taken out of the map so it isn't
+// used twice.
+static void OrderFiles(PackFileList &files, const std::vector<std::string> &manifest)
+{
+	std::sort(files.begin(), files.end(), SortByName);
+
+	// Sorted first, so of names that fold the same the first by name wins.
+	std::map<std::string, size_t> byName;
+	for (size_t f = 0; f < files.size(); f++)
+		byName.insert(std::make_pair(FoldName(files[f].m_name), f));
+
+	PackFileList ordered;
+	std::vector<bool> used(files.size(), false);
+
+	for (size_t m = 0; m < manifest.size(); m++)
+	{
+		std::map<std::string, size_t>::iterator it = byName.find(manifest[m]);
+		if (it == byName.end())
+			continue;
+
+		ordered.push_back(files[(*it).second]);
+		used[(*it).second] = true;
+		byName.erase(it);
+	}
+
+	for (size_t f = 0; f < files.size(); f++)
+		if (!used[f])
+			ordered.push_back(files[f]);
+
+	files.swap(ordered);
+}
+
+static bool ReadWholeFile(const std::string &path, std::vector<char> &data)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data.resize(size);
+	bool ok = size == 0 || fread(&data[0], size, 1, file) == 1;
+	fclose(file);
+	return ok;
+}
+
+// Raw deflate, with a full flush every SYNC_INTERVAL bytes. After a full flush
+// the output is byte aligned and nothing refers back past it, so inflating can
+// start there with a fresh stream.
+static bool Deflate(const std::vector<char> &in, std::vector<char> &out, std::vector<TZipPackSyncPoint> &syncPoints)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	out.clear();
+	syncPoints.clear();
+
+	char chunk[DEFLATE_CHUNK];
+	size_t pos = 0;
+	bool ok = true;
+
+	do
+	{
+		size_t len = in.size() - pos;
+		if (len > SYNC_INTERVAL)
+			len = SYNC_INTERVAL;
+
+		int flush = (pos + len < in.size()) ? Z_FULL_FLUSH : Z_FINISH;
+		stream.next_in = len ? (Bytef *)&in[pos] : NULL;
+		stream.avail_in = (uInt)len;
+
+		int err;
+		do
+		{
+			stream.next_out = (Bytef *)chunk;
+			stream.avail_out = sizeof(chunk);
+			err = deflate(&stream, flush);
+			out.insert(out.end(), chunk, chunk + (sizeof(chunk) - stream.avail_out));
+		}
+		while (err == Z_OK && (stream.avail_out == 0 || stream.avail_in > 0));
+
+		if (err != Z_OK && err != Z_STREAM_END)
+			ok = false;
+
+		pos += len;
+		if (flush == Z_FULL_FLUSH)
+		{
+			TZipPackSyncPoint sync;
+			sync.compressed = (dword)out.size();
+			sync.uncompressed = (dword)pos;
+			syncPoints.push_back(sync);
+		}
+	}
+	while (ok && pos < in.size());
+
+	deflateEnd(&stream);
+	return ok;
+}
+
+static bool Write(FILE *file, const void *data, size_t size)
+{
+	return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+// Writes one file's local header and data. Stored data is padded out to
+// DATA_ALIGNMENT with an extra field.
+static bool WritePackFile(FILE *out, PackFile &file)
+{
+	std::vector<char> data;
+	if (!ReadWholeFile(file.m_path, data))
+	{
+		printf("Can't read %s\n", file.m_path.c_str());
+		return false;
+	}
+
+	dword crc = crc32(0L, Z_NULL, 0);
+	if (!data.empty())
+		crc = crc32(crc, (const Bytef *)&data[0], (uInt)data.size());
+
+	std::vector<char> deflated;
+	bool store = IsStoredExtension(file.m_name) || data.empty();
+	if (!store)
+	{
+		if (!Deflate(data, deflated, file.m_syncPoints))
+		{
+			printf("Can't deflate %s\n", file.m_path.c_str());
+			return false;
+		}
+
+		// Not worth inflating for less than a few percent.
+		store = deflated.size() >= data.size() - data.size() / 32;
+	}
+	if (store)
+		file.m_syncPoints.clear();
+
+	const std::vector<char> &payload = store ? data : deflated;
+
+	dword hdrOffset = (dword)ftell(out);
+	dword dataOffset = hdrOffset + sizeof(TZipLocalHeader) + (dword)file.m_name.size();
+
+	word xtraLen = 0;
+	if (store && dataOffset % DATA_ALIGNMENT)
+	{
+		xtraLen = (word)(DATA_ALIGNMENT - dataOffset % DATA_ALIGNMENT);
+		if (xtraLen < 4)
+			xtraLen += DATA_ALIGNMENT;
+		dataOffset += xtraLen;
+	}
+
+	TZipLocalHeader h;
+	memset(&h, 0, sizeof(h));
+	h.sig = TZipLocalHeader::SIGNATURE;
+	h.version = 20;
+	h.compression = store ? Z_NO_COMPRESSION : Z_DEFLATED;
+	h.modTime = file.m_modTime;
+	h.modDate = file.m_modDate;
+	h.crc32 = crc;
+	h.cSize = (dword)payload.size();
+	h.ucSize = (dword)data.size();
+	h.fnameLen = (word)file.m_name.size();
+	h.xtraLen = xtraLen;
+
+	bool ok = Write(out, &h, sizeof(h)) && Write(out, file.m_name.c_str(), file.m_name.size());
+
+	if (xtraLen)
+	{
+		std::vector<char> padding(xtraLen, 0);
+		word *pField = (word *)&padding[0];
+		pField[0] = PADDING_EXTRA_ID;
+		pField[1] = (word)(xtraLen - 4);
+		ok = ok && Write(out, &padding[0], padding.size());
+	}
+
+	ok = ok && (payload.empty() || Write(out, &payload[0], payload.size()));
+
+	TZipDirFileHeader &fh = file.m_dir;
+	memset(&fh, 0, sizeof(fh));
+	fh.sig = TZipDirFileHeader::SIGNATURE;
+	fh.verMade = 20;
+	fh.verNeeded = 20;
+	fh.compression = h.compression;
+	fh.modTime = h.modTime;
+	fh.modDate = h.modDate;
+	fh.crc32 = h.crc32;
+	fh.cSize = h.cSize;
+	fh.ucSize = h.ucSize;
+	fh.fnameLen = h.fnameLen;
+	fh.hdrOffset = hdrOffset;
+	file.m_dataOffset = dataOffset;
+
+	printf("%s %-40s %9u -> %9u\n", store ? "stored  " : "deflated", file.m_name.c_str(), h.ucSize, h.cSize);
+	return ok;
+}
+
+static bool WriteIndex(const std::string &fileName, const PackFileList &files, dword archiveSize, dword dirOffset)
+{
+	TZipPackIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	header.sig = TZipPackIndexHeader::SIGNATURE;
+	header.version = TZipPackIndexHeader::VERSION;
+	header.archiveSize = archiveSize;
+	header.dirOffset = dirOffset;
+	header.numEntries = (dword)files.size();
+
+	std::vector<TZipPackIndexEntry> entries;
+	std::vector<TZipPackSyncPoint> syncPoints;
+	std::string names;
+
+	for (size_t f = 0; f < files.size(); f++)
+	{
+		const PackFile &file = files[f];
+
+		TZipPackIndexEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.hdrOffset = file.m_dir.hdrOffset;
+		entry.dataOffset = file.m_dataOffset;
+		entry.cSize = file.m_dir.cSize;
+		entry.ucSize = file.m_dir.ucSize;
+		entry.crc32 = file.m_dir.crc32;
+		entry.compression = file.m_dir.compression;
+		entry.nameLen = (word)file.m_name.size();
+		entry.nameOffset = (dword)names.size();
+		entry.firstSyncPoint = (dword)syncPoints.size();
+		entry.numSyncPoints = (dword)file.m_syncPoints.size();
+		entries.push_back(entry);
+
+		syncPoints.insert(syncPoints.end(), file.m_syncPoints.begin(), file.m_syncPoints.end());
+
+		// CZipFile works with backslashes.
+		std::string name = file.m_name;
+		std::replace(name.begin(), name.end(), '/', '\\');
+		names += name;
+	}
+
+	header.numSyncPoints = (dword)syncPoints.size();
+	header.namesSize = (dword)names.size();
+
+	FILE *out = fopen(fileName.c_str(), "wb");
+	if (!out)
+		return false;
+
+	bool ok = Write(out, &header, sizeof(header)) &&
+		(entries.empty() || Write(out, &entries[0], entries.size() * sizeof(entries[0]))) &&
+		(syncPoints.empty() || Write(out, &syncPoints[0], syncPoints.size() * sizeof(syncPoints[0]))) &&
+		Write(out, names.c_str(), names.size());
+
+	return fclose(out) == 0 && ok;
+}
+
+// Writes the native pack. The size of the table of contents is known up front
+// from the names and file sizes, so the data goes right after it and the
+// table is filled in at the end.
+static bool WritePack(const std::string &fileName, const PackFileList &files)
+{
+	TPackHeader header;
+	memset(&header, 0, sizeof(header));
+	header.sig = TPackHeader::SIGNATURE;
+	header.version = TPackHeader::VERSION;
+	header.blockSize = PACK_BLOCK_SIZE;
+	header.numSlots = 16;
+	while (header.numSlots < files.size() * 2)
+		header.numSlots <<= 1;
+	header.numEntries = (dword)files.size();
+
+	std::vector<dword> slots(header.numSlots, PACK_EMPTY_SLOT);
+	std::vector<TPackEntry> entries;
+	std::vector<TPackBlock> blocks;
+	std::string names;
+
+	for (size_t f = 0; f < files.size(); f++)
+	{
+		std::string name = files[f].m_name;
+		for (size_t c = 0; c < name.size(); c++)
+			name[c] = PackFoldChar(name[c]);
+
+		TPackEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.nameHash = PackHashName(name.c_str(), (int)name.size());
+		entry.nameOffset = (dword)names.size();
+		entry.nameLen = (word)name.size();
+		names += name;
+		entries.push_back(entry);
+
+		// A later file with the same name wins, like in a zip.
+		dword slot = entry.nameHash & (header.numSlots - 1);
+		while (slots[slot] != PACK_EMPTY_SLOT)
+		{
+			const TPackEntry &other = entries[slots[slot]];
+			if (other.nameHash == entry.nameHash && other.nameLen == entry.nameLen &&
+				!memcmp(&names[other.nameOffset], &names[entry.nameOffset], entry.nameLen))
+				break;
+			slot = (slot + 1) & (header.numSlots - 1);
+		}
+		slots[slot] = (dword)f;
+	}
+	header.namesSize = (dword)names.size();
+
+	FILE *out = fopen(fileName.c_str(), "wb");
+	if (!out)
+		return false;
+
+	for (size_t f = 0; f < files.size(); f++)
+	{
+		entries[f].size = files[f].m_size;
+		entries[f].numBlocks = (entries[f].size + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE;
+		header.numBlocks += entries[f].numBlocks;
+	}
+
+	dword tocSize = sizeof(header) + header.numSlots * sizeof(dword) + header.numEntries * sizeof(TPackEntry) +
+		header.numBlocks * sizeof(TPackBlock) + header.namesSize;
+	header.dataOffset = (tocSize + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+	bool ok = fseek(out, header.dataOffset, SEEK_SET) == 0;
+	std::vector<char> compressed(LZBlockBound(PACK_BLOCK_SIZE));
+
+	for (size_t f = 0; f < files.size() && ok; f++)
+	{
+		TPackEntry &entry = entries[f];
+		std::vector<char> data;
+		if (!ReadWholeFile(files[f].m_path, data) || data.size() != entry.size)
+		{
+			printf("Can't read %s\n", files[f].m_path.c_str());
+			ok = false;
+			break;
+		}
+
+		bool storeAll = IsStoredExtension(files[f].m_name);
+
+		// Stored files are aligned so the game can use them in place.
+		if (storeAll && entry.size)
+		{
+			dword pos = (dword)ftell(out);
+			dword pad = (DATA_ALIGNMENT - pos % DATA_ALIGNMENT) % DATA_ALIGNMENT;
+			std::vector<char> padding(pad + 1, 0);
+			ok = Write(out, &padding[0], pad);
+		}
+
+		entry.firstBlock = (dword)blocks.size();
+		entry.flags = TPackEntry::STORED;
+		dword packedSize = 0;
+
+		for (dword b = 0; b < entry.numBlocks && ok; b++)
+		{
+			dword start = b * PACK_BLOCK_SIZE;
+			dword len = entry.size - start;
+			if (len > PACK_BLOCK_SIZE)
+				len = PACK_BLOCK_SIZE;
+
+			int compressedLen = 0;
+			if (!storeAll)
+				compressedLen = LZBlockCompress(&data[start], len, &compressed[0], (int)compressed.size());
+
+			TPackBlock block;
+			block.offset = (dword)ftell(out);
+
+			// Not worth decoding for less than a few percent.
+			if (compressedLen > 0 && (dword)compressedLen < len - len / 32)
+			{
+				block.compressedSize = compressedLen;
+				entry.flags = 0;
+				ok = Write(out, &compressed[0], compressedLen);
+			}
+			else
+			{
+				block.compressedSize = len | TPackBlock::STORED;
+				ok = Write(out, &data[start], len);
+			}
+			packedSize += block.compressedSize & ~TPackBlock::STORED;
+			blocks.push_back(block);
+		}
+
+		printf("%s %-40s %9u -> %9u\n", entry.flags ? "stored  " : "lz      ", files[f].m_name.c_str(), entry.size, packedSize);
+	}
+
+	ok = ok && fseek(out, 0, SEEK_SET) == 0 &&
+		Write(out, &header, sizeof(header)) &&
+		Write(out, &slots[0], slots.size() * sizeof(slots[0])) &&
+		(entries.empty() || Write(out, &entries[0], entries.size() * sizeof(entries[0]))) &&
+		(blocks.empty() || Write(out, &blocks[0], blocks.size() * sizeof(blocks[0]))) &&
+		Write(out, names.c_str(), names.size());
+
+	return fclose(out) == 0 && ok;
+}
+
+int main(int argc, char *argv[])
+{
+	bool pak = argc > 1 && !strcmp(argv[1], "-pak");
+	if (pak)
+	{
+		argc--;
+		argv++;
+	}
+
+	if (argc < 3)
+	{
+		printf("Usage: ZipPack [-pak] <source dir> <output zip> [manifest]\n");
+		return 1;
+	}
+
+	std::string sourceDir = argv[1];
+	std::string zipName = argv[2];
+
+	PackFileList files;
+	FindFiles(sourceDir, "", files);
+	if (files.empty() || files.size() > 0xffff)
+	{
+		printf("Found %u files in %s, need 1 to 65535\n", (unsigned int)files.size(), sourceDir.c_str());
+		return 1;
+	}
+
+	std::vector<std::string> manifest;
+	if (argc > 3)
+		ReadManifest(argv[3], manifest);
+
+	OrderFiles(files, manifest);
+
+	if (pak)
+	{
+		if (!WritePack(zipName, files))
+		{
+			printf("Failed writing %s\n", zipName.c_str());
+			remove(zipName.c_str());
+			return 1;
+		}
+		printf("%u files\n", (unsigned int)files.size());
+		return 0;
+	}
+
+	FILE *out = fopen(zipName.c_str(), "wb");
+	if (!out)
+	{
+		printf("Can't create %s\n", zipName.c_str());
+		return 1;
+	}
+
+	bool ok = true;
+	for (size_t f = 0; f < files.size() && ok; f++)
+		ok = WritePackFile(out, files[f]);
+
+	// Central directory, then the end record without a comment, which is all
+	// CZipFile looks for.
+	dword dirOffset = (dword)ftell(out);
+	for (size_t f = 0; f < files.size() && ok; f++)
+		ok = Write(out, &files[f].m_dir, sizeof(files[f].m_dir)) && Write(out, files[f].m_name.c_str(), files[f].m_name.size());
+
+	TZipDirHeader dh;
+	memset(&dh, 0, sizeof(dh));
+	dh.sig = TZipDirHeader::SIGNATURE;
+	dh.nDirEntries = (word)files.size();
+	dh.totalDirEntries = (word)files.size();
+	dh.dirOffset = dirOffset;
+	dh.dirSize = (dword)ftell(out) - dirOffset;
+	ok = ok && Write(out, &dh, sizeof(dh));
+
+	dword archiveSize = (dword)ftell(out);
+	ok = (fclose(out) == 0) && ok;
+
+	if (!ok || !WriteIndex(zipName + ".idx", files, archiveSize, dirOffset))
+	{
+		printf("Failed writing %s\n", zipName.c_str());
+		remove(zipName.c_str());
+		return 1;
+	}
+
+	printf("%u files, %u bytes\n", (unsigned int)files.size(), archiveSize);
+	return 0;
+}
@@ -34,6 +34,12 @@ INT WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
 	if (!g_App->InitInstance(hInstance, lpCmdLine) )
 		return FALSE;
 
+	// A replay or a headless run has no window.
+	if (g_App->IsReplaying())
+		return g_App->RunReplay();
+	if (g_App->IsHeadless())
+		return g_App->RunHeadless();
+
 	DXUTMainLoop();
 
 	DXUTSimpleShutdown();